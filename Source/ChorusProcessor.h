@@ -0,0 +1,314 @@
+/**
+ * A multi-tap chorus/ensemble.  Each channel's delay line is read by 2 to 8
+ * taps, each with its own phase of a shared sine LFO, and the taps are mixed
+ * with the dry signal.
+ *
+ * juce::dsp::Chorus works out its LFO and fractional delay one tap and one
+ * sample at a time.  Here the LFO comes from a table shared by every
+ * instance and is only read at the start and end of each short sub-block;
+ * in between, the delays are ramped linearly.  The taps are processed side by
+ * side in juce::dsp::SIMDRegister lanes, so that ramping, interpolating and
+ * mixing 8 taps costs about the same as 1.  Only the delay line reads
+ * themselves are done per tap, as SIMDRegister has no gather.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+#include "Config.h"
+
+class ChorusProcessor: public juce_igutil::Processor
+{
+public:
+
+    static const int minTaps = 2;
+    static const int maxTaps = 8;
+
+    /**
+     * Constructor.
+     *
+     * @param numTapsPerChannel number of modulated taps, minTaps to maxTaps.
+     */
+    ChorusProcessor(const int numTapsPerChannel):
+        juce_igutil::Processor(),
+        numTaps(juce::jlimit(minTaps, maxTaps, numTapsPerChannel)),
+        numRegisters((numTaps + simdWidth - 1) / simdWidth),
+        lfoTable(getLfoTable())
+    {
+        jassert(numTapsPerChannel >= minTaps && numTapsPerChannel <= maxTaps);
+
+        // spread the taps evenly over the LFO cycle, and average them so low
+        // frequencies (which stay in phase) don't get any louder.  Unused 
+        // lanes keep a gain of 0.
+        for (int tap = 0; tap < numTaps; ++tap) {
+            tapPhaseOffset[tap] = static_cast<float>(tap) / numTaps;
+            tapGain[tap] = 1.0f / numTaps;
+        }
+    }
+
+    /** Destructor. */
+    virtual ~ChorusProcessor() = default;
+
+    /**
+     * Set wet/dry mix (1.0 = full wet, 0.0 = full dry)
+     */
+    void setMix(const float wetToDryRatio)
+    {
+        wetGain.setTargetValue(wetToDryRatio);
+        dryGain.setTargetValue(1.0f - wetToDryRatio);
+    }
+
+    /** LFO rate in Hz. */
+    void setRate(const float newRateHz)
+    {
+        rateHz = newRateHz;
+    }
+
+    /** Centre delay and how far the LFO moves it either way, in ms. */
+    void setDelay(const float newCentreDelayMs, const float newDepthMs)
+    {
+        jassert(newDepthMs < newCentreDelayMs);
+        jassert(newCentreDelayMs + newDepthMs <= maxDelayMs);
+        centreDelayMs = newCentreDelayMs;
+        depthMs = newDepthMs;
+    }
+
+    /** Prepare to process audio.  */
+    void prepare(const juce::dsp::ProcessSpec & spec) override
+    {
+        sampleRate = spec.sampleRate;
+
+        const int maxDelaySamples = static_cast<int>(std::ceil(maxDelayMs * 0.001 * sampleRate)) + 2;
+        delaySize = juce::nextPowerOfTwo(maxDelaySamples);
+        delayMask = delaySize - 1;
+        delayLines.resize(spec.numChannels);
+        for (auto & line : delayLines) {
+            line.assign(delaySize, 0.0f);
+        }
+        channels.resize(spec.numChannels);
+
+        wetRamp.resize(spec.maximumBlockSize);
+        dryRamp.resize(spec.maximumBlockSize);
+        wetGain.reset(sampleRate, config::parameterSmoothingSeconds);
+        dryGain.reset(sampleRate, config::parameterSmoothingSeconds);
+
+        reset();
+    }
+
+    /** Process audio. */
+    void process(juce::dsp::ProcessContextReplacing<float> & context) noexcept override
+    {
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        const int numChannels = juce::jmin(static_cast<int>(block.getNumChannels()),
+            static_cast<int>(channels.size()));
+        jassert(numSamples <= static_cast<int>(wetRamp.size()));
+
+        for (int ix = 0; ix < numSamples; ++ix) {
+            wetRamp[ix] = wetGain.getNextValue();
+            dryRamp[ix] = dryGain.getNextValue();
+        }
+
+        const float phaseIncrement = static_cast<float>(rateHz / sampleRate);
+        const float centreDelay = static_cast<float>(centreDelayMs * 0.001 * sampleRate);
+        const float depth = static_cast<float>(depthMs * 0.001 * sampleRate);
+
+        for (int start = 0; start < numSamples; start += lfoInterval) {
+            const int count = juce::jmin(lfoInterval, numSamples - start);
+            const float endPhase = wrap(lfoPhase + phaseIncrement * count);
+
+            for (int chan = 0; chan < numChannels; ++chan) {
+                TapState & taps = channels[chan];
+
+                // delays at the start and end of the sub-block; the right
+                // channel is a quarter cycle off from the left.
+                const float channelOffset = 0.25f * chan;
+                for (int tap = 0; tap < numTaps; ++tap) {
+                    const float offset = tapPhaseOffset[tap] + channelOffset;
+                    const float from = centreDelay + depth * readLfo(lfoPhase + offset);
+                    const float to = centreDelay + depth * readLfo(endPhase + offset);
+                    taps.delay[tap] = from;
+                    taps.slope[tap] = (to - from) / count;
+                }
+
+                processTaps(taps, delayLines[chan].data(),
+                    block.getChannelPointer(chan) + start, start, count);
+            }
+
+            writeIndex = (writeIndex + count) & delayMask;
+            lfoPhase = endPhase;
+        }
+    }
+
+    /** Reset the state. */
+    void reset() override
+    {
+        for (auto & line : delayLines) {
+            std::fill(line.begin(), line.end(), 0.0f);
+        }
+        writeIndex = 0;
+        lfoPhase = 0.0f;
+        wetGain.setCurrentAndTargetValue(wetGain.getTargetValue());
+        dryGain.setCurrentAndTargetValue(dryGain.getTargetValue());
+    }
+
+    /** The longest tap. */
+    int getTailSamples() const noexcept override
+    {
+        return static_cast<int>(std::ceil((centreDelayMs + depthMs) * 0.001 * sampleRate)) + 2;
+    }
+
+    /** Just the dry signal when the mix is fully dry. */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        if (wetGain.getTargetValue() != 0.0f) {
+            return false;
+        }
+        gain = dryGain.getTargetValue();
+        return true;
+    }
+
+    /** The delay lines and the ramps. */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        for (auto & line : delayLines) {
+            memory.add(line);
+        }
+        memory.add(channels);
+        memory.add(wetRamp);
+        memory.add(dryRamp);
+    }
+
+private:
+
+    using SIMDType = juce::dsp::SIMDRegister<float>;
+    static constexpr int simdWidth = static_cast<int>(SIMDType::SIMDNumElements);
+    static_assert(maxTaps % simdWidth == 0, "taps must fill whole SIMD registers");
+
+    // Longest delay (centre + depth) the lines are sized for, in ms.
+    static constexpr float maxDelayMs = 50.0f;
+
+    // The LFO is read every this many samples and ramped in between.
+    static const int lfoInterval = 32;
+
+    // The LFO table: one sine cycle, plus a guard point for interpolation.
+    static const int lfoTableSize = 1024;
+    struct LfoTable {
+        float values[lfoTableSize + 1];
+    };
+
+    // Shared by every instance; built by the first one.
+    static const LfoTable & getLfoTable()
+    {
+        static const LfoTable table = [] {
+            LfoTable t;
+            for (int ix = 0; ix <= lfoTableSize; ++ix) {
+                t.values[ix] = static_cast<float>(std::sin(
+                    juce::MathConstants<double>::twoPi * ix / lfoTableSize));
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    // SIMD-aligned per-tap values.  One entry per tap.
+    struct alignas(SIMDType::SIMDRegisterSize) TapArray {
+        float values[maxTaps] = {};
+        inline float & operator[](const int ix) { return values[ix]; }
+        inline const float & operator[](const int ix) const { return values[ix]; }
+        inline SIMDType load(const int reg) const { return SIMDType::fromRawArray(values + reg * simdWidth); }
+        inline void store(const int reg, const SIMDType v) { v.copyToRawArray(values + reg * simdWidth); }
+    };
+
+    // Per channel tap delays (in samples) and their per-sample change.
+    struct TapState {
+        TapArray delay;
+        TapArray slope;
+    };
+
+    static float wrap(const float phase) noexcept
+    {
+        return phase - std::floor(phase);
+    }
+
+    // LFO value at a phase (in cycles; any value).
+    float readLfo(const float phase) const noexcept
+    {
+        const float position = wrap(phase) * lfoTableSize;
+        const int index = juce::jmin(static_cast<int>(position), lfoTableSize - 1);
+        const float frac = position - index;
+        return lfoTable.values[index] + frac * (lfoTable.values[index + 1] - lfoTable.values[index]);
+    }
+
+    // Run one channel's taps over a sub-block.
+    void processTaps(
+        TapState & taps,
+        float * pLine,
+        float * pSamples,
+        const int blockOffset,
+        const int count) noexcept
+    {
+        TapArray position;
+        TapArray older;
+        TapArray newer;
+        const float * pWet = wetRamp.data() + blockOffset;
+        const float * pDry = dryRamp.data() + blockOffset;
+
+        for (int ix = 0; ix < count; ++ix) {
+            const int write = (writeIndex + ix) & delayMask;
+            pLine[write] = pSamples[ix];
+
+            // Read positions, kept positive so they can be wrapped with the
+            // mask.
+            const SIMDType writePosition = SIMDType::expand(static_cast<float>(write + delaySize));
+            for (int reg = 0; reg < numRegisters; ++reg) {
+                position.store(reg, writePosition - taps.delay.load(reg));
+            }
+
+            // the gather
+            for (int tap = 0; tap < numTaps; ++tap) {
+                const int read = static_cast<int>(position[tap]);
+                older[tap] = pLine[read & delayMask];
+                newer[tap] = pLine[(read + 1) & delayMask];
+            }
+
+            SIMDType wet = SIMDType::expand(0.0f);
+            for (int reg = 0; reg < numRegisters; ++reg) {
+                const SIMDType pos = position.load(reg);
+                const SIMDType frac = pos - SIMDType::truncate(pos);
+                const SIMDType a = older.load(reg);
+                const SIMDType tapOut = a + frac * (newer.load(reg) - a);
+                wet += tapOut * tapGain.load(reg);
+                taps.delay.store(reg, taps.delay.load(reg) + taps.slope.load(reg));
+            }
+
+            pSamples[ix] = pSamples[ix] * pDry[ix] + wet.sum() * pWet[ix];
+        }
+    }
+
+    const int numTaps;
+    const int numRegisters;
+    const LfoTable & lfoTable;
+
+    TapArray tapPhaseOffset;
+    TapArray tapGain;
+
+    double sampleRate = 44100.0;
+    float rateHz = 0.75f;
+    float centreDelayMs = 12.0f;
+    float depthMs = 3.0f;
+    float lfoPhase = 0.0f;
+
+    std::vector<std::vector<float>> delayLines;
+    int delaySize = 0;
+    int delayMask = 0;
+    int writeIndex = 0;
+    std::vector<TapState> channels;
+
+    juce::SmoothedValue<float> wetGain { 0.5f };
+    juce::SmoothedValue<float> dryGain { 0.5f };
+    std::vector<float> wetRamp;
+    std::vector<float> dryRamp;
+};
@@ -15,6 +15,108 @@ using WaveAudioBuffer = juce::AudioBuffer<WTSampleType>;
 
 static const int maxEffects = 6;
 
+// Engine used behind REVERB_EFFECT.  FREEVERB is juce::dsp::Reverb; FDN is the
+// feedback delay network in FdnReverbProcessor, which is denser and cheaper.
+enum class ReverbEngine { FREEVERB, FDN };
+static const ReverbEngine reverbEngine = ReverbEngine::FDN;
+
+// Number of delay lines in the FDN reverb (8 or 16).
+static const int fdnReverbNumLines = 8;
+
+// Convolution reverb.  Impulse responses are cut off at this length.
+static const double maxImpulseResponseSeconds = 8.0;
+
+// Number of impulse response partitions convolved on the audio thread; the 
+// rest are done by the tail worker thread.  Must be at least 2.
+static const int convolutionHeadPartitions = 4;
+
+// The convolution partition size is the max block size rounded up to a power 
+// of two, kept within these limits.
+static const int minConvolutionPartitionSize = 64;
+static const int maxConvolutionPartitionSize = 512;
+
+// Oversampling of the distortion effect, as a power of two (0 = 1x, 1 = 2x, 
+// 2 = 4x, 3 = 8x), and whether to use linear phase FIR half band filters 
+// instead of the cheaper, lower latency polyphase IIR ones.  Offline renders 
+// can afford much more than live playback.
+static const int distortionOversamplingOrderLive = 1;
+static const bool distortionOversamplingFIRLive = false;
+static const int distortionOversamplingOrderOffline = 3;
+static const bool distortionOversamplingFIROffline = true;
+
+// At high sample rates, run the chorus, delay and reverbs at a reduced rate 
+// (see MultirateProcessor): the host rate divided by the largest power of two
+// (up to 8) that keeps it at or above multirateFxMinSampleRate.  The last half
+// band filter has this normalised transition width and stopband attenuation.
+static const bool multirateFx = true;
+static const double multirateFxMinSampleRate = 44'100.0;
+static const float multirateTransitionWidth = 0.05f;
+static const float multirateStopbandDb = -80.0f;
+
+// Number of modulated taps per channel in the chorus (2 to 8).  3 is the 
+// classic ensemble sound.
+static const int chorusNumTaps = 3;
+
+// Waveshaper effect: the curve, the antiderivative anti-aliasing order (1 or 
+// 2) and the gain into the curve.
+enum class WaveshaperShape { TANH, HARD_CLIP, OBX_HORN };
+static const WaveshaperShape waveshaperShape = WaveshaperShape::OBX_HORN;
+static const int waveshaperAdaaOrder = 2;
+static const float waveshaperDrive = 4.0f;
+
+// The engine renders in micro-blocks of this many samples (16, 32 or 64), 
+// whatever the host's buffer size.  Parameters are read at the start of each
+// one, and all the scratch buffers are sized for one.
+static const int microBlockSize = 32;
+static_assert(microBlockSize == 16 || microBlockSize == 32 || microBlockSize == 64,
+    "microBlockSize must be 16, 32 or 64");
+
+// Midi controller changes (CC, pitch wheel, aftertouch) are moved back to a
+// multiple of this many samples, so a dense stream of them doesn't split the
+// micro-blocks into lots of tiny sub-blocks.  Notes still start on their 
+// exact sample.
+static const int midiControllerSubBlockSize = 16;
+
+// Dense controller streams are thinned out before they reach the synth: in
+// each window this long (rounded up to a multiple of 
+// midiControllerSubBlockSize), only the last value of each controller on each
+// channel is kept, and the voices ramp to a new pitch bend over the window.
+// 0 keeps every controller message.
+static const double midiControllerWindowSeconds = 0.002;
+
+// The controller window in samples
+static int getMidiControllerWindowSamples(const double sampleRate) {
+    const int samples = static_cast<int>(std::ceil(midiControllerWindowSeconds * sampleRate));
+    return juce::jmax(1, 
+        (samples + midiControllerSubBlockSize - 1) / midiControllerSubBlockSize * midiControllerSubBlockSize);
+}
+
+// Pitch wheel range, in semitones up and down
+static const double pitchBendSemitones = 2.0;
+
+// Host notes are shown on the onscreen keyboard this often.  The audio thread
+// queues them, and the message thread hands them to the keyboard, so only the
+// message thread ever takes the keyboard's lock.
+static const int keyboardHostNotesIntervalMs = 30;
+
+// Parameter changes are ramped in over this long, rather than stepped, to 
+// avoid zipper noise.
+static const double parameterSmoothingSeconds = 0.02;
+
+// Worker threads helping the audio thread run parallel effect branches (e.g.
+// the delay and reverb sends), as well as the audio thread itself.  0 runs
+// everything on the audio thread.  One pool is shared by every instance in
+// the process.
+static const int fxWorkerThreads = 1;
+
+// Run the effects on their own thread, behind the voices, so the two
+// overlap.  They're handed over a chunk of pipelinedFxChunkSamples at a time
+// (and run in micro-blocks there), so the handoffs are few enough not to eat
+// the gain.  This adds two chunks of latency (reported to the host), so it's
+// for sessions where latency is compensated.
+static const bool pipelinedFx = false;
+static const int pipelinedFxChunkSamples = 256;
+
 static const int maxNumVoices = 8;
 static const int numVoices = maxNumVoices;
 static const int wavetableNumSamples = 512;
@@ -25,6 +127,47 @@ static const double maxOscillatorsGain = 0.5;
 
 static const double oscillatorGain = maxOscillatorsGain / maxNumVoices;
 
+// The voice filter is skipped while it's wide open: cutoff at or above this,
+// and no resonance.
+static const float filterOpenCutoffHz = 20'000.0f;
+
+// The output is clipped to +/- this, in case the resonance gets out of hand.
+static const float outputClipLevel = 0.97f;
+
+// The output limiter keeps peaks under its ceiling, so the clipping above is
+// only a last resort.  The lookahead (and 8 samples more for true peak 
+// detection, which also catches the peaks between samples) is added to the 
+// latency.
+static const float limiterCeiling = 0.94f;
+static const double limiterLookaheadSeconds = 0.0015;
+static const double limiterReleaseSeconds = 0.1;
+static const bool limiterTruePeak = true;
+
+// prepareToPlay() writes to every page of the memory the audio thread will use,
+// so the first notes don't take page faults, then renders warmUpMicroBlocks 
+// of silence through every voice and effect.  Locking the memory as well 
+// keeps it from being paged out, but it counts against a limit the plugin 
+// shares with its host (RLIMIT_MEMLOCK, or the working set on Windows).  
+// Buffers of 2MB or more (the convolution reverb's) are offered huge pages on
+// Linux as they're allocated.
+static const bool lockRealtimeMemory = false;
+static const bool realtimeHugePages = true;
+static const int warmUpMicroBlocks = 8;
+
+// Check the synth's final output (after the limiter and the clipping) for NaNs,
+// infinities, denormals and samples over the clip level, and log anything 
+// found at most this often.
+static const bool validateOutput = true;
+static const int outputValidatorLogIntervalMs = 5000;
+
+// Write the logs as compact binary files (midi-synthesiser.mtlog, next to the
+// text log) rather than text; tools/mtlogdecode turns them back into text.  A
+// new file is started before one goes over logMaxFileBytes, and logMaxFiles
+// are kept, counting the current one.
+static const bool binaryLogging = true;
+static const juce::int64 logMaxFileBytes = 16 * 1024 * 1024;
+static const int logMaxFiles = 4;
+
 // Note: "PN" is shorthand for "parameter name".
 
 // UI Control Parameter names 
@@ -32,6 +175,10 @@ static const std::string waveIndexPN("waveIndex");
 static const std::string cutoffPN("cutoff");
 static const std::string resonancePN("resonance");
 
+// Parameter state property holding the convolution reverb's impulse response 
+// file.  Empty means use the built-in one.
+static const std::string impulseResponseFilePN("impulseResponseFile");
+
 // Per-effect param names
 static const std::string typeSelectorPN("typeSelector");
 static const std::string fxLevelPN("fxLevel");
@@ -57,7 +204,10 @@ static const enum EffectType {
     CHORUS_EFFECT,
     DELAY_EFFECT,
     REVERB_EFFECT,
-    LAST_EFFECT = REVERB_EFFECT,
+    CONVOLUTION_EFFECT,
+    WAVESHAPER_EFFECT,
+    DELAY_REVERB_EFFECT,
+    LAST_EFFECT = DELAY_REVERB_EFFECT,
     NUM_REAL_EFFECTS = LAST_EFFECT,
     NUM_EFFECTS // including the null effect
 };
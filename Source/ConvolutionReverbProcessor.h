@@ -0,0 +1,694 @@
+/**
+ * A convolution reverb using uniformly partitioned FFT convolution (overlap-
+ * add with a frequency-domain delay line).
+ *
+ * The impulse response is cut into partitions of partitionSize samples.  The
+ * audio thread convolves the first numHeadPartitions of them; the rest (the
+ * "tail") is summed in the frequency domain by ConvolutionTailWorker, which
+ * has numHeadPartitions - 1 partitions' worth of time before the result is
+ * needed.  Each call still produces output with no added latency: like
+ * juce::dsp::Convolution, the partially filled input partition is transformed
+ * on every call and the output is taken from the matching part of the
+ * inverse transform.
+ *
+ * The impulse response itself comes from ImpulseResponseLoader and can change
+ * at any time; the new one takes over at the next partition boundary.  The
+ * frequency-domain delay line is sized for the impulse response, and
+ * reallocated (off the audio thread, before the loader publishes it) for one
+ * of a different length; the reverb's history starts again when it is.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+#include "Config.h"
+#include "ConvolutionTailWorker.h"
+#include "ImpulseResponseLoader.h"
+#include "PartitionedImpulseResponse.h"
+
+class ConvolutionReverbProcessor:
+    public juce_igutil::Processor,
+    private ConvolutionTailWorker::Client,
+    private ImpulseResponseLoader::Listener
+{
+private:
+
+    using IRType = PartitionedImpulseResponse;
+
+    // Longest the audio thread will spin waiting for a late tail before
+    // going without it for that partition.
+    static constexpr double maxTailWaitSec = 0.0002;
+
+    // Per channel convolution state
+    struct ChannelState {
+        AlignedFloatBuffer headSpectrum; // sum of the tail and head partitions 1..K-1
+        AlignedFloatBuffer outSpectrum;  // headSpectrum + the current partition
+        AlignedFloatBuffer tailSpectra;  // worker results, numHeadPartitions slots
+        std::vector<float> input;        // the partition being filled
+        std::vector<float> overlap;      // second half of the last full partition
+        std::vector<float> output;       // convolved output for the current chunk
+    };
+
+    // Frequency-domain delay lines: input spectra, one per partition (ring),
+    // for every channel.  Room for every partition the tail of an impulse
+    // response of maxPartitions can reach, plus the head partitions written
+    // while the worker is still reading.
+    struct DelayLines {
+        int maxPartitions = 0;
+        int numSlots = 0;
+        std::vector<AlignedFloatBuffer> channels;
+    };
+
+    std::shared_ptr<ImpulseResponseLoader> pLoader;
+    std::shared_ptr<ConvolutionTailWorker> pWorker;
+
+    const int numHeadPartitions;
+
+    // sizes set in prepare()
+    int numChannels = 0;
+    int partitionSize = 0;
+    int fftSize = 0;
+    int numBins = 0;
+    int paddedBins = 0;
+    int spectrumSize = 0;
+    double sampleRate = 0.0;
+
+    std::unique_ptr<juce::dsp::FFT> pFFT;
+    AlignedFloatBuffer fftBuffer;
+    std::vector<ChannelState> channels;
+    std::vector<float> wetRamp;
+    std::vector<float> dryRamp;
+
+    // Position in the partition being filled, and its index.  Partition
+    // indexes are never reset, so they identify partitions uniquely.  Inputs
+    // from before firstValidPartition are treated as silence; that way a 
+    // reset doesn't have to clear the whole frequency-domain delay line.
+    int inputPosition = 0;
+    juce::int64 partitionIndex = 0;
+    juce::int64 firstValidPartition = 0;
+
+    // Impulse responses.  Each is kept alive by one of the hazard pointers:
+    // 0 for the active one, 1 for the previous one until the worker is done
+    // with the tails it was used for, and 2 while checking for a new one.
+    enum { ACTIVE_HAZARD, PREVIOUS_HAZARD, LATEST_HAZARD, NUM_HAZARDS };
+    ImpulseResponseLoader::HazardPointer hazards[NUM_HAZARDS];
+    const IRType * pActiveIR = nullptr;
+    const IRType * pPreviousIR = nullptr;
+    juce::int64 lastTailWithPreviousIR = -1;
+
+    // Delay lines.  They're allocated on the loader thread (or in prepare())
+    // for each impulse response of a new length, and offered to the audio
+    // thread in pNewDelayLines; it switches to them along with the impulse
+    // response.  The hazard pointers work like the ones above, for the
+    // active delay lines, the previous ones until the worker is done with
+    // them, and the new ones while checking for them.  allDelayLines owns
+    // them, and is protected by delayLinesLock.
+    juce::CriticalSection delayLinesLock;
+    std::vector<std::unique_ptr<DelayLines>> allDelayLines;
+    std::atomic<DelayLines*> pNewDelayLines { nullptr };
+    std::atomic<DelayLines*> delayLineHazards[NUM_HAZARDS];
+    DelayLines * pActiveDelayLines = nullptr;
+    DelayLines * pPreviousDelayLines = nullptr;
+    std::atomic<int> tailSamples { 0 };
+
+    // Tail jobs, posted by the audio thread and done by the worker.  The tail
+    // for partition m uses slot m % numHeadPartitions.  A worker that's late
+    // can still be reading a slot when the audio thread reuses it, so the
+    // slot is a seqlock: job is -1 while the fields are being written and
+    // the job's partition once they're done, and the worker drops the job
+    // if that's changed by the time it has copied them.
+    struct TailJob {
+        std::atomic<juce::int64> job { -1 };
+        std::atomic<const IRType*> pIR { nullptr };
+        std::atomic<DelayLines*> pDelayLines { nullptr };
+        std::atomic<juce::int64> firstValidPartition { 0 };
+    };
+    std::vector<TailJob> tailJobs;
+    std::atomic<juce::int64> requestedTail { -1 };
+    std::atomic<juce::int64> completedTail { -1 };
+    std::unique_ptr<std::atomic<juce::int64>[]> tailSlotPartition;
+
+    // Tails that weren't ready in time.
+    std::atomic<int> numLateTails { 0 };
+
+    // When rendering offline there's no deadline, so wait for every tail.
+    std::atomic<bool> nonRealtime { false };
+
+    juce::SmoothedValue<float> wetGain { 0.3f };
+    juce::SmoothedValue<float> dryGain { 0.7f };
+
+public:
+    /**
+     * Constructor.  numHeadPartitionsToUse partitions are convolved on the
+     * audio thread; must be at least 2.
+     */
+    ConvolutionReverbProcessor(
+        std::shared_ptr<ImpulseResponseLoader> pImpulseResponseLoader,
+        std::shared_ptr<ConvolutionTailWorker> pTailWorker,
+        const int numHeadPartitionsToUse = config::convolutionHeadPartitions
+    ):
+        juce_igutil::Processor(),
+        pLoader(pImpulseResponseLoader),
+        pWorker(pTailWorker),
+        numHeadPartitions(numHeadPartitionsToUse),
+        tailJobs(numHeadPartitionsToUse),
+        tailSlotPartition(new std::atomic<juce::int64>[numHeadPartitionsToUse])
+    {
+        jassert(numHeadPartitions >= 2);
+        for (auto & hazard : hazards) {
+            hazard.store(nullptr);
+            pLoader->addHazardPointer(&hazard);
+        }
+        for (auto & hazard : delayLineHazards) {
+            hazard.store(nullptr);
+        }
+        for (int ix = 0; ix < numHeadPartitions; ++ix) {
+            tailSlotPartition[ix].store(-1);
+        }
+    }
+
+    /** Destructor. */
+    virtual ~ConvolutionReverbProcessor()
+    {
+        pWorker->removeClient(this);
+        pLoader->removeListener(this);
+        for (auto & hazard : hazards) {
+            pLoader->removeHazardPointer(&hazard);
+        }
+    }
+
+    /** Set wet/dry mix (1.0 = full wet, 0.0 = full dry) */
+    void setMix(const float wetToDryRatio)
+    {
+        wetGain.setTargetValue(wetToDryRatio);
+        dryGain.setTargetValue(1.0f - wetToDryRatio);
+    }
+
+    /**
+     * Tell the processor whether it is rendering offline.  Offline, the audio
+     * thread waits for the worker however long it takes instead of going 
+     * without the tail, as it may be running much faster than real time.
+     */
+    void setNonRealtime(const bool isNonRealtime) noexcept override
+    {
+        nonRealtime.store(isNonRealtime);
+    }
+
+    /** Number of tail partitions the worker didn't finish in time. */
+    int getNumLateTails() const noexcept
+    {
+        return numLateTails.load(std::memory_order_relaxed);
+    }
+
+    /** Prepare to process audio.  */
+    void prepare(const juce::dsp::ProcessSpec& spec) override
+    {
+        // neither the worker nor the loader may touch the buffers while they
+        // are reallocated
+        pWorker->removeClient(this);
+        pLoader->removeListener(this);
+
+        sampleRate = spec.sampleRate;
+        numChannels = static_cast<int>(spec.numChannels);
+        partitionSize = juce::jlimit(
+            config::minConvolutionPartitionSize,
+            config::maxConvolutionPartitionSize,
+            juce::nextPowerOfTwo(static_cast<int>(spec.maximumBlockSize)));
+        fftSize = 2 * partitionSize;
+        numBins = partitionSize + 1;
+        paddedBins = spectrum::getPaddedBins(numBins);
+        spectrumSize = 2 * paddedBins;
+
+        pFFT.reset(new juce::dsp::FFT(IRType::getFftOrder(fftSize)));
+        fftBuffer.allocate(static_cast<size_t>(2 * fftSize));
+
+        channels.clear();
+        channels.resize(static_cast<size_t>(numChannels));
+        for (auto & chan : channels) {
+            chan.headSpectrum.allocate(static_cast<size_t>(spectrumSize));
+            chan.outSpectrum.allocate(static_cast<size_t>(spectrumSize));
+            chan.tailSpectra.allocate(static_cast<size_t>(numHeadPartitions * spectrumSize));
+            chan.input.assign(static_cast<size_t>(partitionSize), 0.0f);
+            chan.overlap.assign(static_cast<size_t>(partitionSize), 0.0f);
+            chan.output.assign(static_cast<size_t>(partitionSize), 0.0f);
+        }
+        wetRamp.assign(static_cast<size_t>(partitionSize), 0.0f);
+        dryRamp.assign(static_cast<size_t>(partitionSize), 0.0f);
+
+        wetGain.reset(sampleRate, config::parameterSmoothingSeconds);
+        dryGain.reset(sampleRate, config::parameterSmoothingSeconds);
+
+        // drop the old impulse response and delay lines; they may not match
+        // the new sizes.  The delay lines for the current impulse response
+        // are allocated when the loader listener is added back.
+        pActiveIR = nullptr;
+        pPreviousIR = nullptr;
+        for (auto & hazard : hazards) {
+            hazard.store(nullptr);
+        }
+        pActiveDelayLines = nullptr;
+        pPreviousDelayLines = nullptr;
+        for (auto & hazard : delayLineHazards) {
+            hazard.store(nullptr);
+        }
+        pNewDelayLines.store(nullptr);
+        tailSamples.store(0);
+        {
+            const juce::ScopedLock sl(delayLinesLock);
+            allDelayLines.clear();
+        }
+        requestedTail.store(-1);
+        completedTail.store(-1);
+        partitionIndex = 0;
+        for (int ix = 0; ix < numHeadPartitions; ++ix) {
+            tailSlotPartition[ix].store(-1);
+            tailJobs[ix].job.store(-1);
+            tailJobs[ix].pIR.store(nullptr);
+            tailJobs[ix].pDelayLines.store(nullptr);
+            tailJobs[ix].firstValidPartition.store(0);
+        }
+        reset();
+
+        pLoader->prepare(sampleRate, partitionSize);
+        pLoader->addListener(this);
+        pWorker->addClient(this);
+    }
+
+    /**
+     * Process audio.
+     */
+    void process(
+        juce::dsp::ProcessContextReplacing<float> & context
+    ) noexcept override
+    {
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        const int numChans = juce::jmin(numChannels, static_cast<int>(block.getNumChannels()));
+        jassert(numChans > 0 && partitionSize > 0);
+
+        int done = 0;
+        while (done < numSamples) {
+            const int count = juce::jmin(numSamples - done, partitionSize - inputPosition);
+
+            for (int ix = 0; ix < count; ++ix) {
+                wetRamp[ix] = wetGain.getNextValue();
+                dryRamp[ix] = dryGain.getNextValue();
+            }
+
+            for (int chan = 0; chan < numChans; ++chan) {
+                float * pSamples = block.getChannelPointer(chan) + done;
+                ChannelState & state = channels[chan];
+                juce::FloatVectorOperations::copy(
+                    state.input.data() + inputPosition, pSamples, count);
+
+                if (pActiveIR != nullptr) {
+                    convolveChunk(chan, count);
+                    juce::FloatVectorOperations::multiply(pSamples, dryRamp.data(), count);
+                    juce::FloatVectorOperations::addWithMultiply(
+                        pSamples, state.output.data(), wetRamp.data(), count);
+                }
+                else {
+                    juce::FloatVectorOperations::multiply(pSamples, dryRamp.data(), count);
+                }
+            }
+
+            inputPosition += count;
+            done += count;
+            if (inputPosition == partitionSize) {
+                finishPartition(numChans);
+            }
+        }
+    }
+
+    /**
+     * Reset the internal state of the processor.
+     */
+    void reset() override
+    {
+        for (auto & chan : channels) {
+            chan.headSpectrum.clear();
+            std::fill(chan.input.begin(), chan.input.end(), 0.0f);
+            std::fill(chan.overlap.begin(), chan.overlap.end(), 0.0f);
+        }
+        // start a fresh partition with no history.
+        inputPosition = 0;
+        ++partitionIndex;
+        firstValidPartition = partitionIndex;
+        wetGain.setCurrentAndTargetValue(wetGain.getTargetValue());
+        dryGain.setCurrentAndTargetValue(dryGain.getTargetValue());
+    }
+
+    /**
+     * Until every partition in the frequency-domain delay line is silent.  An
+     * impulse response too long for it comes with new delay lines and no
+     * history, so it can't pick up input from before a skip.
+     */
+    int getTailSamples() const noexcept override
+    {
+        return tailSamples.load(std::memory_order_relaxed);
+    }
+
+    /** Just the dry signal when the mix is fully dry. */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        if (wetGain.getTargetValue() != 0.0f) {
+            return false;
+        }
+        gain = dryGain.getTargetValue();
+        return true;
+    }
+
+    /**
+     * The frequency-domain delay lines (the big ones) and the scratch.  The 
+     * worker has no tails to do until process() posts them.  Delay lines
+     * allocated later for another impulse response are zeroed, so resident,
+     * but not locked.
+     */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        auto addBuffer = [&memory](AlignedFloatBuffer & buffer) {
+            memory.add(buffer.data(), buffer.getSize() * sizeof(float));
+        };
+        addBuffer(fftBuffer);
+        {
+            const juce::ScopedLock sl(delayLinesLock);
+            if (!allDelayLines.empty()) {
+                for (auto & fdl : allDelayLines.back()->channels) {
+                    addBuffer(fdl);
+                }
+            }
+        }
+        for (auto & chan : channels) {
+            addBuffer(chan.headSpectrum);
+            addBuffer(chan.outSpectrum);
+            addBuffer(chan.tailSpectra);
+            memory.add(chan.input);
+            memory.add(chan.overlap);
+            memory.add(chan.output);
+        }
+        memory.add(wetRamp);
+        memory.add(dryRamp);
+    }
+
+private:
+
+    // FDL slot for a partition
+    inline float * getFdlSpectrum(
+        DelayLines & delayLines,
+        const int chan,
+        const juce::int64 partition) noexcept
+    {
+        const int slot = static_cast<int>(partition % delayLines.numSlots);
+        return delayLines.channels[chan].data() + slot * spectrumSize;
+    }
+
+    // Transform the current partition (as far as it is filled), add it to the
+    // precomputed head spectrum and transform back.
+    void convolveChunk(const int chan, const int count) noexcept
+    {
+        ChannelState & state = channels[chan];
+        float * pFft = fftBuffer.data();
+        float * pX = getFdlSpectrum(*pActiveDelayLines, chan, partitionIndex);
+
+        juce::FloatVectorOperations::copy(pFft, state.input.data(), partitionSize);
+        juce::FloatVectorOperations::clear(pFft + partitionSize, 2 * fftSize - partitionSize);
+        pFFT->performRealOnlyForwardTransform(pFft, true);
+        spectrum::splitFromInterleaved(pFft, pX, numBins, paddedBins);
+
+        juce::FloatVectorOperations::copy(
+            state.outSpectrum.data(), state.headSpectrum.data(), spectrumSize);
+        spectrum::multiplyAccumulate(
+            state.outSpectrum.data(), pX, pActiveIR->getPartition(chan, 0), paddedBins);
+
+        spectrum::interleavedFromSplit(state.outSpectrum.data(), pFft, numBins, paddedBins);
+        pFFT->performRealOnlyInverseTransform(pFft);
+
+        juce::FloatVectorOperations::add(
+            state.output.data(), pFft + inputPosition, state.overlap.data() + inputPosition, count);
+
+        // The last chunk of a partition sees all of its input, so its second
+        // half is what overlaps the next partition.
+        if (inputPosition + count == partitionSize) {
+            juce::FloatVectorOperations::copy(
+                state.overlap.data(), pFft + partitionSize, partitionSize);
+        }
+    }
+
+    // Move on to the next partition: switch impulse responses if there's a
+    // new one, post a tail job and precompute the next head spectrum.
+    void finishPartition(const int numChans) noexcept
+    {
+        for (int chan = 0; chan < numChans; ++chan) {
+            std::fill(channels[chan].input.begin(), channels[chan].input.end(), 0.0f);
+        }
+        inputPosition = 0;
+        ++partitionIndex;
+
+        updateImpulseResponse();
+        if (pActiveIR == nullptr) {
+            return;
+        }
+
+        // Post the tail for partition numHeadPartitions - 1 after this one.
+        // Everything it needs (the partition just finished and older) is
+        // complete now.
+        const bool hasTail = pActiveIR->numPartitions > numHeadPartitions;
+        if (hasTail) {
+            const juce::int64 job = partitionIndex + numHeadPartitions - 1;
+            postTailJob(job);
+            requestedTail.store(job, std::memory_order_release);
+            pWorker->wake();
+        }
+
+        // Head spectrum for this partition: its tail plus partitions 1..K-1
+        // of the impulse response against the previous inputs.  There is no
+        // tail if it would only cover inputs from before the last reset.
+        const bool tailReady = hasTail
+            && partitionIndex - numHeadPartitions >= firstValidPartition
+            && waitForTail(partitionIndex);
+        const int numHead = juce::jmin(numHeadPartitions, pActiveIR->numPartitions);
+        const int tailSlot = static_cast<int>(partitionIndex % numHeadPartitions);
+        for (int chan = 0; chan < numChans; ++chan) {
+            ChannelState & state = channels[chan];
+            float * pHead = state.headSpectrum.data();
+            if (tailReady) {
+                juce::FloatVectorOperations::copy(
+                    pHead, state.tailSpectra.data() + tailSlot * spectrumSize, spectrumSize);
+            }
+            else {
+                juce::FloatVectorOperations::clear(pHead, spectrumSize);
+            }
+            for (int part = 1; part < numHead; ++part) {
+                const juce::int64 source = partitionIndex - part;
+                if (source < firstValidPartition) {
+                    break;
+                }
+                spectrum::multiplyAccumulate(
+                    pHead,
+                    getFdlSpectrum(*pActiveDelayLines, chan, source),
+                    pActiveIR->getPartition(chan, part),
+                    paddedBins);
+            }
+        }
+    }
+
+    // Pick up a newly loaded impulse response, and its delay lines if it
+    // needs new ones, once the worker is done with the ones before the
+    // active ones.
+    void updateImpulseResponse() noexcept
+    {
+        if (pPreviousIR != nullptr) {
+            if (completedTail.load(std::memory_order_acquire) < lastTailWithPreviousIR) {
+                return;
+            }
+            pPreviousIR = nullptr;
+            hazards[PREVIOUS_HAZARD].store(nullptr);
+            pPreviousDelayLines = nullptr;
+            delayLineHazards[PREVIOUS_HAZARD].store(nullptr);
+        }
+
+        const IRType * pLatest = pLoader->acquire(hazards[LATEST_HAZARD]);
+        if (pLatest != pActiveIR && isUsable(pLatest)) {
+            DelayLines * pDelayLines = pActiveDelayLines;
+            if (pDelayLines == nullptr || pDelayLines->maxPartitions != pLatest->numPartitions) {
+                pDelayLines = acquireNewDelayLines();
+            }
+            // The loader offers the delay lines before the impulse response,
+            // so they should always be there.
+            jassert(pDelayLines != nullptr && pDelayLines->maxPartitions == pLatest->numPartitions);
+            if (pDelayLines != nullptr && pDelayLines->maxPartitions == pLatest->numPartitions) {
+                if (pActiveIR == nullptr || pDelayLines != pActiveDelayLines) {
+                    // the delay line wasn't kept up while there was no IR,
+                    // or is a new one
+                    firstValidPartition = partitionIndex;
+                }
+                if (pActiveIR != nullptr) {
+                    pPreviousIR = pActiveIR;
+                    hazards[PREVIOUS_HAZARD].store(pPreviousIR);
+                    pPreviousDelayLines = pActiveDelayLines;
+                    delayLineHazards[PREVIOUS_HAZARD].store(pPreviousDelayLines);
+                    lastTailWithPreviousIR = requestedTail.load(std::memory_order_relaxed);
+                }
+                hazards[ACTIVE_HAZARD].store(pLatest);
+                pActiveIR = pLatest;
+                delayLineHazards[ACTIVE_HAZARD].store(pDelayLines);
+                pActiveDelayLines = pDelayLines;
+                tailSamples.store((pDelayLines->numSlots + 1) * partitionSize, std::memory_order_relaxed);
+            }
+        }
+        hazards[LATEST_HAZARD].store(nullptr);
+        delayLineHazards[LATEST_HAZARD].store(nullptr);
+    }
+
+    // The delay lines on offer, protected by the latest hazard pointer
+    DelayLines * acquireNewDelayLines() noexcept
+    {
+        DelayLines * pDelayLines = pNewDelayLines.load();
+        for (;;) {
+            delayLineHazards[LATEST_HAZARD].store(pDelayLines);
+            DelayLines * pCheck = pNewDelayLines.load();
+            if (pCheck == pDelayLines) {
+                return pDelayLines;
+            }
+            pDelayLines = pCheck;
+        }
+    }
+
+    // Can this processor use the impulse response as prepared?
+    bool isUsable(const IRType * pIR) const noexcept
+    {
+        return pIR != nullptr
+            && pIR->sampleRate == sampleRate
+            && pIR->partitionSize == partitionSize;
+    }
+
+    /**
+     * Loader thread (or prepare()): allocate delay lines for an impulse
+     * response of a new length, and free the ones that aren't in use or on
+     * offer any more.
+     */
+    void impulseResponseReady(const IRType & ir) override
+    {
+        if (!isUsable(&ir)) {
+            return;
+        }
+        const juce::ScopedLock sl(delayLinesLock);
+        DelayLines * pOffered = pNewDelayLines.load();
+        allDelayLines.erase(
+            std::remove_if(allDelayLines.begin(), allDelayLines.end(),
+                [this, pOffered](const std::unique_ptr<DelayLines> & pDelayLines) {
+                    if (pDelayLines.get() == pOffered) {
+                        return false;
+                    }
+                    for (auto & hazard : delayLineHazards) {
+                        if (hazard.load() == pDelayLines.get()) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }),
+            allDelayLines.end());
+
+        if (!allDelayLines.empty() && allDelayLines.back()->maxPartitions == ir.numPartitions) {
+            return;
+        }
+        auto pDelayLines = std::make_unique<DelayLines>();
+        pDelayLines->maxPartitions = ir.numPartitions;
+        pDelayLines->numSlots = ir.numPartitions + numHeadPartitions;
+        pDelayLines->channels.resize(static_cast<size_t>(numChannels));
+        for (auto & fdl : pDelayLines->channels) {
+            fdl.allocate(static_cast<size_t>(pDelayLines->numSlots * spectrumSize));
+        }
+        pNewDelayLines.store(pDelayLines.get());
+        allDelayLines.push_back(std::move(pDelayLines));
+    }
+
+    // Fill in a tail job's slot, marking it as being written first.
+    void postTailJob(const juce::int64 job) noexcept
+    {
+        TailJob & tailJob = tailJobs[job % numHeadPartitions];
+        tailJob.job.store(-1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        tailJob.pIR.store(pActiveIR, std::memory_order_relaxed);
+        tailJob.pDelayLines.store(pActiveDelayLines, std::memory_order_relaxed);
+        tailJob.firstValidPartition.store(firstValidPartition, std::memory_order_relaxed);
+        tailJob.job.store(job, std::memory_order_release);
+    }
+
+    // Wait (briefly) for the worker to finish the tail for a partition.
+    bool waitForTail(const juce::int64 partition) noexcept
+    {
+        auto & slotPartition = tailSlotPartition[partition % numHeadPartitions];
+        if (slotPartition.load(std::memory_order_acquire) == partition) {
+            return true;
+        }
+        if (nonRealtime.load(std::memory_order_relaxed)) {
+            pWorker->wake();
+            while (slotPartition.load(std::memory_order_acquire) != partition) {
+                std::this_thread::yield();
+            }
+            return true;
+        }
+        const juce::int64 deadline = juce::Time::getHighResolutionTicks()
+            + juce::Time::secondsToHighResolutionTicks(maxTailWaitSec);
+        while (juce::Time::getHighResolutionTicks() < deadline) {
+            if (slotPartition.load(std::memory_order_acquire) == partition) {
+                return true;
+            }
+        }
+        numLateTails.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Worker thread: sum the tail partitions for every posted job.
+    void processPendingTails() noexcept override
+    {
+        const juce::int64 requested = requestedTail.load(std::memory_order_acquire);
+        juce::int64 completed = completedTail.load(std::memory_order_relaxed);
+        while (completed < requested) {
+            // Jobs more than numHeadPartitions behind are past their deadline.
+            const juce::int64 job = juce::jmax(completed + 1, requested - numHeadPartitions + 1);
+            computeTail(job);
+            completed = job;
+            completedTail.store(completed, std::memory_order_release);
+        }
+    }
+
+    // Tail for partition m: sum over k >= K of X[m - k] * H[k]
+    void computeTail(const juce::int64 job) noexcept
+    {
+        const int slot = static_cast<int>(job % numHeadPartitions);
+        const TailJob & tailJob = tailJobs[slot];
+        if (tailJob.job.load(std::memory_order_acquire) != job) {
+            return;
+        }
+        const IRType * pIR = tailJob.pIR.load(std::memory_order_relaxed);
+        DelayLines * pDelayLines = tailJob.pDelayLines.load(std::memory_order_relaxed);
+        const juce::int64 firstValid = tailJob.firstValidPartition.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (tailJob.job.load(std::memory_order_relaxed) != job) {
+            // reused for a later job while being copied: this one's too late
+            return;
+        }
+        if (pIR == nullptr || pDelayLines == nullptr) {
+            return;
+        }
+        const int numPartitions = juce::jmin(pIR->numPartitions, pDelayLines->maxPartitions);
+        for (int chan = 0; chan < static_cast<int>(channels.size()); ++chan) {
+            ChannelState & state = channels[chan];
+            float * pTail = state.tailSpectra.data() + slot * spectrumSize;
+            juce::FloatVectorOperations::clear(pTail, spectrumSize);
+            for (int part = numHeadPartitions; part < numPartitions; ++part) {
+                const juce::int64 source = job - part;
+                if (source < firstValid) {
+                    break;
+                }
+                spectrum::multiplyAccumulate(
+                    pTail, getFdlSpectrum(*pDelayLines, chan, source), pIR->getPartition(chan, part), paddedBins);
+            }
+        }
+        tailSlotPartition[slot].store(job, std::memory_order_release);
+    }
+};
@@ -0,0 +1,64 @@
+#include "ConvolutionTailWorker.h"
+
+using namespace juce;
+using namespace std;
+
+/**
+ * Constructor
+ */
+ConvolutionTailWorker::ConvolutionTailWorker():
+    Thread("ConvolutionTailWorker")
+{
+    // The tail for a partition is needed a few partitions after it is posted,
+    // so this thread has audio deadlines too.
+    startThread(Thread::realtimeAudioPriority);
+}
+
+/**
+ * Destructor
+ */
+ConvolutionTailWorker::~ConvolutionTailWorker()
+{
+    jassert(clients.empty() && "remove all clients before destroying the worker");
+    signalThreadShouldExit();
+    wakeEvent.signal();
+    stopThread(1000);
+}
+
+/**
+ * Add a client
+ */
+void ConvolutionTailWorker::addClient(Client * pClient)
+{
+    const ScopedLock sl(clientLock);
+    if (std::find(clients.begin(), clients.end(), pClient) == clients.end()) {
+        clients.push_back(pClient);
+    }
+}
+
+/**
+ * Remove a client
+ */
+void ConvolutionTailWorker::removeClient(Client * pClient)
+{
+    const ScopedLock sl(clientLock);
+    clients.erase(std::remove(clients.begin(), clients.end(), pClient), clients.end());
+}
+
+/**
+ * Worker loop.  Every wake-up gives each client a chance to do its pending 
+ * work.  A wake() that arrives while working leaves the event signalled, so 
+ * it is never missed.
+ */
+void ConvolutionTailWorker::run()
+{
+    while (!threadShouldExit()) {
+        {
+            const ScopedLock sl(clientLock);
+            for (auto pClient : clients) {
+                pClient->processPendingTails();
+            }
+        }
+        wakeEvent.wait(idleWaitMs);
+    }
+}
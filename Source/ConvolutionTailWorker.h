@@ -0,0 +1,62 @@
+/**
+ * Background thread that convolves the tail partitions of the impulse
+ * response for every ConvolutionReverbProcessor.  The audio thread only
+ * convolves the first few partitions itself, so its cost stays flat however
+ * long the impulse response is.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Semaphore.h"
+
+class ConvolutionTailWorker: private juce::Thread
+{
+public:
+
+    /**
+     * Anything with tail work to do.  processPendingTails() is called on the
+     * worker thread whenever it is woken up.
+     */
+    class Client
+    {
+    public:
+        virtual ~Client() = default;
+        virtual void processPendingTails() noexcept = 0;
+    };
+
+    /** Constructor; starts the worker thread. */
+    ConvolutionTailWorker();
+
+    /** Destructor; stops the worker thread.  All clients must be removed first. */
+    virtual ~ConvolutionTailWorker() override;
+
+    /** Add a client.  Not realtime safe. */
+    void addClient(Client * pClient);
+
+    /**
+     * Remove a client.  Not realtime safe: waits for the worker thread to 
+     * finish with the client if it is busy with it.
+     */
+    void removeClient(Client * pClient);
+
+    /** 
+     * Wake the worker up because a client has posted work.  Called from the
+     * audio thread; this only posts a semaphore, which never blocks (unlike
+     * Thread::notify(), which takes a lock).
+     */
+    void wake() noexcept { wakeEvent.signal(); }
+
+private:
+
+    void run() override;
+
+    // Longest time the worker sleeps without being woken up.
+    static const int idleWaitMs = 50;
+
+    juce_igutil::WakeEvent wakeEvent;
+
+    juce::CriticalSection clientLock;
+    std::vector<Client*> clients;
+};
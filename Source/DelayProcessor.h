@@ -1,5 +1,7 @@
 /** 
- * A delay effect that uses juce::dsp::DelayLine. 
+ * A delay effect: the input repeated numRepeats times, each repeat delayed 
+ * again from the one before.  The delay lines are its own (rather than 
+ * juce::dsp::DelayLine's) so they can be prefaulted and locked.
  */
 
 #pragma once
@@ -7,26 +9,37 @@
 #include <JuceHeader.h>
 
 #include "juce_igutil/Processor.h"
-
-// rough calculation for this simple delay
-static const int maxDelayInSamples = 48000*10;
+#include "Config.h"
 
 class DelayProcessor: public juce_igutil::Processor
 {
 private:
 
-    using DelayLineType = juce::dsp::DelayLine<
-        float, 
-        juce::dsp::DelayLineInterpolationTypes::Linear
-    >;
+    // Longest delay the lines have room for
+    static constexpr double maxDelaySeconds = 1.0;
 
-    float wetMix = 0.25;
+    juce::SmoothedValue<float> wetMix { 0.25f };
+    std::vector<float> wetMixRamp;
     float delayTimeSec = 0.39;
     int numRepeats = 4;
-    const int maxRepeats = 4;
-    using BufferPtr = std::shared_ptr<juce::AudioBuffer<float>>;
-    std::deque<BufferPtr> delayBuffers;
-    std::deque<std::shared_ptr<DelayLineType>> delayLines;
+    static const int maxRepeats = 4;
+    std::vector<juce::AudioBuffer<float>> delayBuffers;
+
+    // All the delay lines, one per repeat and channel, live in one buffer; 
+    // each line is a power-of-two slice.  The delay is linearly interpolated.
+    std::vector<float> lineBuffer;
+    int numChannels = 0;
+    int lineSize = 0;
+    int lineMask = 0;
+    int writeIndex = 0;
+    int delayWhole = 0;
+    float delayFraction = 0.0f;
+    int tailSamples = 0;
+
+    float * getLine(const int repeat, const int chan) noexcept
+    {
+        return lineBuffer.data() + (repeat * numChannels + chan) * lineSize;
+    }
 
 public:
     /** Constructor.  */
@@ -40,39 +53,41 @@ public:
     virtual ~DelayProcessor() = default;
 
     /**
-     * set the delay time
+     * set the delay time, up to the line length.  Not while processing.
      */
     void setDelayTime(const float newDelayInSamples) {
-        //delayLine.setDelay(newDelayInSamples);
-        std::for_each(delayLines.begin(), delayLines.end(), [=](auto & p){ p->setDelay(newDelayInSamples); });
+        const float delay = juce::jlimit(0.0f, static_cast<float>(juce::jmax(0, lineSize - 2)), newDelayInSamples);
+        delayWhole = static_cast<int>(delay);
+        delayFraction = delay - static_cast<float>(delayWhole);
+        tailSamples = static_cast<int>(std::ceil(delay)) * numRepeats;
     }
 
     /**
      * Set wet/dry mix (1.0 = full wet, 0.0 = full dry)
      */
     void setMix(const float wetToDryRatio) {
-        wetMix = wetToDryRatio;
+        wetMix.setTargetValue(wetToDryRatio);
     }
 
     /** Prepare to process audio.  */
     void prepare(const juce::dsp::ProcessSpec& spec) override 
     {
         using namespace std;
-        // create a buffer and delay line for every delay line up to maxRepeats.
-        for (int ix=0; ix<maxRepeats; ++ix) {
-            // allocate twice the max block size -- I don't think that's *really* a maximum.
-            const int numSamplesToAllocate = spec.maximumBlockSize * 2;
-            const int numChannels = spec.numChannels;
-            auto pDelayBuffer = make_shared<juce::AudioBuffer<float>>(numChannels, numSamplesToAllocate);
-            delayBuffers.push_back(pDelayBuffer);
-
-            shared_ptr<DelayLineType> pLine(new DelayLineType(maxDelayInSamples));
+        // a buffer for every repeat
+        numChannels = static_cast<int>(spec.numChannels);
+        delayBuffers.resize(maxRepeats);
+        for (auto & delayBuffer : delayBuffers) {
+            delayBuffer.setSize(numChannels, static_cast<int>(spec.maximumBlockSize));
+        }
 
-            pLine->setDelay(spec.sampleRate * delayTimeSec);
+        lineSize = juce::nextPowerOfTwo(static_cast<int>(std::ceil(spec.sampleRate * maxDelaySeconds)) + 2);
+        lineMask = lineSize - 1;
+        lineBuffer.assign(static_cast<size_t>(lineSize * numChannels * maxRepeats), 0.0f);
+        writeIndex = 0;
+        setDelayTime(static_cast<float>(spec.sampleRate * delayTimeSec));
 
-            pLine->prepare(spec);
-            delayLines.push_back(pLine);
-        }
+        wetMix.reset(spec.sampleRate, config::parameterSmoothingSeconds);
+        wetMixRamp.resize(spec.maximumBlockSize);
     }
 
     /** 
@@ -82,8 +97,19 @@ public:
     {
         using namespace juce;
 
-        // copy the block to 'pDelayBuffer' and process delay on it.
+        // copy the block to each repeat's buffer and delay it there.
         auto & outputBlock = context.getOutputBlock();
+        const int numSamples = static_cast<int>(outputBlock.getNumSamples());
+
+        // While the mix is moving, each repeat is scaled by the ramp rather 
+        // than a constant.
+        const bool mixRamping = wetMix.isSmoothing();
+        if (mixRamping) {
+            jassert(numSamples <= static_cast<int>(wetMixRamp.size()));
+            for (int samp = 0; samp < numSamples; ++samp) {
+                wetMixRamp[samp] = wetMix.getNextValue();
+            }
+        }
 
         dsp::AudioBlock<float> inputBlock;
         dsp::AudioBlock<float> lastProcessedBlock;
@@ -94,33 +120,32 @@ public:
             else 
                 inputBlock = lastProcessedBlock;
 
-            // resize the delay buffer without reallocating
-            auto pDelayBuffer = delayBuffers[ix];
-            pDelayBuffer->setSize(
-                outputBlock.getNumChannels(), 
-                outputBlock.getNumSamples(),
-                true, // keepExistingContent
-                false, //clearExtraSpace
-                true // avoidReallocating
-            );
-            jassert(outputBlock.getNumSamples() <= pDelayBuffer->getNumSamples());
-            
             // copy the input block to the delay block
             // we use each delay line's to input to the next delay line
-            dsp::AudioBlock<float> delayBlock(*pDelayBuffer);
+            jassert(numSamples <= delayBuffers[ix].getNumSamples());
+            dsp::AudioBlock<float> delayBlock = dsp::AudioBlock<float>(delayBuffers[ix])
+                .getSubsetChannelBlock(0, outputBlock.getNumChannels())
+                .getSubBlock(0, static_cast<size_t>(numSamples));
             delayBlock.copyFrom(inputBlock);
-            jassert(delayBlock.getNumSamples() == outputBlock.getNumSamples());
-            jassert(delayBlock.getNumChannels() == outputBlock.getNumChannels());
-            dsp::ProcessContextReplacing<float> delayContext(delayBlock);
             
             // Now process
-            auto pDelayLine = delayLines[ix];
-            pDelayLine->process(delayContext);
-            delayBlock.multiplyBy(wetMix);
+            for (size_t chan = 0; chan < delayBlock.getNumChannels(); ++chan) {
+                delay(getLine(ix, static_cast<int>(chan)), delayBlock.getChannelPointer(chan), numSamples);
+            }
+            if (mixRamping) {
+                for (size_t chan = 0; chan < delayBlock.getNumChannels(); ++chan) {
+                    FloatVectorOperations::multiply(
+                        delayBlock.getChannelPointer(chan), wetMixRamp.data(), numSamples);
+                }
+            }
+            else {
+                delayBlock.multiplyBy(wetMix.getTargetValue());
+            }
 
             // save the last processed block
             lastProcessedBlock = delayBlock;
         }
+        writeIndex = (writeIndex + numSamples) & lineMask;
 
         // mix all the delay blocks back with the original block.
         // outputBlock + delayBlocks = new output
@@ -129,7 +154,7 @@ public:
                 // todo would using a pointer be more efficient? do clients of AudioBlock even have that ability?
                 SAMPLE_TYPE processedTotal = 0.0;
                 for (int iBuf = 0; iBuf < numRepeats; ++iBuf) {
-                    processedTotal += delayBuffers[iBuf]->getSample(chan, samp);
+                    processedTotal += delayBuffers[iBuf].getSample(chan, samp);
                 }
                 SAMPLE_TYPE newSample = outputBlock.getSample(chan, samp) + processedTotal;
                 outputBlock.setSample(chan, samp, newSample);
@@ -143,7 +168,53 @@ public:
      */
     void reset() override
     {
-        std::for_each(delayLines.begin(), delayLines.end(), [](auto & p){ p->reset(); });
+        std::fill(lineBuffer.begin(), lineBuffer.end(), 0.0f);
+        wetMix.setCurrentAndTargetValue(wetMix.getTargetValue());
+    }
+
+    /**
+     * The last repeat.
+     */
+    int getTailSamples() const noexcept override
+    {
+        return tailSamples;
+    }
+
+    /**
+     * With no wet signal, the input passes straight through.
+     */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        if (wetMix.isSmoothing() || wetMix.getTargetValue() != 0.0f) {
+            return false;
+        }
+        gain = 1.0f;
+        return true;
+    }
+
+    /** The delay lines and the repeats' buffers. */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        memory.add(lineBuffer);
+        for (auto & delayBuffer : delayBuffers) {
+            memory.add(delayBuffer);
+        }
+        memory.add(wetMixRamp);
+    }
+
+private:
+
+    // Write a channel's block into its line, and replace it with the delayed
+    // samples.
+    void delay(float * pLine, float * pSamples, const int numSamples) noexcept
+    {
+        for (int samp = 0; samp < numSamples; ++samp) {
+            const int position = writeIndex + samp;
+            pLine[position & lineMask] = pSamples[samp];
+            const float newer = pLine[(position - delayWhole) & lineMask];
+            const float older = pLine[(position - delayWhole - 1) & lineMask];
+            pSamples[samp] = newer + delayFraction * (older - newer);
+        }
     }
 
 };
@@ -2,9 +2,16 @@
 
 #include <JuceHeader.h>
 
+#include "ChorusProcessor.h"
+#include "ConvolutionReverbProcessor.h"
 #include "DelayProcessor.h"
+#include "FdnReverbProcessor.h"
 #include "EffectUtil.h"
+#include "MultirateProcessor.h"
+#include "OversamplingProcessor.h"
+#include "WaveshaperProcessor.h"
 #include "juce_igutil/EffectProcessor.h"
+#include "juce_igutil/ProcessorGraph.h"
 #include "juce_igutil/ProcessorSequence.h"
 
 using namespace std;
@@ -12,32 +19,29 @@ using namespace juce;
 using namespace juce_igutil;
 
 // chorus effect
-ProcessorAndFxSetter effect_creator::createChorus(std::deque<FxParamGroup> & fxParams) 
+ProcessorAndFxSetter effect_creator::createChorus() 
 {
-    auto pChorusFx = make_shared<ChorusType>();
-    pChorusFx->setCentreDelay(20.0);
-    pChorusFx->setDepth(0.3);
+    auto pChorusFx = make_shared<ChorusProcessor>(config::chorusNumTaps);
+    pChorusFx->setDelay(12.0, 3.0);
     pChorusFx->setMix(0.5);
     pChorusFx->setRate(0.75);
-    FxSetterFunc chorusGainFunc( [pChorusFx, &fxParams](int fxIndex) { 
-        auto pGain = fxParams.at(fxIndex).pGain;
-        pChorusFx->setMix(*pGain);
+    FxSetterFunc chorusGainFunc( [pChorusFx](float level) { 
+        pChorusFx->setMix(level);
     });
     auto pChorusGainSetter = make_shared<FxSetter>();
     pChorusGainSetter->fxGainSetter = chorusGainFunc;
     return ProcessorAndFxSetter{
-        make_shared<EffectProcessor<ChorusType>>(pChorusFx),
+        pChorusFx,
         pChorusGainSetter
     };
 }
 
 // delay
-ProcessorAndFxSetter effect_creator::createDelay(std::deque<FxParamGroup> & fxParams)
+ProcessorAndFxSetter effect_creator::createDelay()
 {
     auto pDelayFx = make_shared<DelayProcessor>();
-    FxSetterFunc delayGainFunc( [pDelayFx, &fxParams](int fxIndex) { 
-        auto pGain = fxParams.at(fxIndex).pGain;
-        pDelayFx->setMix(*pGain);
+    FxSetterFunc delayGainFunc( [pDelayFx](float level) { 
+        pDelayFx->setMix(level);
     });
     auto pDelayGainSetter = make_shared<FxSetter>();
     pDelayGainSetter->fxGainSetter = delayGainFunc;
@@ -47,30 +51,81 @@ ProcessorAndFxSetter effect_creator::createDelay(std::deque<FxParamGroup> & fxPa
     };
 }
 
+// reverb parameters shared by both reverb engines
+static const dsp::Reverb::Parameters reverbParams{
+    0.75, //float roomSize   = 0.5f;     /**< Room size, 0 to 1.0, where 1.0 is big, 0 is small. */
+    0.4, //float damping    = 0.5f;     /**< Damping, 0 to 1.0, where 0 is not damped, 1.0 is fully damped. */
+    0.30, //float wetLevel   = 0.33f;    /**< Wet level, 0 to 1.0 */
+    0.6, //float dryLevel   = 0.4f;     /**< Dry level, 0 to 1.0 */
+    0.3, //float width      = 1.0f;     /**< Reverb width, 0 to 1.0, where 1.0 is very wide. */
+    0.0 //float freezeMode = 0.0f;     /**< Freeze mode - values < 0.5 are "normal" mode, values > 0.5
+};
+
+// How long juce::dsp::Reverb takes to die away by 90dB with the parameters 
+// above (its combs' feedback is 0.91 at roomSize 0.75).
+static const double freeverbTailSeconds = 4.0;
+
 // reverb
-ProcessorAndFxSetter effect_creator::createReverb(std::deque<FxParamGroup> & fxParams)
+ProcessorAndFxSetter effect_creator::createReverb()
 {
+    if (config::reverbEngine == config::ReverbEngine::FDN) {
+        return createFdnReverb();
+    }
+
     auto pReverbFx = make_shared<ReverbType>();
-    dsp::Reverb::Parameters params{
-        0.75, //float roomSize   = 0.5f;     /**< Room size, 0 to 1.0, where 1.0 is big, 0 is small. */
-        0.4, //float damping    = 0.5f;     /**< Damping, 0 to 1.0, where 0 is not damped, 1.0 is fully damped. */
-        0.30, //float wetLevel   = 0.33f;    /**< Wet level, 0 to 1.0 */
-        0.6, //float dryLevel   = 0.4f;     /**< Dry level, 0 to 1.0 */
-        0.3, //float width      = 1.0f;     /**< Reverb width, 0 to 1.0, where 1.0 is very wide. */
-        0.0 //float freezeMode = 0.0f;     /**< Freeze mode - values < 0.5 are "normal" mode, values > 0.5
-    };
-    pReverbFx->setParameters(params);
-    FxSetterFunc reverbGainFunc( [pReverbFx, &fxParams](int fxIndex) { 
-        auto pGain = fxParams.at(fxIndex).pGain;
+    pReverbFx->setParameters(reverbParams);
+    // setParameters() recalculates all the filters; the setter is only called
+    // when the level changes.
+    FxSetterFunc reverbGainFunc( [pReverbFx](float level) { 
         dsp::Reverb::Parameters parms = pReverbFx->getParameters();
-        parms.wetLevel = *pGain;
+        parms.wetLevel = level;
         parms.dryLevel = 1.0 - parms.wetLevel;
         pReverbFx->setParameters(parms);
     });
     auto pReverbGainSetter = make_shared<FxSetter>();
     pReverbGainSetter->fxGainSetter = reverbGainFunc;
+    auto pReverbProc = make_shared<EffectProcessor<ReverbType>>(pReverbFx, freeverbTailSeconds);
+    pReverbProc->setPureGainFunc( [pReverbFx](float & gain) {
+        const auto & parms = pReverbFx->getParameters();
+        if (parms.wetLevel != 0.0f) return false;
+        gain = parms.dryLevel;
+        return true;
+    });
+    return ProcessorAndFxSetter{
+        pReverbProc,
+        pReverbGainSetter
+    };
+}
+
+// feedback delay network reverb
+ProcessorAndFxSetter effect_creator::createFdnReverb()
+{
+    auto pReverbFx = make_shared<FdnReverbProcessor>(config::fdnReverbNumLines);
+    pReverbFx->setParameters(reverbParams);
+    FxSetterFunc reverbGainFunc( [pReverbFx](float level) { 
+        pReverbFx->setMix(level);
+    });
+    auto pReverbGainSetter = make_shared<FxSetter>();
+    pReverbGainSetter->fxGainSetter = reverbGainFunc;
+    return ProcessorAndFxSetter{
+        pReverbFx,
+        pReverbGainSetter
+    };
+}
+
+// convolution reverb
+ProcessorAndFxSetter effect_creator::createConvolutionReverb(
+    std::shared_ptr<ImpulseResponseLoader> pLoader,
+    std::shared_ptr<ConvolutionTailWorker> pTailWorker)
+{
+    auto pReverbFx = make_shared<ConvolutionReverbProcessor>(pLoader, pTailWorker);
+    FxSetterFunc reverbGainFunc( [pReverbFx](float level) { 
+        pReverbFx->setMix(level);
+    });
+    auto pReverbGainSetter = make_shared<FxSetter>();
+    pReverbGainSetter->fxGainSetter = reverbGainFunc;
     return ProcessorAndFxSetter{
-        make_shared<EffectProcessor<ReverbType>>(pReverbFx),
+        pReverbFx,
         pReverbGainSetter
     };
 }
@@ -81,28 +136,112 @@ ProcessorAndFxSetter effect_creator::createReverb(std::deque<FxParamGroup> & fxP
 // pretty good except there's some high pitched tonal noise I'm not sure 
 // what to do about.  Lowering the LPF cutoff doesn't seem to help; it just 
 // lowers the frequency of the noise.
-// TODO the noise only shows up when no notes are sounding.  Consider by-
-// passing it when no notes are playing.
-ProcessorAndFxSetter effect_creator::createDistortion(std::deque<FxParamGroup> & fxParams)
+// The noise only shows up when no notes are sounding, and ProcessorSequence
+// now bypasses the effect once its input is silent.
+// The drive is run oversampled so its harmonics don't alias back down; the 
+// output level is applied afterwards at the normal rate.  The live and 
+// offline oversampling each run their own copy of the drive.
+ProcessorAndFxSetter effect_creator::createDistortion()
 {
-    auto pDistortionFx = make_shared<DistortionType>();
-    const float drive = 650.0f;
-    pDistortionFx->setDrive(drive);
-    pDistortionFx->setMode(dsp::LadderFilterMode::LPF12);
-    pDistortionFx->setCutoffFrequencyHz(30'000.0);
-    pDistortionFx->setResonance(0.0);
+    auto createDrive = []() {
+        auto pDistortionFx = make_shared<DistortionType>();
+        const float drive = 650.0f;
+        pDistortionFx->setDrive(drive);
+        pDistortionFx->setMode(dsp::LadderFilterMode::LPF12);
+        pDistortionFx->setCutoffFrequencyHz(30'000.0);
+        pDistortionFx->setResonance(0.0);
+        return make_shared<EffectProcessor<DistortionType>>(pDistortionFx, 0.01);
+    };
     auto pDistLevel = make_shared<GainType>();
+    pDistLevel->setRampDurationSeconds(config::parameterSmoothingSeconds);
     auto pDistSeq = make_shared<ProcessorSequence>();
-    pDistSeq->addProcessor(make_shared<EffectProcessor<DistortionType>>(pDistortionFx));
-    pDistSeq->addProcessor(make_shared<EffectProcessor<GainType>>(pDistLevel));
+    pDistSeq->addProcessor(make_shared<OversamplingProcessor>(
+        createDrive(),
+        createDrive(),
+        OversamplingProcessor::Settings{
+            config::distortionOversamplingOrderLive,
+            config::distortionOversamplingFIRLive },
+        OversamplingProcessor::Settings{
+            config::distortionOversamplingOrderOffline,
+            config::distortionOversamplingFIROffline }
+    ));
+    // The level is a plain gain, so it's folded into the next gain along.  At 
+    // level 0 that mutes the whole thing, and the distortion is skipped too.
+    auto pDistLevelProc = make_shared<EffectProcessor<GainType>>(pDistLevel, 0.0);
+    pDistLevelProc->setPureGainFunc( [pDistLevel](float & gain) {
+        if (pDistLevel->isSmoothing()) return false;
+        gain = pDistLevel->getGainLinear();
+        return true;
+    });
+    pDistSeq->addProcessor(pDistLevelProc);
     
-    FxSetterFunc distGainFunc( [pDistLevel, &fxParams](int fxIndex) { 
-        auto pGain = fxParams.at(fxIndex).pGain;
-        pDistLevel->setGainLinear(*pGain * 0.15); // hard code a reduction because there's a LOT of gain
+    FxSetterFunc distGainFunc( [pDistLevel](float level) { 
+        pDistLevel->setGainLinear(level * 0.15); // hard code a reduction because there's a LOT of gain
     });
     auto pDistGainSetter = make_shared<FxSetter>();
     pDistGainSetter->fxGainSetter = distGainFunc;
     return ProcessorAndFxSetter{pDistSeq, pDistGainSetter};
 }
 
+// waveshaper
+ProcessorAndFxSetter effect_creator::createWaveshaper()
+{
+    auto pWaveshaperFx = make_shared<WaveshaperProcessor>(
+        config::waveshaperShape, config::waveshaperAdaaOrder);
+    pWaveshaperFx->setDrive(config::waveshaperDrive);
+    FxSetterFunc waveshaperGainFunc( [pWaveshaperFx](float level) { 
+        pWaveshaperFx->setLevel(level * 0.5); // the curve's output is up to full scale
+    });
+    auto pWaveshaperGainSetter = make_shared<FxSetter>();
+    pWaveshaperGainSetter->fxGainSetter = waveshaperGainFunc;
+    return ProcessorAndFxSetter{
+        pWaveshaperFx,
+        pWaveshaperGainSetter
+    };
+}
+
+
+// parallel delay and reverb: the delay (which passes the dry signal through)
+// and a fully wet reverb both take the input, and the reverb's level is set by
+// a return gain.
+//
+//   input -+-> delay -------------+-> output
+//          +-> reverb -> return --+
+ProcessorAndFxSetter effect_creator::createDelayReverb(
+    std::shared_ptr<juce_igutil::RealtimeWorkerPool> pWorkerPool)
+{
+    auto pDelayFx = make_shared<DelayProcessor>();
+    auto pReverbFx = make_shared<FdnReverbProcessor>(config::fdnReverbNumLines);
+    pReverbFx->setParameters(reverbParams);
+    pReverbFx->setMix(1.0);
+    auto pReturnLevel = make_shared<GainType>();
+    pReturnLevel->setRampDurationSeconds(config::parameterSmoothingSeconds);
+
+    auto pGraph = make_shared<ProcessorGraph>(pWorkerPool);
+    pGraph->addNode(pDelayFx, {ProcessorGraph::graphInput}, true);
+    const int reverbNode = pGraph->addNode(pReverbFx, {ProcessorGraph::graphInput}, false);
+    pGraph->addNode(make_shared<EffectProcessor<GainType>>(pReturnLevel, 0.0), {reverbNode}, true);
 
+    FxSetterFunc delayReverbGainFunc( [pDelayFx, pReturnLevel](float level) { 
+        pDelayFx->setMix(level);
+        pReturnLevel->setGainLinear(level * reverbParams.wetLevel);
+    });
+    auto pDelayReverbGainSetter = make_shared<FxSetter>();
+    pDelayReverbGainSetter->fxGainSetter = delayReverbGainFunc;
+    return ProcessorAndFxSetter{
+        pGraph,
+        pDelayReverbGainSetter
+    };
+}
+
+// reduced rate wrapper
+ProcessorAndFxSetter effect_creator::atReducedRate(ProcessorAndFxSetter effect)
+{
+    if (!config::multirateFx) {
+        return effect;
+    }
+    return ProcessorAndFxSetter{
+        make_shared<MultirateProcessor>(effect.pProcessor),
+        effect.pFxSetter
+    };
+}
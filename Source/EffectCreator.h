@@ -2,19 +2,30 @@
 
 #include <JuceHeader.h>
 
+#include "ConvolutionTailWorker.h"
 #include "EffectUtil.h"
+#include "ImpulseResponseLoader.h"
 #include "juce_igutil/EffectProcessor.h"
+#include "juce_igutil/RealtimeWorkerPool.h"
 
 namespace effect_creator {
 
     // create chorus effect
-    ProcessorAndFxSetter createChorus(std::deque<FxParamGroup> & fxParams);
+    ProcessorAndFxSetter createChorus();
 
     // create delay
-    ProcessorAndFxSetter createDelay(std::deque<FxParamGroup> & fxParams);
+    ProcessorAndFxSetter createDelay();
 
-    // reverb
-    ProcessorAndFxSetter createReverb(std::deque<FxParamGroup> & fxParams);
+    // reverb, using the engine selected in config::reverbEngine
+    ProcessorAndFxSetter createReverb();
+
+    // feedback delay network reverb
+    ProcessorAndFxSetter createFdnReverb();
+
+    // convolution reverb, using the impulse response from the loader
+    ProcessorAndFxSetter createConvolutionReverb(
+        std::shared_ptr<ImpulseResponseLoader> pLoader,
+        std::shared_ptr<ConvolutionTailWorker> pTailWorker);
     
     // "distortion"; the only one provided with juce::dsp is this mild overdrive
     // from the ladder filter.  It's actually pretty cool because it makes the 
@@ -22,7 +33,20 @@ namespace effect_creator {
     // pretty good except there's some high pitched tonal noise I'm not sure 
     // what to do about.  Lowering the LPF cutoff doesn't seem to help; it just 
     // lowers the frequency of the noise.
-    // TODO the noise only shows up when no notes are sounding.  Consider by-
-    // passing it when no notes are playing.
-    ProcessorAndFxSetter createDistortion(std::deque<FxParamGroup> & fxParams);
+    // The noise only shows up when no notes are sounding, and 
+    // ProcessorSequence now bypasses the effect once its input is silent.
+    ProcessorAndFxSetter createDistortion();
+
+    // waveshaper distortion with antiderivative anti-aliasing; a cheaper 
+    // alternative to the oversampled distortion above.
+    ProcessorAndFxSetter createWaveshaper();
+
+    // delay and reverb in parallel rather than one after the other, with 
+    // the branches run on the worker pool.
+    ProcessorAndFxSetter createDelayReverb(
+        std::shared_ptr<juce_igutil::RealtimeWorkerPool> pWorkerPool);
+
+    // run an effect at a reduced rate when the host rate is high, if 
+    // config::multirateFx is set; otherwise it's returned as is.
+    ProcessorAndFxSetter atReducedRate(ProcessorAndFxSetter effect);
 }
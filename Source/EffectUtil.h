@@ -4,7 +4,9 @@
 
 #include "Config.h"
 
-using FxSetterFunc = std::function<void(int)>;
+// Applies an effect slot's level.  Only called when it changes, and when the
+// effect is put in a slot.
+using FxSetterFunc = std::function<void(float)>;
 struct FxSetter {
     FxSetterFunc fxGainSetter;
     // todo add more when new effects controls are added
@@ -15,12 +17,6 @@ struct ProcessorAndFxSetter {
     std::shared_ptr<FxSetter> pFxSetter = nullptr;
 };
 
-struct FxParamGroup {
-    std::atomic<float> * pTypeSelector = nullptr;
-    std::atomic<float> * pGain = nullptr;
-};
-
-using ChorusType = juce::dsp::Chorus<SAMPLE_TYPE>;
 using ReverbType = juce::dsp::Reverb;
 using GainType = juce::dsp::Gain<SAMPLE_TYPE>;
 using DistortionType = juce::dsp::LadderFilter<SAMPLE_TYPE>;
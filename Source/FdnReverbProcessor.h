@@ -0,0 +1,403 @@
+/**
+ * A feedback delay network (FDN) reverb.  This is an alternative engine for
+ * the reverb effect: instead of running Freeverb's 8 comb and 4 allpass
+ * filters per channel one sample at a time, all of the delay lines are damped,
+ * mixed and fed back together using juce::dsp::SIMDRegister.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+#include "Config.h"
+
+class FdnReverbProcessor: public juce_igutil::Processor
+{
+public:
+
+    // Feedback mixing matrix.  Both are orthogonal (lossless), so the decay
+    // is controlled by the per-line feedback gains alone.
+    enum class MixingMatrix {
+        HOUSEHOLDER, // I - 2/N * ones; cheapest, but less diffuse
+        HADAMARD     // Walsh-Hadamard; maximally diffuse
+    };
+
+    // The parameters are the same as juce::dsp::Reverb's, so the two engines
+    // can be swapped without touching the callers.
+    using Parameters = juce::dsp::Reverb::Parameters;
+
+    static const int maxDelayLines = 16;
+
+private:
+
+    using SIMDType = juce::dsp::SIMDRegister<float>;
+    static constexpr int simdWidth = static_cast<int>(SIMDType::SIMDNumElements);
+    static_assert(maxDelayLines % simdWidth == 0, "delay lines must fill whole SIMD registers");
+
+    // Delay line lengths at roomSize 0.5, in ms.  These are tuned in time
+    // rather than in samples so the reverb sounds the same at every sample
+    // rate.  When using fewer than maxDelayLines, every other one is used.
+    static constexpr float baseDelayMs[maxDelayLines] = {
+        23.1f, 27.7f, 31.3f, 36.7f, 41.1f, 44.9f, 50.3f, 53.9f,
+        59.3f, 63.7f, 68.9f, 73.1f, 79.3f, 83.9f, 89.1f, 97.3f
+    };
+
+    // Largest room size scale applied to baseDelayMs; used to size the lines.
+    static constexpr float maxRoomScale = 1.5f;
+
+    // Delay modulation (chorusing of the tail) depth in ms and base rate in Hz.
+    static constexpr float modDepthMs = 0.35f;
+    static constexpr float modRateHz = 0.31f;
+
+    // Loudness trim to roughly match juce::dsp::Reverb at the same wet level.
+    static constexpr float wetTrim = 0.6f;
+
+    // SIMD-aligned per-line state.  One entry per delay line.
+    struct alignas(SIMDType::SIMDRegisterSize) LineState {
+        float values[maxDelayLines] = {};
+        inline float & operator[](const int ix) { return values[ix]; }
+        inline const float & operator[](const int ix) const { return values[ix]; }
+        inline SIMDType load(const int reg) const { return SIMDType::fromRawArray(values + reg * simdWidth); }
+        inline void store(const int reg, const SIMDType v) { v.copyToRawArray(values + reg * simdWidth); }
+    };
+
+    const int numLines;
+    const int numRegisters;
+    const MixingMatrix mixingMatrix;
+
+    Parameters params;
+    double sampleRate = 48000.0;
+    int numChannels = 2;
+
+    // All delay lines live in one buffer; each line is a power-of-two slice.
+    std::vector<float> lineBuffer;
+    int lineSize = 0;
+    int lineMask = 0;
+    int writeIndex = 0;
+    std::array<int, maxDelayLines> lineLengths{};
+
+    LineState delayOut;   // output read from each line this sample
+    LineState lowpass;    // damping filter state
+    LineState feedback;   // mixed signal written back to the lines
+    LineState fbGain;     // per-line decay gain
+    LineState inputGain;  // per-line input gain (alternating sign)
+    LineState outLeft;    // left output tap gains
+    LineState outRight;   // right output tap gains
+    LineState lfoSin;     // quadrature LFO per line, used for modulation
+    LineState lfoCos;
+    LineState lfoRotSin;
+    LineState lfoRotCos;
+
+    float dampCoef = 0.0f;
+    float modDepthSamples = 0.0f;
+    int tailSamples = infiniteTail;
+    float wet1 = 0.0f;
+    float wet2 = 0.0f;
+    juce::SmoothedValue<float> wetGain;
+    juce::SmoothedValue<float> dryGain;
+
+public:
+    /** Constructor.  numDelayLines must be 8 or 16. */
+    FdnReverbProcessor(
+        const int numDelayLines = 8,
+        const MixingMatrix matrix = MixingMatrix::HADAMARD
+    ):
+        juce_igutil::Processor(),
+        numLines(numDelayLines),
+        numRegisters(numDelayLines / simdWidth),
+        mixingMatrix(matrix)
+    {
+        jassert(numLines == 8 || numLines == 16);
+        jassert(numLines % simdWidth == 0);
+    }
+
+    /** Destructor. */
+    virtual ~FdnReverbProcessor() = default;
+
+    /** Set all the reverb parameters. */
+    void setParameters(const Parameters & newParams)
+    {
+        params = newParams;
+        updateCoefficients();
+    }
+
+    /** Get the current reverb parameters. */
+    const Parameters & getParameters() const noexcept
+    {
+        return params;
+    }
+
+    /**
+     * Set wet/dry mix (1.0 = full wet, 0.0 = full dry).  This is much cheaper
+     * than setParameters() as nothing needs to be recalculated.
+     */
+    void setMix(const float wetToDryRatio)
+    {
+        params.wetLevel = wetToDryRatio;
+        params.dryLevel = 1.0f - wetToDryRatio;
+        wetGain.setTargetValue(params.wetLevel);
+        dryGain.setTargetValue(params.dryLevel);
+    }
+
+    /** Prepare to process audio.  */
+    void prepare(const juce::dsp::ProcessSpec& spec) override
+    {
+        sampleRate = spec.sampleRate;
+        numChannels = static_cast<int>(spec.numChannels);
+
+        // Size every line for the largest room plus the modulation swing.
+        modDepthSamples = static_cast<float>(modDepthMs * 0.001 * sampleRate);
+        const double longestMs = baseDelayMs[maxDelayLines - 1] * maxRoomScale;
+        const int longest = static_cast<int>(longestMs * 0.001 * sampleRate + modDepthSamples) + 4;
+        lineSize = juce::nextPowerOfTwo(longest);
+        lineMask = lineSize - 1;
+        lineBuffer.assign(static_cast<size_t>(lineSize * numLines), 0.0f);
+
+        // Input and output taps.  Alternating signs decorrelate left and right.
+        const float norm = 1.0f / std::sqrt(static_cast<float>(numLines));
+        for (int ix = 0; ix < numLines; ++ix) {
+            inputGain[ix] = (ix % 2 == 0 ? norm : -norm);
+            outLeft[ix] = norm;
+            outRight[ix] = ((ix / 2) % 2 == 0 ? norm : -norm);
+        }
+
+        // Each line gets its own modulation rate and starting phase so the
+        // modulation does not pulse.
+        for (int ix = 0; ix < numLines; ++ix) {
+            const double rate = modRateHz * (1.0 + 0.17 * ix);
+            const double w = juce::MathConstants<double>::twoPi * rate / sampleRate;
+            const double phase = juce::MathConstants<double>::twoPi * ix / numLines;
+            lfoRotSin[ix] = static_cast<float>(std::sin(w));
+            lfoRotCos[ix] = static_cast<float>(std::cos(w));
+            lfoSin[ix] = static_cast<float>(std::sin(phase));
+            lfoCos[ix] = static_cast<float>(std::cos(phase));
+        }
+
+        wetGain.reset(sampleRate, config::parameterSmoothingSeconds);
+        dryGain.reset(sampleRate, config::parameterSmoothingSeconds);
+        wetGain.setCurrentAndTargetValue(params.wetLevel);
+        dryGain.setCurrentAndTargetValue(params.dryLevel);
+
+        updateCoefficients();
+        reset();
+    }
+
+    /**
+     * Process audio.
+     */
+    void process(juce::dsp::ProcessContextReplacing<float> & context) noexcept override
+    {
+        auto & outputBlock = context.getOutputBlock();
+        const int numSamples = static_cast<int>(outputBlock.getNumSamples());
+        const bool stereo = outputBlock.getNumChannels() > 1;
+        float * left = outputBlock.getChannelPointer(0);
+        float * right = stereo ? outputBlock.getChannelPointer(1) : nullptr;
+
+        // The lines are fed the mid signal, (L + R) / 2; a mono input is fed
+        // as both channels, so at the same level.
+        const float inputScale = params.freezeMode >= 0.5f ? 0.0f : 0.5f;
+        const SIMDType damp = SIMDType::expand(dampCoef);
+        const SIMDType undamp = SIMDType::expand(1.0f - dampCoef);
+
+        for (int samp = 0; samp < numSamples; ++samp) {
+            const float dryL = left[samp];
+            const float dryR = stereo ? right[samp] : dryL;
+            const float input = (dryL + dryR) * inputScale;
+
+            // Read every line at its (modulated) length.  This is the only
+            // per-line scalar work; everything after it is done in SIMD.
+            for (int ix = 0; ix < numLines; ++ix) {
+                const float delay = lineLengths[ix] + modDepthSamples * lfoSin[ix];
+                delayOut[ix] = readLine(ix, delay);
+            }
+
+            // Damp, tap the outputs and advance the LFOs.
+            SIMDType accL = SIMDType::expand(0.0f);
+            SIMDType accR = SIMDType::expand(0.0f);
+            for (int reg = 0; reg < numRegisters; ++reg) {
+                const SIMDType lp = delayOut.load(reg) * undamp + lowpass.load(reg) * damp;
+                lowpass.store(reg, lp);
+                accL += lp * outLeft.load(reg);
+                accR += lp * outRight.load(reg);
+
+                const SIMDType s = lfoSin.load(reg);
+                const SIMDType c = lfoCos.load(reg);
+                const SIMDType rs = lfoRotSin.load(reg);
+                const SIMDType rc = lfoRotCos.load(reg);
+                lfoSin.store(reg, s * rc + c * rs);
+                lfoCos.store(reg, c * rc - s * rs);
+            }
+
+            // Mix and write back.
+            mix(lowpass, feedback);
+            const SIMDType in = SIMDType::expand(input);
+            for (int reg = 0; reg < numRegisters; ++reg) {
+                feedback.store(reg, feedback.load(reg) * fbGain.load(reg) + in * inputGain.load(reg));
+            }
+            for (int ix = 0; ix < numLines; ++ix) {
+                lineBuffer[static_cast<size_t>(ix * lineSize + writeIndex)] = feedback[ix];
+            }
+            writeIndex = (writeIndex + 1) & lineMask;
+
+            // Output, with Freeverb-style width handling.
+            const float tapL = accL.sum();
+            const float tapR = accR.sum();
+            const float wet = wetGain.getNextValue() * wetTrim;
+            const float dry = dryGain.getNextValue();
+            left[samp] = dryL * dry + wet * (tapL * wet1 + tapR * wet2);
+            if (stereo) {
+                right[samp] = dryR * dry + wet * (tapR * wet1 + tapL * wet2);
+            }
+        }
+
+        // The LFO recurrences slowly drift in amplitude; pull them back once
+        // per block.
+        for (int ix = 0; ix < numLines; ++ix) {
+            const float mag = std::sqrt(lfoSin[ix] * lfoSin[ix] + lfoCos[ix] * lfoCos[ix]);
+            if (mag > 0.0f) {
+                lfoSin[ix] /= mag;
+                lfoCos[ix] /= mag;
+            }
+        }
+    }
+
+    /**
+     * Reset the internal state of the processor, with smoothing if
+     * necessary.
+     */
+    void reset() override
+    {
+        std::fill(lineBuffer.begin(), lineBuffer.end(), 0.0f);
+        lowpass = LineState();
+        feedback = LineState();
+        delayOut = LineState();
+        writeIndex = 0;
+        wetGain.setCurrentAndTargetValue(params.wetLevel);
+        dryGain.setCurrentAndTargetValue(params.dryLevel);
+    }
+
+    /** Time to decay by 90dB, or forever when frozen. */
+    int getTailSamples() const noexcept override
+    {
+        return tailSamples;
+    }
+
+    /**
+     * Just the dry signal when the mix is fully dry, and the wet level has
+     * finished fading out.
+     */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        if (params.wetLevel != 0.0f || wetGain.isSmoothing() || dryGain.isSmoothing()) {
+            return false;
+        }
+        gain = params.dryLevel;
+        return true;
+    }
+
+    /** The delay lines, all in one buffer. */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        memory.add(lineBuffer);
+    }
+
+private:
+
+    /**
+     * Recalculate the line lengths, decay gains and damping from the
+     * parameters and sample rate.
+     */
+    void updateCoefficients()
+    {
+        const bool frozen = params.freezeMode >= 0.5f;
+
+        // roomSize 0..1 scales the lines from half to maxRoomScale of their
+        // base length, and the decay time from 0.3s to 5s.
+        const float roomScale = 0.5f + params.roomSize * (maxRoomScale - 0.5f);
+        const double t60 = 0.3 + params.roomSize * params.roomSize * 4.7;
+        const int step = maxDelayLines / numLines;
+        for (int ix = 0; ix < numLines; ++ix) {
+            const double ms = baseDelayMs[ix * step] * roomScale;
+            lineLengths[ix] = juce::jmax(1, static_cast<int>(ms * 0.001 * sampleRate));
+            fbGain[ix] = frozen ? 1.0f : static_cast<float>(
+                std::pow(10.0, -3.0 * lineLengths[ix] / (t60 * sampleRate)));
+        }
+
+        // damping 0..1 sweeps the loop lowpass from 18kHz down to 1.5kHz.
+        // A frozen reverb is not damped at all.
+        const double dampHz = juce::jmin(18000.0 - params.damping * 16500.0, sampleRate * 0.49);
+        dampCoef = frozen ? 0.0f : static_cast<float>(
+            std::exp(-juce::MathConstants<double>::twoPi * dampHz / sampleRate));
+
+        // 90dB of decay (1.5 * t60), after the longest line has been filled
+        const int longestLine = *std::max_element(lineLengths.begin(), lineLengths.begin() + numLines);
+        tailSamples = frozen ? infiniteTail :
+            static_cast<int>(std::ceil(1.5 * t60 * sampleRate + modDepthSamples)) + longestLine;
+
+        wet1 = 0.5f * (1.0f + params.width);
+        wet2 = 0.5f * (1.0f - params.width);
+        wetGain.setTargetValue(params.wetLevel);
+        dryGain.setTargetValue(params.dryLevel);
+    }
+
+    /**
+     * Read a line at a fractional delay with linear interpolation.
+     */
+    inline float readLine(const int line, const float delay) const noexcept
+    {
+        const float readPos = static_cast<float>(writeIndex) - delay;
+        const float floorPos = std::floor(readPos);
+        const int i0 = static_cast<int>(floorPos);
+        const float frac = readPos - floorPos;
+        const float * p = lineBuffer.data() + line * lineSize;
+        const float a = p[i0 & lineMask];
+        const float b = p[(i0 + 1) & lineMask];
+        return a + (b - a) * frac;
+    }
+
+    /**
+     * Apply the feedback matrix:  out = M * in.
+     */
+    inline void mix(const LineState & in, LineState & out) const noexcept
+    {
+        if (mixingMatrix == MixingMatrix::HOUSEHOLDER) {
+            SIMDType total = in.load(0);
+            for (int reg = 1; reg < numRegisters; ++reg) total += in.load(reg);
+            const SIMDType reflect = SIMDType::expand(total.sum() * (-2.0f / numLines));
+            for (int reg = 0; reg < numRegisters; ++reg) {
+                out.store(reg, in.load(reg) + reflect);
+            }
+            return;
+        }
+
+        // Fast Walsh-Hadamard transform.  Butterflies that span whole
+        // registers are done in SIMD; the ones inside a register are not
+        // expressible with SIMDRegister (no shuffles) so they are scalar.
+        out = in;
+        for (int half = 1; half < simdWidth && half < numLines; half <<= 1) {
+            for (int ix = 0; ix < numLines; ix += 2 * half) {
+                for (int jx = ix; jx < ix + half; ++jx) {
+                    const float a = out[jx];
+                    const float b = out[jx + half];
+                    out[jx] = a + b;
+                    out[jx + half] = a - b;
+                }
+            }
+        }
+        for (int halfRegs = 1; halfRegs < numRegisters; halfRegs <<= 1) {
+            for (int reg = 0; reg < numRegisters; reg += 2 * halfRegs) {
+                for (int jreg = reg; jreg < reg + halfRegs; ++jreg) {
+                    const SIMDType a = out.load(jreg);
+                    const SIMDType b = out.load(jreg + halfRegs);
+                    out.store(jreg, a + b);
+                    out.store(jreg + halfRegs, a - b);
+                }
+            }
+        }
+        const SIMDType norm = SIMDType::expand(1.0f / std::sqrt(static_cast<float>(numLines)));
+        for (int reg = 0; reg < numRegisters; ++reg) {
+            out.store(reg, out.load(reg) * norm);
+        }
+    }
+};
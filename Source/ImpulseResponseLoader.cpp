@@ -0,0 +1,317 @@
+#include "ImpulseResponseLoader.h"
+
+#include "Config.h"
+
+using namespace juce;
+using namespace juce_igutil;
+using namespace std;
+
+/**
+ * Constructor
+ */
+ImpulseResponseLoader::ImpulseResponseLoader(
+    std::shared_ptr<juce_igutil::MTLogger> _pMTL,
+    std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParameters
+):
+    Thread("ImpulseResponseLoader"),
+    pMTL(_pMTL),
+    pParams(pSynthParameters),
+    filePropertyId(config::impulseResponseFilePN.c_str())
+{
+    pParams->state.addListener(this);
+    updateFromState();
+    startThread();
+}
+
+/**
+ * Destructor
+ */
+ImpulseResponseLoader::~ImpulseResponseLoader()
+{
+    pParams->state.removeListener(this);
+    stopThread(4000);
+    jassert(hazards.empty() && "all processors should be gone by now");
+}
+
+/**
+ * Set the processing sample rate and partition size
+ */
+void ImpulseResponseLoader::prepare(const double sampleRate, const int partitionSize)
+{
+    const ScopedLock sl(requestLock);
+    if (sampleRate != requestedSampleRate || partitionSize != requestedPartitionSize) {
+        requestedSampleRate = sampleRate;
+        requestedPartitionSize = partitionSize;
+        reloadPending = true;
+        notify();
+    }
+}
+
+/**
+ * Register a hazard pointer
+ */
+void ImpulseResponseLoader::addHazardPointer(HazardPointer * pHazard)
+{
+    const ScopedLock sl(hazardLock);
+    hazards.push_back(pHazard);
+}
+
+/**
+ * Unregister a hazard pointer
+ */
+void ImpulseResponseLoader::removeHazardPointer(HazardPointer * pHazard)
+{
+    const ScopedLock sl(hazardLock);
+    hazards.erase(std::remove(hazards.begin(), hazards.end(), pHazard), hazards.end());
+}
+
+/**
+ * Register a listener and tell it about the current impulse response
+ */
+void ImpulseResponseLoader::addListener(Listener * pListener)
+{
+    const ScopedLock sl(listenerLock);
+    listeners.push_back(pListener);
+    if (const PartitionedImpulseResponse * pIR = pCurrent.load()) {
+        pListener->impulseResponseReady(*pIR);
+    }
+}
+
+/**
+ * Unregister a listener
+ */
+void ImpulseResponseLoader::removeListener(Listener * pListener)
+{
+    const ScopedLock sl(listenerLock);
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), pListener), listeners.end());
+}
+
+/**
+ * Loader loop
+ */
+void ImpulseResponseLoader::run()
+{
+    while (!threadShouldExit()) {
+        String filePath;
+        double sampleRate = 0.0;
+        int partitionSize = 0;
+        bool reload = false;
+        {
+            const ScopedLock sl(requestLock);
+            reload = reloadPending && requestedSampleRate > 0.0 && requestedPartitionSize > 0;
+            if (reload) {
+                reloadPending = false;
+                filePath = requestedFilePath;
+                sampleRate = requestedSampleRate;
+                partitionSize = requestedPartitionSize;
+            }
+        }
+
+        if (reload) {
+            auto pIR = build(filePath, sampleRate, partitionSize);
+            if (pIR && !threadShouldExit()) {
+                publish(move(pIR));
+            }
+        }
+
+        reclaim();
+        wait(reclaimIntervalMs);
+    }
+}
+
+/**
+ * Build the partitioned impulse response
+ */
+std::unique_ptr<PartitionedImpulseResponse> ImpulseResponseLoader::build(
+    const juce::String & filePath,
+    const double sampleRate,
+    const int partitionSize)
+{
+    AudioBuffer<float> ir;
+    double irSampleRate = sampleRate;
+    String name("built-in room");
+
+    if (filePath.isNotEmpty()) {
+        const File file(filePath);
+        if (readFile(file, ir, irSampleRate)) {
+            name = file.getFileName();
+        }
+        else {
+            pMTL->error(String("ImpulseResponseLoader: can't read impulse response file ")
+                + filePath + "; using the built-in one instead.");
+        }
+    }
+    if (ir.getNumSamples() == 0) {
+        createDefaultImpulseResponse(ir, sampleRate);
+        irSampleRate = sampleRate;
+    }
+
+    // Resample to the processing rate, as juce::dsp::Convolution does.
+    if (irSampleRate != sampleRate) {
+        const double ratio = irSampleRate / sampleRate;
+        const int newLength = static_cast<int>(std::ceil(ir.getNumSamples() / ratio));
+        MemoryAudioSource source(ir, false);
+        ResamplingAudioSource resampler(&source, false, ir.getNumChannels());
+        resampler.setResamplingRatio(ratio);
+        resampler.prepareToPlay(newLength, sampleRate);
+        AudioBuffer<float> resampled(ir.getNumChannels(), newLength);
+        resampler.getNextAudioBlock(AudioSourceChannelInfo(resampled));
+        ir = move(resampled);
+    }
+
+    // Trim the silent end and cap the length.
+    const int maxLength = static_cast<int>(config::maxImpulseResponseSeconds * sampleRate);
+    const float silence = Decibels::decibelsToGain(-90.0f);
+    int length = jmin(ir.getNumSamples(), maxLength);
+    while (length > 1 && ir.getMagnitude(length - 1, 1) < silence) {
+        --length;
+    }
+
+    // Normalise so the loudest channel passes white noise at a fixed power.
+    float maxEnergy = 0.0f;
+    for (int chan = 0; chan < ir.getNumChannels(); ++chan) {
+        const float rms = ir.getRMSLevel(chan, 0, length);
+        maxEnergy = jmax(maxEnergy, rms * rms * length);
+    }
+    if (maxEnergy <= 0.0f) {
+        pMTL->error(String("ImpulseResponseLoader: impulse response ") + name + " is silent.");
+        return nullptr;
+    }
+    const float normalisedEnergy = 0.5f;
+    ir.setSize(ir.getNumChannels(), length, true);
+    ir.applyGain(std::sqrt(normalisedEnergy / maxEnergy));
+
+    auto pIR = make_unique<PartitionedImpulseResponse>(ir, sampleRate, partitionSize);
+    pMTL->info(String("ImpulseResponseLoader: loaded ") + name + " - "
+        + String(pIR->numChannels) + " channel(s), "
+        + String(length / sampleRate, 2) + "s, "
+        + String(pIR->numPartitions) + " partitions of " + String(partitionSize) + " samples.");
+    return pIR;
+}
+
+/**
+ * Read an IR file (up to two channels).
+ */
+bool ImpulseResponseLoader::readFile(
+    const juce::File & file,
+    juce::AudioBuffer<float> & ir,
+    double & irSampleRate)
+{
+    if (!file.existsAsFile()) {
+        return false;
+    }
+
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<AudioFormatReader> pReader(formatManager.createReaderFor(file));
+    if (!pReader || pReader->sampleRate <= 0.0 || pReader->lengthInSamples <= 0) {
+        return false;
+    }
+
+    const int numChannels = jmin(2, static_cast<int>(pReader->numChannels));
+    const int64 maxLength = static_cast<int64>(config::maxImpulseResponseSeconds * pReader->sampleRate);
+    const int length = static_cast<int>(jmin(pReader->lengthInSamples, maxLength));
+    ir.setSize(numChannels, length);
+    if (!pReader->read(&ir, 0, length, 0, true, numChannels > 1)) {
+        return false;
+    }
+    irSampleRate = pReader->sampleRate;
+    return true;
+}
+
+/**
+ * Generate the built-in impulse response: a short predelay followed by
+ * exponentially decaying noise that gets darker as it decays, decorrelated
+ * between the two channels.
+ */
+void ImpulseResponseLoader::createDefaultImpulseResponse(
+    juce::AudioBuffer<float> & ir,
+    const double sampleRate)
+{
+    const double t60 = 2.2;
+    const double lengthSec = 2.6;
+    const double predelaySec = 0.008;
+    const int length = static_cast<int>(lengthSec * sampleRate);
+    const int predelay = static_cast<int>(predelaySec * sampleRate);
+
+    ir.setSize(2, length);
+    ir.clear();
+    Random random(0x1f5eed);
+    for (int chan = 0; chan < 2; ++chan) {
+        float * p = ir.getWritePointer(chan);
+        float lowpass = 0.0f;
+        for (int ix = predelay; ix < length; ++ix) {
+            const double t = (ix - predelay) / sampleRate;
+            const float envelope = static_cast<float>(std::pow(10.0, -3.0 * t / t60));
+            // one pole lowpass going from nearly open to ~2kHz over the decay
+            const float coef = static_cast<float>(jmap(t / lengthSec, 0.95, 0.25));
+            lowpass += coef * (random.nextFloat() * 2.0f - 1.0f - lowpass);
+            p[ix] = lowpass * envelope;
+        }
+    }
+}
+
+/**
+ * Publish a new impulse response, once the listeners are ready for it
+ */
+void ImpulseResponseLoader::publish(std::unique_ptr<PartitionedImpulseResponse> pIR)
+{
+    const ScopedLock sl(listenerLock);
+    for (auto pListener : listeners) {
+        pListener->impulseResponseReady(*pIR);
+    }
+    pCurrent.store(pIR.get());
+    impulseResponses.push_back(move(pIR));
+}
+
+/**
+ * Delete the retired impulse responses that aren't in any hazard pointer.
+ */
+void ImpulseResponseLoader::reclaim()
+{
+    const PartitionedImpulseResponse * pInUse = pCurrent.load();
+    const ScopedLock sl(hazardLock);
+    impulseResponses.erase(
+        std::remove_if(impulseResponses.begin(), impulseResponses.end(),
+            [this, pInUse](const std::unique_ptr<PartitionedImpulseResponse> & pIR) {
+                if (pIR.get() == pInUse) {
+                    return false;
+                }
+                for (auto pHazard : hazards) {
+                    if (pHazard->load() == pIR.get()) {
+                        return false;
+                    }
+                }
+                return true;
+            }),
+        impulseResponses.end());
+}
+
+/**
+ * Read the file property from the parameter state and queue a reload if it
+ * changed.
+ */
+void ImpulseResponseLoader::updateFromState()
+{
+    const String filePath = pParams->state.getProperty(filePropertyId, String()).toString();
+    const ScopedLock sl(requestLock);
+    if (filePath != requestedFilePath) {
+        requestedFilePath = filePath;
+        reloadPending = true;
+        notify();
+    }
+}
+
+void ImpulseResponseLoader::valueTreePropertyChanged(
+    juce::ValueTree & tree,
+    const juce::Identifier & property)
+{
+    if (property == filePropertyId) {
+        updateFromState();
+    }
+}
+
+void ImpulseResponseLoader::valueTreeRedirected(juce::ValueTree & tree)
+{
+    updateFromState();
+}
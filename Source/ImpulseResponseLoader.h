@@ -0,0 +1,157 @@
+/**
+ * Loads the impulse response for the convolution reverb on a background
+ * thread: decodes the file, resamples it to the processing rate, trims and
+ * normalises it, and partitions it into a PartitionedImpulseResponse.
+ *
+ * The file to use is kept in the synth parameter state (see
+ * config::impulseResponseFilePN), so it is saved and restored with the rest
+ * of the plugin state.  If it is empty or can't be read, a built-in room
+ * impulse response is generated instead.
+ *
+ * The finished impulse response is published through an atomic pointer.
+ * Processors read it with acquire() and a hazard pointer of their own, and an
+ * old impulse response is only deleted once no processor has it in a hazard
+ * pointer any more, so the audio thread never waits and never frees memory.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/MTLogger.h"
+#include "PartitionedImpulseResponse.h"
+
+class ImpulseResponseLoader:
+    private juce::Thread,
+    private juce::ValueTree::Listener
+{
+public:
+
+    using HazardPointer = std::atomic<const PartitionedImpulseResponse*>;
+
+    /**
+     * Told about each impulse response just before it's published, so it
+     * can allocate whatever it needs for it off the audio thread.
+     */
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+        virtual void impulseResponseReady(const PartitionedImpulseResponse & ir) = 0;
+    };
+
+    /** Constructor; starts the loader thread. */
+    ImpulseResponseLoader(
+        std::shared_ptr<juce_igutil::MTLogger> pMTL,
+        std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParameters
+    );
+
+    /** Destructor; stops the loader thread. */
+    virtual ~ImpulseResponseLoader() override;
+
+    /**
+     * Set the sample rate and partition size the impulse response is needed
+     * at.  Triggers a reload if either has changed.  Not realtime safe.
+     */
+    void prepare(const double sampleRate, const int partitionSize);
+
+    /**
+     * Get the current impulse response (or nullptr if none is loaded yet) and
+     * protect it from deletion with the given hazard pointer, which must have
+     * been added with addHazardPointer().  It stays protected until the hazard
+     * pointer is changed.  Realtime safe.
+     */
+    const PartitionedImpulseResponse * acquire(HazardPointer & hazard) const noexcept
+    {
+        const PartitionedImpulseResponse * pIR = pCurrent.load();
+        for (;;) {
+            hazard.store(pIR);
+            // make sure it wasn't retired before the hazard became visible
+            const PartitionedImpulseResponse * pCheck = pCurrent.load();
+            if (pCheck == pIR) {
+                return pIR;
+            }
+            pIR = pCheck;
+        }
+    }
+
+    /** Register/unregister a hazard pointer.  Not realtime safe. */
+    void addHazardPointer(HazardPointer * pHazard);
+    void removeHazardPointer(HazardPointer * pHazard);
+
+    /**
+     * Register/unregister a listener.  Adding one calls it straight away with
+     * the current impulse response, if there is one, so it can't miss one
+     * published in between.  Either can wait for a call to a listener to
+     * finish.  Not realtime safe.
+     */
+    void addListener(Listener * pListener);
+    void removeListener(Listener * pListener);
+
+private:
+
+    // Loader thread
+    void run() override;
+
+    // Build the partitioned impulse response.  Loader thread only.
+    std::unique_ptr<PartitionedImpulseResponse> build(
+        const juce::String & filePath,
+        const double sampleRate,
+        const int partitionSize);
+
+    // Read an IR file.  Returns false if it can't be read.
+    bool readFile(
+        const juce::File & file,
+        juce::AudioBuffer<float> & ir,
+        double & irSampleRate);
+
+    // Generate the built-in impulse response.
+    void createDefaultImpulseResponse(
+        juce::AudioBuffer<float> & ir,
+        const double sampleRate);
+
+    // Make the new impulse response current and retire the old one.
+    void publish(std::unique_ptr<PartitionedImpulseResponse> pIR);
+
+    // Delete retired impulse responses no processor is using any more.
+    void reclaim();
+
+    // Read the file property and queue a reload.
+    void updateFromState();
+
+    // ValueTree::Listener
+    void valueTreePropertyChanged(
+        juce::ValueTree & tree,
+        const juce::Identifier & property) override;
+    void valueTreeRedirected(juce::ValueTree & tree) override;
+
+    // How often retired impulse responses are checked for deletion.
+    static const int reclaimIntervalMs = 250;
+
+    std::shared_ptr<juce_igutil::MTLogger> pMTL;
+    std::shared_ptr<juce::AudioProcessorValueTreeState> pParams;
+    const juce::Identifier filePropertyId;
+
+    // What to load next; protected by requestLock.
+    juce::CriticalSection requestLock;
+    juce::String requestedFilePath;
+    double requestedSampleRate = 0.0;
+    int requestedPartitionSize = 0;
+    bool reloadPending = true;
+
+    // The published impulse response
+    std::atomic<const PartitionedImpulseResponse*> pCurrent { nullptr };
+
+    // Every impulse response that hasn't been deleted yet, including the
+    // current one.  Loader thread only.
+    std::vector<std::unique_ptr<PartitionedImpulseResponse>> impulseResponses;
+
+    // Processors' hazard pointers; protected by hazardLock.
+    juce::CriticalSection hazardLock;
+    std::vector<HazardPointer*> hazards;
+
+    // Listeners; protected by listenerLock, which is also held while
+    // publishing.
+    juce::CriticalSection listenerLock;
+    std::vector<Listener*> listeners;
+};
@@ -0,0 +1,430 @@
+/**
+ * A lookahead peak limiter for the synth's output.
+ *
+ * The signal is delayed by the lookahead, so the gain can be brought down
+ * before a peak arrives rather than after.  For each sample the gain needed
+ * to keep it under the ceiling is worked out, and then:
+ *
+ *   - the lowest of those over the lookahead window is held, so the gain is
+ *     already down when the peak comes out of the delay,
+ *   - it's released back towards 1 exponentially,
+ *   - and it's averaged over the lookahead, so it ramps down over the
+ *     lookahead instead of stepping.  The window the average covers is
+ *     inside the hold, so every gain averaged is low enough for the peak.
+ *
+ * With true peak detection on, the peaks between the samples are estimated
+ * too: the signal is interpolated at 4x with a windowed sinc, and the loudest
+ * of the interpolated points counts as the peak.  That's what a DAC's
+ * reconstruction filter would output, and can be well over the samples
+ * themselves.  The interpolator adds half its length to the latency.
+ *
+ * The detection and the gain are applied across whole blocks with
+ * FloatVectorOperations; only the gain envelope itself is worked out sample
+ * by sample.  A gain offered for the input (see setInputGain()) is applied in
+ * the copies into the detector and the delay line, rather than in a pass of
+ * its own, and the output is bounded by the ceiling, so whatever follows
+ * needn't clip it (see getOutputCeiling()).
+ *
+ * How often and how hard the limiter works is counted in atomics, so they can
+ * be read from another thread without the audio thread ever logging.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+
+class LimiterProcessor: public juce_igutil::Processor
+{
+public:
+
+    // What the limiter has done since the last resetDiagnostics()
+    struct Diagnostics
+    {
+        juce::int64 limitedSamples = 0;
+        float maxGainReductionDb = 0.0f;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param ceilingLevel peaks are kept under this level.
+     * @param lookaheadSecs how far ahead to look, and how long the gain takes
+     *                      to come down.
+     * @param releaseSecs time constant of the gain's recovery.
+     * @param detectTruePeaks whether to estimate the peaks between samples.
+     */
+    LimiterProcessor(
+        const float ceilingLevel,
+        const double lookaheadSecs,
+        const double releaseSecs,
+        const bool detectTruePeaks
+    ):
+        juce_igutil::Processor(),
+        ceiling(ceilingLevel),
+        lookaheadSeconds(lookaheadSecs),
+        releaseSeconds(releaseSecs),
+        truePeak(detectTruePeaks)
+    {
+        jassert(ceiling > 0.0f);
+        jassert(lookaheadSeconds > 0.0 && releaseSeconds > 0.0);
+        designInterpolator();
+    }
+
+    /** Destructor. */
+    virtual ~LimiterProcessor() = default;
+
+    /** Prepare to process audio.  */
+    void prepare(const juce::dsp::ProcessSpec& spec) override
+    {
+        const int numChannels = static_cast<int>(spec.numChannels);
+        const int maxBlock = static_cast<int>(spec.maximumBlockSize);
+
+        lookaheadSamples = juce::jmax(1, juce::roundToInt(spec.sampleRate * lookaheadSeconds));
+        delaySamples = lookaheadSamples + (truePeak ? interpolatorDelay : 0);
+        releaseCoef = static_cast<float>(1.0 - std::exp(-1.0 / (releaseSeconds * spec.sampleRate)));
+
+        history.setSize(numChannels, numTaps - 1 + maxBlock);
+        delayLine.setSize(numChannels, delaySamples + maxBlock);
+        peaks.resize(static_cast<size_t>(maxBlock));
+        scratch.resize(static_cast<size_t>(maxBlock));
+        gains.resize(static_cast<size_t>(maxBlock));
+        inputGains.resize(static_cast<size_t>(maxBlock));
+        // One more than the lookahead, so the points between a sample and the
+        // one before it are covered too.
+        holdGains.resize(static_cast<size_t>(lookaheadSamples + 2));
+        holdTimes.resize(static_cast<size_t>(lookaheadSamples + 2));
+        averageWindow.resize(static_cast<size_t>(lookaheadSamples));
+
+        reset();
+    }
+
+    /**
+     * Process audio.
+     */
+    void process(
+        juce::dsp::ProcessContextReplacing<float> & context
+    ) noexcept override
+    {
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        const int numChannels = juce::jmin(static_cast<int>(block.getNumChannels()), delayLine.getNumChannels());
+        jassert(numSamples <= static_cast<int>(gains.size()));
+
+        const float * pInputGains = takeInputGains(numSamples);
+        detectPeaks(block, numChannels, numSamples, pInputGains);
+        const bool limiting = calculateGains(numSamples);
+
+        // delay the signal and apply the gain
+        const int capacity = delayLine.getNumSamples();
+        const int readPosition = (writePosition + capacity - delaySamples) % capacity;
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pSamples = block.getChannelPointer(chan);
+            float * pDelay = delayLine.getWritePointer(chan);
+            copyIn(pDelay, capacity, writePosition, pSamples, pInputGains, numSamples);
+            copyOut(pSamples, pDelay, capacity, readPosition, numSamples);
+            if (limiting) {
+                juce::FloatVectorOperations::multiply(pSamples, gains.data(), numSamples);
+            }
+        }
+        writePosition = (writePosition + numSamples) % capacity;
+    }
+
+    /**
+     * Reset the internal state of the processor.
+     */
+    void reset() override
+    {
+        history.clear();
+        delayLine.clear();
+        writePosition = 0;
+
+        holdStart = 0;
+        holdCount = 0;
+        sampleTime = 0;
+        envelope = 1.0f;
+        std::fill(averageWindow.begin(), averageWindow.end(), 1.0f);
+        averagePosition = 0;
+        averageSum = static_cast<double>(averageWindow.size());
+    }
+
+    /** Applied as the input is copied into the detector and the delay. */
+    bool setInputGain(const float startGain, const float endGain) noexcept override
+    {
+        inputStartGain = startGain;
+        inputEndGain = endGain;
+        return true;
+    }
+
+    /** Peaks are kept under the ceiling. */
+    float getOutputCeiling() const noexcept override
+    {
+        return ceiling;
+    }
+
+    /** The lookahead, plus the interpolator's delay for true peaks. */
+    int getLatencySamples() const noexcept override
+    {
+        return delaySamples;
+    }
+
+    /** Whatever is still in the delay. */
+    int getTailSamples() const noexcept override
+    {
+        return delaySamples;
+    }
+
+    /** The history, the delay and the gain computer's buffers. */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        memory.add(history);
+        memory.add(delayLine);
+        memory.add(peaks);
+        memory.add(scratch);
+        memory.add(gains);
+        memory.add(inputGains);
+        memory.add(holdGains);
+        memory.add(holdTimes);
+        memory.add(averageWindow);
+    }
+
+    /**
+     * What the limiter has done.  Any thread.
+     */
+    Diagnostics getDiagnostics() const noexcept
+    {
+        Diagnostics result;
+        result.limitedSamples = limitedSamples.load(std::memory_order_relaxed);
+        const float gain = minimumGain.load(std::memory_order_relaxed);
+        result.maxGainReductionDb = -juce::Decibels::gainToDecibels(gain);
+        return result;
+    }
+
+    /** Start counting again.  Any thread. */
+    void resetDiagnostics() noexcept
+    {
+        limitedSamples.store(0, std::memory_order_relaxed);
+        minimumGain.store(1.0f, std::memory_order_relaxed);
+    }
+
+private:
+
+    // Interpolator: 4x, with this many taps per phase.  The interpolated
+    // points lie between the samples half the taps back.
+    static const int truePeakFactor = 4;
+    static const int numTaps = 16;
+    static const int interpolatorDelay = numTaps / 2;
+
+    // Windowed sinc taps for the points a quarter, a half and three quarters
+    // of the way between samples, each normalised to a gain of 1 at DC.
+    void designInterpolator()
+    {
+        const double halfWidth = numTaps / 2 + 1;
+        for (int phase = 1; phase < truePeakFactor; ++phase) {
+            double sum = 0.0;
+            for (int tap = 0; tap < numTaps; ++tap) {
+                // distance of the sample from the interpolated point
+                const double t = tap - interpolatorDelay + static_cast<double>(phase) / truePeakFactor;
+                const double sinc = std::sin(juce::MathConstants<double>::pi * t) / (juce::MathConstants<double>::pi * t);
+                const double window = 0.5 + 0.5 * std::cos(juce::MathConstants<double>::pi * t / halfWidth);
+                interpolator[phase - 1][tap] = static_cast<float>(sinc * window);
+                sum += sinc * window;
+            }
+            for (int tap = 0; tap < numTaps; ++tap) {
+                interpolator[phase - 1][tap] = static_cast<float>(interpolator[phase - 1][tap] / sum);
+            }
+        }
+    }
+
+    // The input gain ramp for this block, one gain per sample, or null if
+    // there isn't one.  It's only for this block.
+    const float * takeInputGains(const int numSamples) noexcept
+    {
+        if (inputStartGain == 1.0f && inputEndGain == 1.0f) {
+            return nullptr;
+        }
+        const float step = (inputEndGain - inputStartGain) / static_cast<float>(numSamples);
+        float gain = inputStartGain;
+        for (int ix = 0; ix < numSamples; ++ix) {
+            inputGains[ix] = gain;
+            gain += step;
+        }
+        inputStartGain = 1.0f;
+        inputEndGain = 1.0f;
+        return inputGains.data();
+    }
+
+    // Fill peaks with the loudest channel at each sample (and between
+    // samples, for true peaks), with the input gains applied if there are any.
+    void detectPeaks(
+        juce::dsp::AudioBlock<float> & block,
+        const int numChannels,
+        const int numSamples,
+        const float * pInputGains
+    ) noexcept
+    {
+        float * pPeaks = peaks.data();
+        float * pScratch = scratch.data();
+        juce::FloatVectorOperations::clear(pPeaks, numSamples);
+
+        for (int chan = 0; chan < numChannels; ++chan) {
+            const float * pIn = block.getChannelPointer(chan);
+            if (!truePeak) {
+                if (pInputGains != nullptr) {
+                    juce::FloatVectorOperations::multiply(pScratch, pIn, pInputGains, numSamples);
+                    pIn = pScratch;
+                }
+                juce::FloatVectorOperations::abs(pScratch, pIn, numSamples);
+                juce::FloatVectorOperations::max(pPeaks, pPeaks, pScratch, numSamples);
+                continue;
+            }
+
+            // The channel's last numTaps - 1 samples, then this block.
+            float * pHistory = history.getWritePointer(chan);
+            if (pInputGains != nullptr) {
+                juce::FloatVectorOperations::multiply(pHistory + numTaps - 1, pIn, pInputGains, numSamples);
+            }
+            else {
+                juce::FloatVectorOperations::copy(pHistory + numTaps - 1, pIn, numSamples);
+            }
+            const float * pNewest = pHistory + numTaps - 1;
+
+            // the samples themselves, interpolatorDelay back
+            juce::FloatVectorOperations::abs(pScratch, pNewest - interpolatorDelay, numSamples);
+            juce::FloatVectorOperations::max(pPeaks, pPeaks, pScratch, numSamples);
+
+            // and the points after them
+            for (int phase = 0; phase < truePeakFactor - 1; ++phase) {
+                const float * pTaps = interpolator[phase];
+                juce::FloatVectorOperations::copyWithMultiply(pScratch, pNewest, pTaps[0], numSamples);
+                for (int tap = 1; tap < numTaps; ++tap) {
+                    juce::FloatVectorOperations::addWithMultiply(pScratch, pNewest - tap, pTaps[tap], numSamples);
+                }
+                juce::FloatVectorOperations::abs(pScratch, pScratch, numSamples);
+                juce::FloatVectorOperations::max(pPeaks, pPeaks, pScratch, numSamples);
+            }
+
+            std::memmove(pHistory, pHistory + numSamples, (numTaps - 1) * sizeof(float));
+        }
+    }
+
+    // Work out the gain for each sample of the block from the peaks.  Returns
+    // false if it's 1 throughout.
+    bool calculateGains(const int numSamples) noexcept
+    {
+        const int holdLength = static_cast<int>(holdGains.size());
+        const int averageLength = static_cast<int>(averageWindow.size());
+        float lowest = 1.0f;
+        int limited = 0;
+
+        for (int ix = 0; ix < numSamples; ++ix) {
+            const float peak = peaks[ix];
+            const float needed = peak > ceiling ? ceiling / peak : 1.0f;
+
+            // Hold the lowest gain needed over the window: a queue of
+            // increasing gains, each lower than everything before it that's
+            // still in the window.  The one leaving the window goes first, so
+            // the queue never holds more than the window's holdLength gains
+            // (while the needed gain keeps rising, every one is kept).
+            if (holdCount > 0 && sampleTime - holdTimes[holdStart] >= static_cast<juce::uint32>(holdLength)) {
+                holdStart = (holdStart + 1) % holdLength;
+                --holdCount;
+            }
+            while (holdCount > 0 && holdGains[(holdStart + holdCount - 1) % holdLength] >= needed) {
+                --holdCount;
+            }
+            jassert(holdCount < holdLength);
+            holdGains[(holdStart + holdCount) % holdLength] = needed;
+            holdTimes[(holdStart + holdCount) % holdLength] = sampleTime;
+            ++holdCount;
+            ++sampleTime;
+            const float held = holdGains[holdStart];
+
+            // down at once, back up gradually
+            envelope = held < envelope ? held : envelope + (held - envelope) * releaseCoef;
+
+            // ramp down over the lookahead
+            averageSum += envelope - averageWindow[averagePosition];
+            averageWindow[averagePosition] = envelope;
+            averagePosition = (averagePosition + 1) % averageLength;
+            const float gain = juce::jmin(1.0f, static_cast<float>(averageSum / averageLength));
+
+            gains[ix] = gain;
+            lowest = juce::jmin(lowest, gain);
+            limited += gain < 1.0f ? 1 : 0;
+        }
+
+        if (limited > 0) {
+            limitedSamples.fetch_add(limited, std::memory_order_relaxed);
+            if (lowest < minimumGain.load(std::memory_order_relaxed)) {
+                minimumGain.store(lowest, std::memory_order_relaxed);
+            }
+        }
+        return limited > 0;
+    }
+
+    // Ring buffer copies, in up to two parts.  The copy in applies the input
+    // gains, if there are any.
+    static void copyIn(float * pRing, const int capacity, const int position, const float * pSrc, const float * pGains, const int numSamples) noexcept
+    {
+        const int first = juce::jmin(numSamples, capacity - position);
+        if (pGains != nullptr) {
+            juce::FloatVectorOperations::multiply(pRing + position, pSrc, pGains, first);
+            juce::FloatVectorOperations::multiply(pRing, pSrc + first, pGains + first, numSamples - first);
+            return;
+        }
+        juce::FloatVectorOperations::copy(pRing + position, pSrc, first);
+        juce::FloatVectorOperations::copy(pRing, pSrc + first, numSamples - first);
+    }
+
+    static void copyOut(float * pDest, const float * pRing, const int capacity, const int position, const int numSamples) noexcept
+    {
+        const int first = juce::jmin(numSamples, capacity - position);
+        juce::FloatVectorOperations::copy(pDest, pRing + position, first);
+        juce::FloatVectorOperations::copy(pDest + first, pRing, numSamples - first);
+    }
+
+    // Settings
+    const float ceiling;
+    const double lookaheadSeconds;
+    const double releaseSeconds;
+    const bool truePeak;
+
+    float interpolator[truePeakFactor - 1][numTaps] = {};
+
+    // Set in prepare()
+    int lookaheadSamples = 1;
+    int delaySamples = 1;
+    float releaseCoef = 1.0f;
+
+    // Detection
+    juce::AudioBuffer<float> history;
+    std::vector<float> peaks;
+    std::vector<float> scratch;
+
+    // Gain envelope: the hold queue, the release and the average
+    std::vector<float> holdGains;
+    std::vector<juce::uint32> holdTimes;
+    int holdStart = 0;
+    int holdCount = 0;
+    juce::uint32 sampleTime = 0;
+    float envelope = 1.0f;
+    std::vector<float> averageWindow;
+    int averagePosition = 0;
+    double averageSum = 0.0;
+    std::vector<float> gains;
+
+    // The input gain ramp, set by setInputGain() for the next block
+    float inputStartGain = 1.0f;
+    float inputEndGain = 1.0f;
+    std::vector<float> inputGains;
+
+    // The delayed signal
+    juce::AudioBuffer<float> delayLine;
+    int writePosition = 0;
+
+    // Diagnostics
+    std::atomic<juce::int64> limitedSamples { 0 };
+    std::atomic<float> minimumGain { 1.0f };
+};
@@ -0,0 +1,426 @@
+/**
+ * Runs another processor at a lower sample rate: the audio is decimated by 2,
+ * 4 or 8 with half band filters on the way in and interpolated back up on the
+ * way out.  At 96k or 192k, effects like the reverb, chorus and delay do the
+ * same job at 48k for a half or a quarter of the CPU and memory, since
+ * nothing they'd add above 20k would be heard anyway.
+ *
+ * The factor is worked out in prepare(): the largest power of two that keeps
+ * the inner processor at or above config::multirateFxMinSampleRate.  The inner
+ * processor is prepared with the reduced rate and block size, so it sizes its
+ * buffers for that.  At 44.1k and 48k, the processor is just called directly.
+ *
+ * The half band filters are polyphase IIR allpass pairs (see
+ * juce::dsp::Oversampling), one per factor of 2, so the whole signal
+ * (including whatever dry signal the effect mixes in) is band limited to a
+ * little over 20k and delayed by their latency, which is reported.
+ *
+ * Blocks don't have to be a multiple of the factor.  Input samples that don't
+ * make up a whole reduced rate sample yet are held over to the next block,
+ * and the output comes from a small FIFO that starts with factor - 1 samples
+ * of silence.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "Config.h"
+#include "juce_igutil/Processor.h"
+
+class MultirateProcessor: public juce_igutil::Processor
+{
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param pProcessorToRun the processor to run at the reduced rate.
+     */
+    explicit MultirateProcessor(std::shared_ptr<juce_igutil::Processor> pProcessorToRun):
+        juce_igutil::Processor(),
+        pInner(pProcessorToRun)
+    {
+        jassert(pInner);
+    }
+
+    /** Destructor. */
+    virtual ~MultirateProcessor() override = default;
+
+    /**
+     * Prepare to process audio.  Works out the factor, designs the filters and
+     * prepares the inner processor at the reduced rate.
+     */
+    void prepare(const juce::dsp::ProcessSpec & spec) override
+    {
+        const int maxBlock = static_cast<int>(spec.maximumBlockSize);
+        const int numChannels = static_cast<int>(spec.numChannels);
+
+        numStages = 0;
+        while (numStages < maxStages
+            && spec.sampleRate / (2 << numStages) >= config::multirateFxMinSampleRate) {
+            ++numStages;
+        }
+        factor = 1 << numStages;
+
+        // Every stage but the last only has to keep what the next one will
+        // filter out from aliasing, so it can have a much wider transition.
+        filterLatency = 0.0;
+        for (int ix = 0; ix < numStages; ++ix) {
+            const bool isLast = (ix == numStages - 1);
+            HalfBand & stage = stages[ix];
+            stage.design(
+                isLast ? config::multirateTransitionWidth : earlyStageTransitionWidth,
+                config::multirateStopbandDb);
+            stage.prepare(numChannels);
+            stage.buffer.setSize(numChannels, maxSamplesAtStage(maxBlock, ix + 1));
+
+            // delayed on the way down and again on the way up, in samples at
+            // this stage's input rate
+            filterLatency += 2.0 * stage.groupDelay * (1 << ix);
+        }
+
+        pInner->prepare(juce::dsp::ProcessSpec{
+            spec.sampleRate / factor,
+            static_cast<juce::uint32>(numStages > 0 ? maxBlock / factor + 1 : maxBlock),
+            spec.numChannels
+        });
+
+        upsampled.setSize(numChannels, maxSamplesAtStage(maxBlock, 0));
+        fifo.setSize(numChannels, maxBlock + factor);
+        resetFifo();
+    }
+
+    /** Process audio. */
+    void process(juce::dsp::ProcessContextReplacing<float> & context) noexcept override
+    {
+        if (numStages == 0) {
+            pInner->process(context);
+            return;
+        }
+
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        const int numChannels = juce::jmin(static_cast<int>(block.getNumChannels()), fifo.getNumChannels());
+        jassert(numSamples + factor - 1 <= fifo.getNumSamples());
+
+        // down to the reduced rate
+        int count = numSamples;
+        for (int ix = 0; ix < numStages; ++ix) {
+            HalfBand & stage = stages[ix];
+            for (int chan = 0; chan < numChannels; ++chan) {
+                const float * pIn = (ix == 0) ?
+                    block.getChannelPointer(chan) :
+                    stages[ix - 1].buffer.getReadPointer(chan);
+                stage.decimate(chan, pIn, count, stage.buffer.getWritePointer(chan));
+            }
+            count = stage.finishDecimating(count);
+        }
+
+        if (count > 0) {
+            HalfBand & last = stages[numStages - 1];
+            juce::dsp::AudioBlock<float> innerBlock(
+                last.buffer.getArrayOfWritePointers(),
+                static_cast<size_t>(numChannels),
+                static_cast<size_t>(count));
+            juce::dsp::ProcessContextReplacing<float> innerContext(innerBlock);
+            pInner->process(innerContext);
+
+            // and back up, each stage into the buffer of the one before it,
+            // and the last into the FIFO.
+            for (int ix = numStages - 1; ix >= 0; --ix) {
+                HalfBand & stage = stages[ix];
+                for (int chan = 0; chan < numChannels; ++chan) {
+                    float * pOut = (ix == 0) ?
+                        upsampled.getWritePointer(chan) :
+                        stages[ix - 1].buffer.getWritePointer(chan);
+                    stage.interpolate(chan, stage.buffer.getReadPointer(chan), count, pOut);
+                }
+                count *= 2;
+                if (ix == 0) {
+                    writeFifo(numChannels, count);
+                }
+            }
+        }
+
+        readFifo(block, numChannels, numSamples);
+    }
+
+    /** Reset the filters, the FIFO and the inner processor. */
+    void reset() override
+    {
+        for (int ix = 0; ix < numStages; ++ix) {
+            stages[ix].reset();
+        }
+        resetFifo();
+        pInner->reset();
+    }
+
+    /**
+     * The filters' latency, the samples held in the FIFO and the inner
+     * processor's latency at the host rate.
+     */
+    int getLatencySamples() const noexcept override
+    {
+        if (numStages == 0) {
+            return pInner->getLatencySamples();
+        }
+        return juce::roundToInt(filterLatency) + factor - 1
+            + pInner->getLatencySamples() * factor;
+    }
+
+    /** The inner processor's tail at the host rate, plus the filters'. */
+    int getTailSamples() const noexcept override
+    {
+        const int innerTail = pInner->getTailSamples();
+        if (numStages == 0 || innerTail == infiniteTail) {
+            return innerTail;
+        }
+        const int extra = getLatencySamples() + filterRingSamples * factor;
+        return innerTail >= (infiniteTail - extra) / factor ? infiniteTail : innerTail * factor + extra;
+    }
+
+    /** Passed on to the inner processor. */
+    void setInputSilent(const bool isSilent) noexcept override
+    {
+        pInner->setInputSilent(isSilent);
+    }
+
+    /**
+     * A plain gain if the inner processor is, but only at the host rate.
+     * Once there are filters, skipping them would take their latency out of
+     * the output but not out of what's reported.
+     */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        return numStages == 0 && pInner->getPureGain(gain);
+    }
+
+    /** Activate/deactivate the inner processor. */
+    void setActive(const bool isActive) noexcept override
+    {
+        pInner->setActive(isActive);
+    }
+
+    /** Pass realtime/offline rendering on to the inner processor. */
+    void setNonRealtime(const bool isNonRealtime) noexcept override
+    {
+        pInner->setNonRealtime(isNonRealtime);
+    }
+
+    /** The stages' buffers, the FIFO and the inner processor's buffers. */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        for (int ix = 0; ix < numStages; ++ix) {
+            memory.add(stages[ix].buffer);
+        }
+        memory.add(upsampled);
+        memory.add(fifo);
+        pInner->prefault(memory);
+    }
+
+    void handlePendingUpdates() override
+    {
+        pInner->handlePendingUpdates();
+    }
+
+private:
+
+    // up to 8x
+    static const int maxStages = 3;
+
+    // Normalised transition width of all but the last stage.
+    static constexpr float earlyStageTransitionWidth = 0.2f;
+
+    // Rough length of the filters' impulse response, in reduced rate samples,
+    // for the tail.
+    static const int filterRingSamples = 64;
+
+    /**
+     * One half band stage: a polyphase pair of first order allpass cascades,
+     * run as a decimator on the way down and an interpolator on the way up.
+     */
+    struct HalfBand
+    {
+        // Design the filter and work out its group delay at DC (in samples
+        // at the higher rate).
+        void design(const float transitionWidth, const float stopbandDb)
+        {
+            auto structure = juce::dsp::FilterDesign<float>::designIIRLowpassHalfBandPolyphaseAllpassMethod(
+                transitionWidth, stopbandDb);
+
+            // The delayed path starts with the delay itself.
+            coefficients.clear();
+            directPathOrder = structure.directPath.size();
+            double directDelay = 0.0;
+            for (int ix = 0; ix < structure.directPath.size(); ++ix) {
+                coefficients.push_back(structure.directPath.getObjectPointer(ix)->coefficients[0]);
+                directDelay += allpassDelay(coefficients.back());
+            }
+            double delayedDelay = 1.0;
+            for (int ix = 1; ix < structure.delayedPath.size(); ++ix) {
+                coefficients.push_back(structure.delayedPath.getObjectPointer(ix)->coefficients[0]);
+                delayedDelay += allpassDelay(coefficients.back());
+            }
+            groupDelay = 0.5 * (directDelay + delayedDelay);
+        }
+
+        // Allocate the filter states
+        void prepare(const int numChannels)
+        {
+            const size_t numStates = coefficients.size() * static_cast<size_t>(numChannels);
+            downStates.assign(numStates, 0.0f);
+            upStates.assign(numStates, 0.0f);
+            delayedOutputs.assign(static_cast<size_t>(numChannels), 0.0f);
+            heldInputs.assign(static_cast<size_t>(numChannels), 0.0f);
+            hasHeldInput = false;
+        }
+
+        void reset()
+        {
+            std::fill(downStates.begin(), downStates.end(), 0.0f);
+            std::fill(upStates.begin(), upStates.end(), 0.0f);
+            std::fill(delayedOutputs.begin(), delayedOutputs.end(), 0.0f);
+            std::fill(heldInputs.begin(), heldInputs.end(), 0.0f);
+            hasHeldInput = false;
+        }
+
+        // Decimate a channel: a sample out for every pair in, starting with
+        // the one held over from the last block, if any.  Every channel gets
+        // the same count; then finishDecimating() is called once.
+        void decimate(const int chan, const float * pIn, const int numIn, float * pOut) noexcept
+        {
+            const int numCoeffs = static_cast<int>(coefficients.size());
+            float * pState = downStates.data() + chan * numCoeffs;
+            float delayed = delayedOutputs[chan];
+            float even = heldInputs[chan];
+            bool haveEven = hasHeldInput;
+            int numOut = 0;
+            for (int ix = 0; ix < numIn; ++ix) {
+                if (!haveEven) {
+                    even = pIn[ix];
+                    haveEven = true;
+                    continue;
+                }
+                const float directOut = runPath(even, pState, 0, directPathOrder);
+                const float delayedOut = runPath(pIn[ix], pState, directPathOrder, numCoeffs);
+                pOut[numOut++] = 0.5f * (directOut + delayed);
+                delayed = delayedOut;
+                haveEven = false;
+            }
+            delayedOutputs[chan] = delayed;
+            heldInputs[chan] = even;
+        }
+
+        // Update the held sample after decimate() and return the number of
+        // samples out.
+        int finishDecimating(const int numIn) noexcept
+        {
+            const int total = numIn + (hasHeldInput ? 1 : 0);
+            hasHeldInput = (total % 2) != 0;
+            return total / 2;
+        }
+
+        // Interpolate a channel: two samples out for every one in.
+        void interpolate(const int chan, const float * pIn, const int numIn, float * pOut) noexcept
+        {
+            const int numCoeffs = static_cast<int>(coefficients.size());
+            float * pState = upStates.data() + chan * numCoeffs;
+            for (int ix = 0; ix < numIn; ++ix) {
+                pOut[2 * ix] = runPath(pIn[ix], pState, 0, directPathOrder);
+                pOut[2 * ix + 1] = runPath(pIn[ix], pState, directPathOrder, numCoeffs);
+            }
+        }
+
+        // A cascade of first order allpasses (in z^-2 at the higher rate).
+        float runPath(float sample, float * pState, const int first, const int last) const noexcept
+        {
+            for (int ix = first; ix < last; ++ix) {
+                const float alpha = coefficients[ix];
+                const float output = alpha * sample + pState[ix];
+                pState[ix] = sample - alpha * output;
+                sample = output;
+            }
+            return sample;
+        }
+
+        // DC group delay of one of the allpasses, at the higher rate.
+        static double allpassDelay(const float alpha) noexcept
+        {
+            return 2.0 * (1.0 - alpha) / (1.0 + alpha);
+        }
+
+        std::vector<float> coefficients;
+        int directPathOrder = 0;
+        double groupDelay = 0.0;
+
+        // per channel states
+        std::vector<float> downStates;
+        std::vector<float> upStates;
+        std::vector<float> delayedOutputs;
+        std::vector<float> heldInputs;
+        bool hasHeldInput = false;
+
+        // this stage's reduced rate samples
+        juce::AudioBuffer<float> buffer;
+    };
+
+    // Most samples a block can hold at the rate after a number of stages, on
+    // the way down (held samples carry over) or back up (twice the next).
+    static int maxSamplesAtStage(const int maxBlock, const int stage) noexcept
+    {
+        return (maxBlock >> stage) + 2;
+    }
+
+    void resetFifo()
+    {
+        fifo.clear();
+        readPosition = 0;
+        fifoSamples = factor - 1;
+    }
+
+    // Add the interpolated samples to the FIFO.
+    void writeFifo(const int numChannels, const int numSamples) noexcept
+    {
+        const int capacity = fifo.getNumSamples();
+        const int writePosition = (readPosition + fifoSamples) % capacity;
+        const int first = juce::jmin(numSamples, capacity - writePosition);
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pFifo = fifo.getWritePointer(chan);
+            const float * pIn = upsampled.getReadPointer(chan);
+            juce::FloatVectorOperations::copy(pFifo + writePosition, pIn, first);
+            juce::FloatVectorOperations::copy(pFifo, pIn + first, numSamples - first);
+        }
+        fifoSamples += numSamples;
+        jassert(fifoSamples <= capacity);
+    }
+
+    // Output the oldest samples from the FIFO.
+    void readFifo(juce::dsp::AudioBlock<float> & block, const int numChannels, const int numSamples) noexcept
+    {
+        jassert(fifoSamples >= numSamples);
+        const int capacity = fifo.getNumSamples();
+        const int first = juce::jmin(numSamples, capacity - readPosition);
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pOut = block.getChannelPointer(chan);
+            const float * pFifo = fifo.getReadPointer(chan);
+            juce::FloatVectorOperations::copy(pOut, pFifo + readPosition, first);
+            juce::FloatVectorOperations::copy(pOut + first, pFifo, numSamples - first);
+        }
+        readPosition = (readPosition + numSamples) % capacity;
+        fifoSamples -= numSamples;
+    }
+
+    std::shared_ptr<juce_igutil::Processor> pInner;
+
+    HalfBand stages[maxStages];
+    int numStages = 0;
+    int factor = 1;
+    double filterLatency = 0.0;
+
+    // Output at the host rate, waiting to go out
+    juce::AudioBuffer<float> upsampled;
+    juce::AudioBuffer<float> fifo;
+    int readPosition = 0;
+    int fifoSamples = 0;
+};
@@ -0,0 +1,223 @@
+/**
+ * Runs another processor at a multiple of the sample rate using
+ * juce::dsp::Oversampling, so that nonlinear processors like the distortion
+ * don't fold their harmonics back down as aliasing.
+ *
+ * The oversampling factor (1x, 2x, 4x or 8x) and the half band filters
+ * (polyphase IIR or linear phase FIR) are set separately for realtime and
+ * offline rendering, since the offline settings are usually far too expensive
+ * to run live in every FX slot.
+ *
+ * Both are built in prepare(), each with its own copy of the processor
+ * (prepared for its own rate), so switching between them is just a matter of
+ * which one runs.  The switch comes on the audio thread (see
+ * Processor::setNonRealtime()), often at the start of an offline render, and
+ * nothing has to be allocated for it; the one switched to is reset first,
+ * since its state is stale.  The signal is never passed through dry.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+
+class OversamplingProcessor:
+    public juce_igutil::Processor
+{
+public:
+
+    /** Oversampling settings */
+    struct Settings
+    {
+        int order;      // log2 of the factor: 0 to 3
+        bool useFir;    // FIR equiripple rather than polyphase IIR filters
+
+        bool operator==(const Settings & other) const noexcept
+        {
+            return order == other.order && useFir == other.useFir;
+        }
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param pLiveProcessor the processor to run at the higher rate live.
+     * @param pOfflineProcessor another one, set up the same way, for offline
+     *                          rendering.
+     * @param liveSettings settings for realtime rendering.
+     * @param offlineSettings settings for offline rendering.
+     */
+    OversamplingProcessor(
+        std::shared_ptr<juce_igutil::Processor> pLiveProcessor,
+        std::shared_ptr<juce_igutil::Processor> pOfflineProcessor,
+        const Settings liveSettings,
+        const Settings offlineSettings
+    ):
+        juce_igutil::Processor()
+    {
+        jassert(pLiveProcessor && pOfflineProcessor);
+        jassert(pLiveProcessor != pOfflineProcessor);
+        jassert(liveSettings.order >= 0 && liveSettings.order <= maxOrder);
+        jassert(offlineSettings.order >= 0 && offlineSettings.order <= maxOrder);
+        chains[liveIndex].pInner = pLiveProcessor;
+        chains[liveIndex].settings = liveSettings;
+        chains[offlineIndex].pInner = pOfflineProcessor;
+        chains[offlineIndex].settings = offlineSettings;
+    }
+
+    /** Build the oversampling for both the live and offline settings. */
+    void prepare(const juce::dsp::ProcessSpec & spec) override
+    {
+        for (auto & chain : chains) {
+            build(chain, spec);
+        }
+    }
+
+    /** Process audio. */
+    void process(juce::dsp::ProcessContextReplacing<float> & context) noexcept override
+    {
+        Chain & chain = getChain();
+        jassert(chain.pOversampling);
+
+        auto oversampledBlock = chain.pOversampling->processSamplesUp(context.getInputBlock());
+        juce::dsp::ProcessContextReplacing<float> oversampledContext(oversampledBlock);
+        chain.pInner->process(oversampledContext);
+        chain.pOversampling->processSamplesDown(context.getOutputBlock());
+    }
+
+    /** Reset the state. */
+    void reset() override
+    {
+        for (auto & chain : chains) {
+            resetChain(chain);
+        }
+    }
+
+    /** Latency of the filters plus the oversampled processor's. */
+    int getLatencySamples() const noexcept override
+    {
+        return getChain().latencySamples;
+    }
+
+    /**
+     * The oversampled processor's tail at the normal rate, plus the filters'
+     * latency on the way up and down.
+     */
+    int getTailSamples() const noexcept override
+    {
+        const Chain & chain = getChain();
+        const int innerTail = chain.pInner->getTailSamples();
+        if (innerTail == infiniteTail) {
+            return infiniteTail;
+        }
+        return innerTail / chain.factor + 2 * chain.latencySamples + 1;
+    }
+
+    /** Activate/deactivate both processors. */
+    void setActive(const bool isActive) noexcept override
+    {
+        for (auto & chain : chains) {
+            chain.pInner->setActive(isActive);
+        }
+    }
+
+    /** Switch between the live and offline settings. */
+    void setNonRealtime(const bool isNonRealtime) noexcept override
+    {
+        const int index = isNonRealtime ? offlineIndex : liveIndex;
+        if (index == selected.load(std::memory_order_relaxed)) {
+            return;
+        }
+        resetChain(chains[index]);
+        selected.store(index, std::memory_order_relaxed);
+    }
+
+    /** Passed on to both processors. */
+    void handlePendingUpdates() override
+    {
+        for (auto & chain : chains) {
+            chain.pInner->handlePendingUpdates();
+        }
+    }
+
+    /**
+     * Both processors' buffers.  The oversampling's own buffers are inside
+     * juce::dsp::Oversampling, out of reach; they're touched by the warm-up
+     * render.
+     */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        for (auto & chain : chains) {
+            chain.pInner->prefault(memory);
+        }
+    }
+
+private:
+
+    static const int maxOrder = 3;
+    static const int liveIndex = 0;
+    static const int offlineIndex = 1;
+
+    // The oversampling for one of the settings, and the processor it runs
+    struct Chain
+    {
+        std::shared_ptr<juce_igutil::Processor> pInner;
+        Settings settings { 0, false };
+        std::unique_ptr<juce::dsp::Oversampling<float>> pOversampling;
+        int factor = 1;
+        int latencySamples = 0;
+    };
+
+    Chain & getChain() noexcept
+    {
+        return chains[selected.load(std::memory_order_relaxed)];
+    }
+
+    const Chain & getChain() const noexcept
+    {
+        return chains[selected.load(std::memory_order_relaxed)];
+    }
+
+    static void resetChain(Chain & chain) noexcept
+    {
+        if (chain.pOversampling) {
+            chain.pOversampling->reset();
+        }
+        chain.pInner->reset();
+    }
+
+    // Allocate the oversampling and prepare the processor for it.
+    static void build(Chain & chain, const juce::dsp::ProcessSpec & spec)
+    {
+        using Oversampling = juce::dsp::Oversampling<float>;
+
+        chain.pOversampling = std::make_unique<Oversampling>(
+            spec.numChannels,
+            static_cast<size_t>(chain.settings.order),
+            chain.settings.useFir ?
+                Oversampling::filterHalfBandFIREquiripple :
+                Oversampling::filterHalfBandPolyphaseIIR,
+            true);
+        chain.pOversampling->initProcessing(spec.maximumBlockSize);
+
+        const auto factor = static_cast<juce::uint32>(chain.pOversampling->getOversamplingFactor());
+        chain.pInner->prepare(juce::dsp::ProcessSpec{
+            spec.sampleRate * factor,
+            spec.maximumBlockSize * factor,
+            spec.numChannels
+        });
+        chain.pInner->reset();
+
+        chain.factor = static_cast<int>(factor);
+        chain.latencySamples = juce::roundToInt(chain.pOversampling->getLatencyInSamples())
+            + chain.pInner->getLatencySamples() / chain.factor;
+    }
+
+    // Live and offline
+    Chain chains[2];
+
+    // The one in use.  Set on the audio thread; read by the latency and
+    // tail queries from wherever they come.
+    std::atomic<int> selected { liveIndex };
+};
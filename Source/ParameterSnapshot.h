@@ -0,0 +1,283 @@
+/**
+ * ParameterSnapshot - the synth's parameters, read once at the start of each
+ * block.
+ *
+ * The parameters live in the AudioProcessorValueTreeState as atomics.  Rather
+ * than every voice and effect slot loading them (and recalculating from them)
+ * every block, update() copies them all into one cache line along with a
+ * bitmask of the ones that changed since the last update().  Consumers read
+ * the copy and only recalculate when their bits are set.
+ *
+ * Changes are posted by parameter listeners, on whatever thread makes them
+ * (host automation, the UI, a state restore), by or-ing the parameter's bit
+ * into an atomic mask.  That's lock free for any number of threads, and
+ * update() only loads the parameters whose bits it takes from the mask.
+ *
+ * The wave index is ramped to its new value over
+ * config::parameterSmoothingSeconds, since the oscillators morph between
+ * waves with it and a step is audible.  The ramp's per-sample values are only
+ * worked out if a voice asks for them, once per block, and only while it's
+ * moving.  (The filter and the effect levels are smoothed sample by sample by
+ * the filter and effects themselves.)
+ *
+ * The bits only cover one update, so anything that doesn't look at every
+ * block (e.g. a voice that isn't playing) has to apply the values in full
+ * when it starts again.  Until the first update() the values are those at
+ * construction and every bit is set.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "Config.h"
+
+class ParameterSnapshot
+{
+public:
+
+    // Change bits
+    static const int waveIndexBit = 0;
+    static const int cutoffBit = 1;
+    static const int resonanceBit = 2;
+    static const int firstFxTypeBit = 3;
+    static const int firstFxLevelBit = firstFxTypeBit + config::maxEffects;
+    static const int numParameters = firstFxLevelBit + config::maxEffects;
+    static const juce::uint32 waveIndexChanged = 1u << waveIndexBit;
+    static const juce::uint32 cutoffChanged = 1u << cutoffBit;
+    static const juce::uint32 resonanceChanged = 1u << resonanceBit;
+    static juce::uint32 fxTypeChanged(const int slot) noexcept { return 1u << (firstFxTypeBit + slot); }
+    static juce::uint32 fxLevelChanged(const int slot) noexcept { return 1u << (firstFxLevelBit + slot); }
+    static const juce::uint32 anyFxTypeChanged = ((1u << config::maxEffects) - 1) << firstFxTypeBit;
+
+    // The values, as of the last update().  One cache line.
+    struct alignas(64) Values
+    {
+        float waveIndex = 0.0f;
+        float cutoff = 0.0f;
+        float resonance = 0.0f;
+        float fxType[config::maxEffects] = {};
+        float fxLevel[config::maxEffects] = {};
+        juce::uint32 changed = 0;
+    };
+
+    /**
+     * Constructor.  Takes the first snapshot and starts listening for
+     * changes.
+     */
+    explicit ParameterSnapshot(juce::AudioProcessorValueTreeState & params):
+        valueTree(params)
+    {
+        using namespace config;
+
+        parameterIds[waveIndexBit] = waveIndexPN;
+        parameterIds[cutoffBit] = cutoffPN;
+        parameterIds[resonanceBit] = resonancePN;
+        for (int ix = 0; ix < maxEffects; ++ix) {
+            parameterIds[firstFxTypeBit + ix] = getEffectPN(typeSelectorPN, ix);
+            parameterIds[firstFxLevelBit + ix] = getEffectPN(fxLevelPN, ix);
+        }
+
+        for (int ix = 0; ix < numParameters; ++ix) {
+            pSources[ix] = params.getRawParameterValue(parameterIds[ix]);
+            jassert(pSources[ix]);
+            listeners[ix].bit = 1u << ix;
+            listeners[ix].pPending = &pendingChanges;
+            params.addParameterListener(parameterIds[ix], &listeners[ix]);
+        }
+
+        pendingChanges.store(~0u);
+        update(0);
+        current.changed = ~0u;
+        waveIndexRamp.setCurrentAndTarget(current.waveIndex);
+    }
+
+    /** Destructor; stops listening. */
+    ~ParameterSnapshot()
+    {
+        for (int ix = 0; ix < numParameters; ++ix) {
+            valueTree.removeParameterListener(parameterIds[ix], &listeners[ix]);
+        }
+    }
+
+    /**
+     * Set up the ramps for the sample rate and block size.
+     */
+    void prepare(const double sampleRate, const int maximumBlockSize)
+    {
+        rampSamples = juce::jmax(1, juce::roundToInt(sampleRate * config::parameterSmoothingSeconds));
+        rampIndexes.resize(static_cast<size_t>(maximumBlockSize));
+        for (int ix = 0; ix < maximumBlockSize; ++ix) {
+            rampIndexes[ix] = static_cast<float>(ix + 1);
+        }
+        waveIndexRamp.values.resize(static_cast<size_t>(maximumBlockSize));
+        waveIndexRamp.setCurrentAndTarget(current.waveIndex);
+    }
+
+    /**
+     * Take a new snapshot for a block of numSamples.  Audio thread, once per
+     * block.
+     */
+    void update(const int numSamples) noexcept
+    {
+        const juce::uint32 pending = pendingChanges.exchange(0, std::memory_order_acquire);
+        juce::uint32 changed = 0;
+        if (pending != 0) {
+            changed |= read(pending, waveIndexBit, current.waveIndex);
+            changed |= read(pending, cutoffBit, current.cutoff);
+            changed |= read(pending, resonanceBit, current.resonance);
+            for (int ix = 0; ix < config::maxEffects; ++ix) {
+                changed |= read(pending, firstFxTypeBit + ix, current.fxType[ix]);
+                changed |= read(pending, firstFxLevelBit + ix, current.fxLevel[ix]);
+            }
+        }
+        current.changed = changed;
+
+        if (changed & waveIndexChanged) {
+            waveIndexRamp.setTarget(current.waveIndex, rampSamples);
+        }
+        waveIndexRamp.advance(numSamples);
+    }
+
+    // The current values
+    const Values & get() const noexcept
+    {
+        return current;
+    }
+
+    // Did any of these parameters change in the last update()?
+    bool hasChanged(const juce::uint32 bits) const noexcept
+    {
+        return (current.changed & bits) != 0;
+    }
+
+    /**
+     * The wave index for each sample of the block, or nullptr if it isn't
+     * moving (then it's get().waveIndex throughout).
+     */
+    const float * getWaveIndexRamp() const noexcept
+    {
+        return waveIndexRamp.getValues(rampIndexes);
+    }
+
+private:
+
+    static_assert(numParameters <= 32, "too many parameters for the change bits");
+
+    // Posts a parameter's change bit.
+    struct ChangeListener: public juce::AudioProcessorValueTreeState::Listener
+    {
+        void parameterChanged(const juce::String &, float) override
+        {
+            pPending->fetch_or(bit, std::memory_order_release);
+        }
+
+        juce::uint32 bit = 0;
+        std::atomic<juce::uint32> * pPending = nullptr;
+    };
+
+    /**
+     * A linear ramp to a parameter's latest value.  Its per-sample values are
+     * filled in on demand, once per block.
+     */
+    struct Ramp
+    {
+        void setCurrentAndTarget(const float newValue) noexcept
+        {
+            value = target = newValue;
+            remaining = 0;
+            moving = false;
+        }
+
+        // Start moving from wherever the ramp is now.
+        void setTarget(const float newTarget, const int numSamples) noexcept
+        {
+            target = newTarget;
+            step = (target - value) / static_cast<float>(numSamples);
+            remaining = numSamples;
+        }
+
+        // Move on to the next block.
+        void advance(const int numSamples) noexcept
+        {
+            moving = remaining > 0 && numSamples > 0;
+            if (!moving) {
+                return;
+            }
+            blockStart = value;
+            blockSamples = numSamples;
+            rampedSamples = juce::jmin(remaining, numSamples);
+            remaining -= rampedSamples;
+            value = (remaining == 0) ? target : value + step * static_cast<float>(rampedSamples);
+            filled = false;
+        }
+
+        const float * getValues(const std::vector<float> & indexes) const noexcept
+        {
+            if (!moving) {
+                return nullptr;
+            }
+            if (!filled) {
+                jassert(blockSamples <= static_cast<int>(values.size()));
+                float * pValues = values.data();
+                juce::FloatVectorOperations::multiply(pValues, indexes.data(), step, rampedSamples);
+                juce::FloatVectorOperations::add(pValues, blockStart, rampedSamples);
+                // the end of the block, or the target if the ramp finished in it
+                pValues[rampedSamples - 1] = value;
+                juce::FloatVectorOperations::fill(
+                    pValues + rampedSamples, value, blockSamples - rampedSamples);
+                filled = true;
+            }
+            return values.data();
+        }
+
+        // where the ramp is (at the end of the last block) and where it's going
+        float value = 0.0f;
+        float target = 0.0f;
+        float step = 0.0f;
+        int remaining = 0;
+
+        // this block
+        bool moving = false;
+        float blockStart = 0.0f;
+        int blockSamples = 0;
+        int rampedSamples = 0;
+
+        mutable bool filled = false;
+        mutable std::vector<float> values;
+    };
+
+    // Copy a parameter if its change was posted, returning its bit if it's
+    // actually different.
+    juce::uint32 read(const juce::uint32 pending, const int index, float & value) const noexcept
+    {
+        const juce::uint32 bit = 1u << index;
+        if ((pending & bit) == 0) {
+            return 0;
+        }
+        const float newValue = pSources[index]->load(std::memory_order_relaxed);
+        if (newValue == value) {
+            return 0;
+        }
+        value = newValue;
+        return bit;
+    }
+
+    Values current;
+
+    // Bits of the parameters changed since the last update().
+    std::atomic<juce::uint32> pendingChanges { 0 };
+
+    // the parameters themselves
+    juce::AudioProcessorValueTreeState & valueTree;
+    juce::String parameterIds[numParameters];
+    const std::atomic<float> * pSources[numParameters] = {};
+    ChangeListener listeners[numParameters];
+
+    // Ramps
+    int rampSamples = 1;
+    std::vector<float> rampIndexes;
+    Ramp waveIndexRamp;
+};
+
+static_assert(sizeof(ParameterSnapshot::Values) == 64, "the snapshot should fit in a cache line");
@@ -0,0 +1,245 @@
+/**
+ * An impulse response cut into equal sized partitions, each of which has been
+ * zero padded to twice its length and transformed to the frequency domain.
+ * This is the form the uniformly partitioned convolution in
+ * ConvolutionReverbProcessor works on.
+ *
+ * Spectra are stored "split": the real parts of all the bins followed by the
+ * imaginary parts, each padded out to whole SIMD registers.  That way the
+ * complex multiply-accumulate needs no lane shuffling, which
+ * juce::dsp::SIMDRegister does not provide.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/RealtimeMemory.h"
+#include "Config.h"
+
+/**
+ * A heap block of floats whose first element is SIMD aligned.  Blocks big
+ * enough are offered huge pages (config::realtimeHugePages) before they're
+ * zeroed, since that's their first touch.
+ */
+class AlignedFloatBuffer
+{
+public:
+    AlignedFloatBuffer() = default;
+    AlignedFloatBuffer(AlignedFloatBuffer &&) = default;
+    AlignedFloatBuffer & operator=(AlignedFloatBuffer &&) = default;
+
+    /** (Re)allocate, zeroed.  Not realtime safe. */
+    void allocate(const size_t numFloats)
+    {
+        // new[] leaves the floats uninitialised, so untouched.
+        storage.reset(new float[numFloats + SIMDType::SIMDNumElements]);
+        pData = SIMDType::getNextSIMDAlignedPtr(storage.get());
+        size = numFloats;
+        if (config::realtimeHugePages) {
+            juce_igutil::RealtimeMemory::adviseHugePages(pData, size * sizeof(float));
+        }
+        std::fill(pData, pData + size, 0.0f);
+    }
+
+    void clear() noexcept
+    {
+        if (size > 0) {
+            juce::FloatVectorOperations::clear(pData, static_cast<int>(size));
+        }
+    }
+
+    float * data() noexcept { return pData; }
+    const float * data() const noexcept { return pData; }
+    size_t getSize() const noexcept { return size; }
+
+private:
+    using SIMDType = juce::dsp::SIMDRegister<float>;
+
+    std::unique_ptr<float[]> storage;
+    float * pData = nullptr;
+    size_t size = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(AlignedFloatBuffer)
+};
+
+/**
+ * Helpers for working with split spectra.
+ */
+namespace spectrum {
+
+    using SIMDType = juce::dsp::SIMDRegister<float>;
+    static constexpr int simdWidth = static_cast<int>(SIMDType::SIMDNumElements);
+
+    /** Number of bins rounded up to whole SIMD registers. */
+    inline int getPaddedBins(const int numBins)
+    {
+        return (numBins + simdWidth - 1) / simdWidth * simdWidth;
+    }
+
+    /**
+     * Convert the output of FFT::performRealOnlyForwardTransform() (interleaved
+     * re/im) to split form.  The padding bins are zeroed.
+     */
+    inline void splitFromInterleaved(
+        const float * interleaved,
+        float * split,
+        const int numBins,
+        const int paddedBins) noexcept
+    {
+        float * re = split;
+        float * im = split + paddedBins;
+        for (int ix = 0; ix < numBins; ++ix) {
+            re[ix] = interleaved[2*ix];
+            im[ix] = interleaved[2*ix + 1];
+        }
+        for (int ix = numBins; ix < paddedBins; ++ix) {
+            re[ix] = 0.0f;
+            im[ix] = 0.0f;
+        }
+    }
+
+    /**
+     * Convert a split spectrum back to the interleaved form expected by
+     * FFT::performRealOnlyInverseTransform().  Only the non-negative
+     * frequencies are written; the inverse transform mirrors them.
+     */
+    inline void interleavedFromSplit(
+        const float * split,
+        float * interleaved,
+        const int numBins,
+        const int paddedBins) noexcept
+    {
+        const float * re = split;
+        const float * im = split + paddedBins;
+        for (int ix = 0; ix < numBins; ++ix) {
+            interleaved[2*ix] = re[ix];
+            interleaved[2*ix + 1] = im[ix];
+        }
+    }
+
+    /**
+     * acc += x * h, bin by bin (complex).  All three must be SIMD aligned split
+     * spectra of paddedBins bins.
+     */
+    inline void multiplyAccumulate(
+        float * acc,
+        const float * x,
+        const float * h,
+        const int paddedBins) noexcept
+    {
+        float * accRe = acc;
+        float * accIm = acc + paddedBins;
+        const float * xRe = x;
+        const float * xIm = x + paddedBins;
+        const float * hRe = h;
+        const float * hIm = h + paddedBins;
+
+        for (int ix = 0; ix < paddedBins; ix += simdWidth) {
+            const auto xr = SIMDType::fromRawArray(xRe + ix);
+            const auto xi = SIMDType::fromRawArray(xIm + ix);
+            const auto hr = SIMDType::fromRawArray(hRe + ix);
+            const auto hi = SIMDType::fromRawArray(hIm + ix);
+            const auto re = SIMDType::fromRawArray(accRe + ix) + xr * hr - xi * hi;
+            const auto im = SIMDType::fromRawArray(accIm + ix) + xr * hi + xi * hr;
+            re.copyToRawArray(accRe + ix);
+            im.copyToRawArray(accIm + ix);
+        }
+    }
+}
+
+/**
+ * The partitioned, transformed impulse response.  Immutable once built, so it
+ * can be shared by every convolution processor without locking.
+ */
+class PartitionedImpulseResponse
+{
+public:
+
+    /**
+     * Partition and transform an impulse response.  This does all the FFTs, so
+     * it belongs on a background thread.
+     *
+     * @param impulseResponse the IR, already at the processing sample rate.
+     * @param irSampleRate the processing sample rate.
+     * @param irPartitionSize samples per partition; must be a power of two.
+     */
+    PartitionedImpulseResponse(
+        const juce::AudioBuffer<float> & impulseResponse,
+        const double irSampleRate,
+        const int irPartitionSize
+    ):
+        sampleRate(irSampleRate),
+        partitionSize(irPartitionSize),
+        fftSize(2 * irPartitionSize),
+        numBins(irPartitionSize + 1),
+        paddedBins(spectrum::getPaddedBins(irPartitionSize + 1)),
+        spectrumSize(2 * spectrum::getPaddedBins(irPartitionSize + 1)),
+        numPartitions(juce::jmax(1,
+            (impulseResponse.getNumSamples() + irPartitionSize - 1) / irPartitionSize)),
+        numChannels(juce::jmax(1, impulseResponse.getNumChannels())),
+        lengthInSamples(impulseResponse.getNumSamples())
+    {
+        jassert(juce::isPowerOfTwo(partitionSize));
+
+        juce::dsp::FFT fft(getFftOrder(fftSize));
+        std::vector<float> fftBuffer(2 * fftSize);
+
+        for (int chan = 0; chan < numChannels; ++chan) {
+            channelSpectra.emplace_back();
+            channelSpectra.back().allocate(static_cast<size_t>(numPartitions * spectrumSize));
+
+            for (int part = 0; part < numPartitions; ++part) {
+                std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+                const int start = part * partitionSize;
+                const int count = juce::jmin(partitionSize, lengthInSamples - start);
+                if (count > 0 && chan < impulseResponse.getNumChannels()) {
+                    juce::FloatVectorOperations::copy(
+                        fftBuffer.data(), impulseResponse.getReadPointer(chan, start), count);
+                }
+                fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+                spectrum::splitFromInterleaved(
+                    fftBuffer.data(), getPartitionForWriting(chan, part), numBins, paddedBins);
+            }
+        }
+    }
+
+    /** Spectrum of one partition.  Mono IRs are used for every channel. */
+    const float * getPartition(const int channel, const int partition) const noexcept
+    {
+        const int chan = juce::jmin(channel, numChannels - 1);
+        return channelSpectra[chan].data() + partition * spectrumSize;
+    }
+
+    /** log2 of an fft size */
+    static int getFftOrder(const int size)
+    {
+        int order = 0;
+        while ((1 << order) < size) {
+            ++order;
+        }
+        return order;
+    }
+
+    const double sampleRate;
+    const int partitionSize;
+    const int fftSize;
+    const int numBins;
+    const int paddedBins;
+    const int spectrumSize;   // floats per partition spectrum (re + im)
+    const int numPartitions;
+    const int numChannels;
+    const int lengthInSamples;
+
+private:
+
+    float * getPartitionForWriting(const int channel, const int partition) noexcept
+    {
+        return channelSpectra[channel].data() + partition * spectrumSize;
+    }
+
+    // one buffer of numPartitions spectra per channel
+    std::vector<AlignedFloatBuffer> channelSpectra;
+
+    JUCE_DECLARE_NON_COPYABLE(PartitionedImpulseResponse)
+};
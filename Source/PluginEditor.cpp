@@ -67,6 +67,9 @@ const Rectangle<int> effectsSepR(waveIndexKnobR.getX(), resonanceKnobRect.getBot
 const int perEffectOriginX = windowMargin;
 const int perEffectOriginY = effectsSepR.getBottom() + labelH;
 
+const Rectangle<int> impulseResponseR(windowMargin, perEffectOriginY + 190, uWindowW, labelH + 4);
+const int irButtonW = 90;
+
 const int scopeX = windowMargin;
 const int scopeY = perEffectOriginY + waveIndexKnobR.getHeight() + 50 + labelH;
 const int scopeW = uWindowW;
@@ -160,6 +163,9 @@ MidisynthesiserAudioProcessorEditor::MidisynthesiserAudioProcessorEditor(
         addItemToDropDown("Chorus",     CHORUS_EFFECT,     typeDD.dropDown);
         addItemToDropDown("Delay",      DELAY_EFFECT,      typeDD.dropDown);
         addItemToDropDown("Reverb",     REVERB_EFFECT,     typeDD.dropDown);
+        addItemToDropDown("Convolution", CONVOLUTION_EFFECT, typeDD.dropDown);
+        addItemToDropDown("Waveshaper", WAVESHAPER_EFFECT, typeDD.dropDown);
+        addItemToDropDown("Delay + Reverb", DELAY_REVERB_EFFECT, typeDD.dropDown);
         typeDD.dropDown.onChange = [this, ix] { this->changedEffectType(ix); };
         addAndMakeVisible(typeDD.dropDown);
         typeDD.pAttachment.reset( 
@@ -184,6 +190,16 @@ MidisynthesiserAudioProcessorEditor::MidisynthesiserAudioProcessorEditor(
                 *pParams, getEffectPN(fxLevelPN, ix), levelKnob.knob ) );
     }
 
+    // impulse response for the convolution reverb
+    loadImpulseResponseButton.setButtonText("Load IR...");
+    loadImpulseResponseButton.onClick = [this] { chooseImpulseResponse(); };
+    addAndMakeVisible(loadImpulseResponseButton);
+    defaultImpulseResponseButton.setButtonText("Built-in IR");
+    defaultImpulseResponseButton.onClick = [this] { setImpulseResponseFile(String()); };
+    addAndMakeVisible(defaultImpulseResponseButton);
+    addAndMakeVisible(impulseResponseLabel);
+    updateImpulseResponseLabel();
+
     //addAndMakeVisible(scopeComponent);
 
     // Do this last
@@ -289,6 +305,13 @@ void MidisynthesiserAudioProcessorEditor::resized()
         }
     }
 
+    Rectangle<int> irR(impulseResponseR);
+    loadImpulseResponseButton.setBounds(irR.removeFromLeft(irButtonW));
+    irR.removeFromLeft(knobSepX);
+    defaultImpulseResponseButton.setBounds(irR.removeFromLeft(irButtonW));
+    irR.removeFromLeft(knobSepX);
+    impulseResponseLabel.setBounds(irR);
+
     scopeComponent.setTopLeftPosition(scopeX, scopeY);
     scopeComponent.setSize(scopeW, scopeH);
 }
@@ -325,3 +348,39 @@ void MidisynthesiserAudioProcessorEditor::setFxGroupVisible(
     fxControl.levelKnob.knob.setVisible(visible);
 }
 
+
+/**
+ * Let the user pick an impulse response file for the convolution reverb.  The
+ * chooser is asynchronous; the loader picks up the change from the parameter
+ * state and does the work on its own thread.
+ */
+void MidisynthesiserAudioProcessorEditor::chooseImpulseResponse()
+{
+    pImpulseResponseChooser.reset(new FileChooser(
+        "Choose an impulse response",
+        File(),
+        "*.wav;*.aif;*.aiff;*.flac"));
+    const int flags = FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles;
+    pImpulseResponseChooser->launchAsync(flags, [this](const FileChooser & chooser) {
+        const File file = chooser.getResult();
+        if (file.existsAsFile()) {
+            setImpulseResponseFile(file.getFullPathName());
+        }
+    });
+}
+
+// store the impulse response file in the parameter state
+void MidisynthesiserAudioProcessorEditor::setImpulseResponseFile(const juce::String & filePath)
+{
+    LOG(String("Impulse response file set to: ") + (filePath.isEmpty() ? String("(built-in)") : filePath));
+    pParams->state.setProperty(Identifier(impulseResponseFilePN.c_str()), filePath, nullptr);
+    updateImpulseResponseLabel();
+}
+
+// show the current impulse response file
+void MidisynthesiserAudioProcessorEditor::updateImpulseResponseLabel()
+{
+    const String filePath = pParams->state.getProperty(Identifier(impulseResponseFilePN.c_str())).toString();
+    const String name = filePath.isEmpty() ? String("(built-in room)") : File(filePath).getFileName();
+    impulseResponseLabel.setText(String("Convolution IR: ") + name, dontSendNotification);
+}
@@ -129,6 +129,22 @@ private:
     // helper to set the visibility of controls when non-null effect is selected
     void setFxGroupVisible(FxControl & fxControl, const bool visible = true);
 
+    // Convolution reverb impulse response selection.  The file is stored as a
+    // property of the parameter state.
+    juce::Label impulseResponseLabel;
+    juce::TextButton loadImpulseResponseButton;
+    juce::TextButton defaultImpulseResponseButton;
+    std::unique_ptr<juce::FileChooser> pImpulseResponseChooser;
+
+    // let the user pick an impulse response file
+    void chooseImpulseResponse();
+
+    // store the impulse response file in the parameter state (empty = built-in)
+    void setImpulseResponseFile(const juce::String & filePath);
+
+    // show the current impulse response file
+    void updateImpulseResponseLabel();
+
     // Oscilloscope
     ScopeComponent<float> scopeComponent;
 
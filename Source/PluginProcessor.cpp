@@ -14,6 +14,8 @@
 #include "juce_igutil/MTLogger.h"
 #include "juce_igutil/Profiler.h"
 #include "juce_igutil/ConfigurableSynthAudioSource.h"
+#include "juce_igutil/RealtimeSanitizer.h"
+#include "juce_igutil/SharedService.h"
 
 #include "Config.h"
 #include "Debug.h"
@@ -32,6 +34,10 @@ using EditorType = MidisynthesiserAudioProcessorEditor;
 //#define AUTO_PLAY_CHORD
 //#define LOG_MIDI_NOTES
 
+// Instances created so far in this process, and the ones still alive
+static std::atomic<int> instancesCreated { 0 };
+static std::atomic<int> instancesAlive { 0 };
+
 //==============================================================================
 /**
  * Processor constructor
@@ -46,21 +52,40 @@ MidisynthesiserAudioProcessor::MidisynthesiserAudioProcessor()
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
                        ),
-    pLogger(std::shared_ptr<juce::FileLogger>(
-        FileLogger::createDefaultAppLogger(
-            "midi-synthesiser", 
-            "midi-synthesiser.txt", 
-            "Processor started."))),
-    pMTL(std::make_shared<MTLogger>(pLogger))
+    instanceNumber(++instancesCreated),
+    // All the instances share one log, and one logger thread.
+    pLogger(SharedService<juce::FileLogger>::get([]() {
+        return std::shared_ptr<juce::FileLogger>(
+            FileLogger::createDefaultAppLogger(
+                "midi-synthesiser", 
+                "midi-synthesiser.txt", 
+                "Processor started."));
+    })),
+    pSharedMTL(SharedService<MTLogger>::get([this]() {
+        return std::make_shared<MTLogger>(
+            pLogger,
+            config::binaryLogging ?
+                std::make_shared<BinaryLogSink>(
+                    pLogger->getLogFile().withFileExtension("mtlog"),
+                    config::logMaxFileBytes,
+                    config::logMaxFiles) :
+                nullptr);
+    })),
+    pMTL(pSharedMTL->createTagged("synth " + String(instanceNumber)))
 
 #endif
 {
+    ++instancesAlive;
     Logger::setCurrentLogger(pLogger.get());
-    pLogger->logMessage("Audio Processor CONSTRUCTOR.");
+    pMTL->info("Audio Processor CONSTRUCTOR.");
 
-    pProfiler.reset(new Profiler("MidisynthesizerAudioProcessor_Profiler", pMTL, 1000));
+    // One profiler for the process too, so its totals cover every instance.
+    pSharedProfiler = SharedService<Profiler>::get([this]() {
+        return std::make_shared<Profiler>("MidisynthesizerAudioProcessor_Profiler", pSharedMTL, 1000);
+    });
+    pProfiler = pSharedProfiler->createTagged("synth " + String(instanceNumber));
 
-    pLogger->logMessage("Creating wavetables...");
+    pMTL->info("Creating wavetables...");
     deque<juce::AudioBuffer<WTSampleType>> wavetable = 
         WavetableGenerator::createBasicWavetable<WTSampleType>(wavetableNumSamples);
     for ( int ix=0; ix<wavetable.size(); ++ix ) {
@@ -68,7 +93,7 @@ MidisynthesiserAudioProcessor::MidisynthesiserAudioProcessor()
         debug::checkOutput(wavetable[ix], pMTL);
     }
 
-    pLogger->logMessage("Creating audio parameter layout...");
+    pMTL->info("Creating audio parameter layout...");
     // standard "always-on" params:  
     AudioProcessorValueTreeState::ParameterLayout paramLayout(
         make_unique<juce::AudioParameterFloat>(
@@ -131,7 +156,7 @@ MidisynthesiserAudioProcessor::MidisynthesiserAudioProcessor()
         ));
     }
 
-    pLogger->logMessage("Creating Synth...");
+    pMTL->info("Creating Synth...");
     pSynthAudioSource.reset(new WavetableSynth(
         pMTL,
         // parameters
@@ -145,11 +170,18 @@ MidisynthesiserAudioProcessor::MidisynthesiserAudioProcessor()
         )),
         UnlimitedSynthSound::Ptr(new UnlimitedSynthSound),
         move(wavetable),
-        config::numVoices,
-        keyboardState
+        config::numVoices
     ));
+    pSynthAudioSource->setOutputTap([this](const float * pSamples, int numSamples) {
+        scopeDataCollector.process(pSamples, static_cast<size_t>(numSamples));
+    });
+
+    // The onscreen keyboard's notes go to the audio thread through the 
+    // injection queue; the host's come back to it on the timer.
+    keyboardState.addListener(this);
+    startTimer(keyboardHostNotesIntervalMs);
 
-    pLogger->logMessage("Audio Processor instantiated.");
+    pMTL->info("Audio Processor instantiated.");
 }
 
 /**
@@ -157,9 +189,16 @@ MidisynthesiserAudioProcessor::MidisynthesiserAudioProcessor()
  */
 MidisynthesiserAudioProcessor::~MidisynthesiserAudioProcessor()
 {
+    stopTimer();
+    keyboardState.removeListener(this);
+
     // I guess the logger, that does not own this pointer, can't abide
-    // being destructed if it is the current logger ...shrug...
-    Logger::setCurrentLogger(nullptr);
+    // being destructed if it is the current logger ...shrug...  It's shared,
+    // so only the last instance (on the message thread, like the rest) lets
+    // go of it.
+    if (--instancesAlive == 0) {
+        Logger::setCurrentLogger(nullptr);
+    }
 }
 
 //==============================================================================
@@ -238,6 +277,13 @@ void MidisynthesiserAudioProcessor::prepareToPlay (double sampleRate, int sample
     };
 
     pSynthAudioSource->prepareToPlay(processSpec);
+    midiInjectionQueue.prepare(sampleRate, samplesPerBlock);
+
+    // effects that are already in place are ready now, so their latency is
+    // known.
+    latencyChanged.store(false);
+    synthLatencySamples.store(pSynthAudioSource->getLatencySamples());
+    setLatencySamples(synthLatencySamples.load());
 }
 
 void MidisynthesiserAudioProcessor::releaseResources()
@@ -317,6 +363,8 @@ void MidisynthesiserAudioProcessor::processBlock(
     juce::MidiBuffer & midiMessages
 )
 {
+    // In RT_SANITIZER builds, report anything this thread shouldn't do.
+    RT_SANITIZER_REALTIME_SCOPE;
     juce::ScopedNoDenormals noDenormals;
 
     //juce::MidiBuffer& incomingMidi(midiMessages);
@@ -326,10 +374,20 @@ void MidisynthesiserAudioProcessor::processBlock(
     playChord(midiMessages, LOW_FIFTH);
 #endif // AUTO_PLAY_CHORD
 
+    // Pass the host's notes back for the onscreen keyboard to show, then 
+    // merge in its midi (and anything else injected).
+    for (const auto metadata : midiMessages) {
+        const auto msg = metadata.getMessage();
+        if (msg.isNoteOnOrOff() || msg.isAllNotesOff())
+            hostNotesQueue.push(msg);
+    }
+    juce::MidiBuffer & blockMidi = midiInjectionQueue.merge(midiMessages, buffer.getNumSamples());
+
 #ifdef LOG_MIDI_NOTES
-    for (auto it = midiMessages.cbegin(); it != midiMessages.cend(); ++it) {
-        const auto & msg = (*it).getMessage();
-        pMTL->info(String("Midi message received: noteNumber ") + String(msg.getNoteNumber()) + ", " + msg.getDescription());
+    for (const auto metadata : blockMidi) {
+        const auto msg = metadata.getMessage();
+        pMTL->log("Midi message received: noteNumber {}, channel {}, at sample {}", 
+            msg.getNoteNumber(), msg.getChannel(), metadata.samplePosition);
     }
 #endif //LOG_MIDI_NOTES
 
@@ -342,18 +400,88 @@ void MidisynthesiserAudioProcessor::processBlock(
     jassert(totalNumInputChannels == 0);
     jassert(totalNumOutputChannels == 2);
 
-    //pProfiler->start();
+    // Nothing sounding and no midi: the block is just cleared, and there's 
+    // nothing new for the scope.
+    if (pSynthAudioSource->renderIdleBlock(buffer, blockMidi, 0)) {
+        return;
+    }
 
-    pSynthAudioSource->renderNextBlock(buffer, midiMessages, 0);
+    //pProfiler->start();
 
-    scopeDataCollector.process(buffer.getReadPointer(0), static_cast<size_t>(buffer.getNumSamples()));
+    pSynthAudioSource->renderNextBlock(buffer, blockMidi, 0);
+    updateLatency();
 
     //pProfiler->stop();
 }
 
+/**
+ * The synth's latency changes when effects that add latency are switched in or
+ * out.  setLatencySamples() notifies the host, so it's called on the message 
+ * thread, from the timer; waking the message thread would take a lock.
+ */
+void MidisynthesiserAudioProcessor::updateLatency()
+{
+    const int latency = pSynthAudioSource->getLatencySamples();
+    if (latency != synthLatencySamples.load(std::memory_order_relaxed)) {
+        synthLatencySamples.store(latency, std::memory_order_relaxed);
+        latencyChanged.store(true, std::memory_order_release);
+    }
+}
+
+/**
+ * The onscreen keyboard's notes are injected, not merged from its state on 
+ * the audio thread, so the keyboard's lock is never taken there.  A full 
+ * queue drops the note (and counts it) rather than block.
+ */
+void MidisynthesiserAudioProcessor::handleNoteOn(
+    juce::MidiKeyboardState *, int midiChannel, int midiNoteNumber, float velocity)
+{
+    if (!showingHostNotes)
+        midiInjectionQueue.push(MidiMessage::noteOn(midiChannel, midiNoteNumber, velocity));
+}
+
+void MidisynthesiserAudioProcessor::handleNoteOff(
+    juce::MidiKeyboardState *, int midiChannel, int midiNoteNumber, float velocity)
+{
+    if (!showingHostNotes)
+        midiInjectionQueue.push(MidiMessage::noteOff(midiChannel, midiNoteNumber, velocity));
+}
+
+/**
+ * Show the notes the host has played since the last time on the keyboard.
+ * The keyboard tells its listeners, including us, about them; they've already
+ * been played, so they aren't injected.
+ */
+void MidisynthesiserAudioProcessor::timerCallback()
+{
+    if (latencyChanged.exchange(false, std::memory_order_acquire))
+        setLatencySamples(synthLatencySamples.load(std::memory_order_relaxed));
+    pSynthAudioSource->handlePendingUpdates();
+
+    showingHostNotes = true;
+    MidiInjectionQueue::Event event;
+    while (hostNotesQueue.pop(event)) {
+        keyboardState.processNextMidiEvent(MidiMessage(event.data, event.numBytes));
+    }
+    showingHostNotes = false;
+}
+
+/**
+ * Switch the synth between its realtime and offline quality settings.
+ */
+void MidisynthesiserAudioProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(isNonRealtime);
+    pSynthAudioSource->setNonRealtime(isNonRealtime);
+}
+
 //------------------------------------------------------------------------------
 // Performance Test Results:
 //
+// (The warmup runs below predate prepareToPlay() making the memory resident
+// and warming up the voices and effects itself; see 
+// WavetableSynth::makeResident().)
+//
 // With RealtimeSineSynthVoice (1st time with warmup):
 // Perf Stats:  minNanos=79'200, maxNanos=514'000, nanosAvg=144'791, nanosCount=5000
 // Perf Stats:  minNanos=79'400, maxNanos=519'400, nanosAvg=146'738, nanosCount=5000
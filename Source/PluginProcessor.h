@@ -13,6 +13,7 @@
 #include "juce_igutil/SynthAudioSource.h"
 #include "juce_igutil/Stopwatch.h"
 
+#include "juce_igutil/MidiInjectionQueue.h"
 #include "juce_igutil/MTLogger.h"
 #include "juce_igutil/Profiler.h"
 
@@ -26,7 +27,9 @@ class MidisynthesiserAudioProcessorEditor;
 //==============================================================================
 /**
 */
-class MidisynthesiserAudioProcessor  : public juce::AudioProcessor
+class MidisynthesiserAudioProcessor  : public juce::AudioProcessor,
+                                       private juce::MidiKeyboardState::Listener,
+                                       private juce::Timer
 {
 public:
     //==============================================================================
@@ -45,6 +48,9 @@ public:
     void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
     bool supportsDoublePrecisionProcessing() const override { return true; }
 
+    // Realtime vs. offline (bounce) rendering
+    void setNonRealtime (bool isNonRealtime) noexcept override;
+
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -68,24 +74,53 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    // Allow access to the keyboard state
-    // TODO thread safety - this is used from process() thread as well as editor.
+    // Allow access to the keyboard state.  Message thread only; its notes 
+    // reach the audio thread through the midi injection queue.
     juce::MidiKeyboardState & getKeyboardState() { return keyboardState; }
 
+    // Push midi here to have it played, from any thread (e.g. a sequencer or
+    // test harness).  It's merged into the host's midi at the next block.
+    juce_igutil::MidiInjectionQueue & getMidiInjectionQueue() noexcept { return midiInjectionQueue; }
+
     // Allow access to the audiobufferqueue.
     // Note ABQ is a lockfree, threadsafe single-reader, single-writer FIFO queue.
     AudioBufferQueue<float>& getAudioBufferQueue() noexcept { return audioBufferQueue; }
 
+    // How much memory prepareToPlay() made resident (and locked) for the 
+    // audio thread.  Not from the audio thread.
+    juce_igutil::RealtimeMemory::Stats getRealtimeMemoryStats() const {
+        return pSynthAudioSource->getRealtimeMemoryStats();
+    }
+
 private:
 
     //==============================================================================
 
-    // logger and helper
+    // Check for a latency change after rendering.  Audio thread.
+    void updateLatency();
+
+    // The onscreen keyboard's notes, to be injected.  Message thread.
+    void handleNoteOn(juce::MidiKeyboardState *, int midiChannel, int midiNoteNumber, float velocity) override;
+    void handleNoteOff(juce::MidiKeyboardState *, int midiChannel, int midiNoteNumber, float velocity) override;
+
+    // Show the host's notes on the onscreen keyboard, report a latency
+    // change to the host, and let the synth do what the audio thread has
+    // asked for.  Message thread.
+    void timerCallback() override;
+
+    // This instance's number, which tags its log messages
+    const int instanceNumber;
+
+    // logger and helper, shared by all the instances in the process
     std::shared_ptr<juce::FileLogger> pLogger;
+    std::shared_ptr<juce_igutil::MTLogger> pSharedMTL;
+    // the shared logger, with this instance's messages tagged
     std::shared_ptr<juce_igutil::MTLogger> pMTL;
     
-    // profiler
-    std::unique_ptr<juce_igutil::Profiler> pProfiler;
+    // profiler, shared by all the instances in the process
+    std::shared_ptr<juce_igutil::Profiler> pSharedProfiler;
+    // the shared profiler, with this instance's stats tagged
+    std::shared_ptr<juce_igutil::Profiler> pProfiler;
 
     // the synth (audio source)
     std::shared_ptr<juce_igutil::SynthAudioSource> pSynthAudioSource;
@@ -95,10 +130,23 @@ private:
     // on-screen keyboard this is optional.
     juce::MidiKeyboardState keyboardState;
 
+    // Midi from the onscreen keyboard and anything else, merged into the
+    // host's on the audio thread; and the host's notes on their way back to
+    // the keyboard.
+    juce_igutil::MidiInjectionQueue midiInjectionQueue;
+    juce_igutil::MidiInjectionQueue hostNotesQueue;
+    // set while the keyboard is shown the host's notes, so they aren't 
+    // injected back
+    bool showingHostNotes = false;
+
     // collects data for the oscilloscope
     AudioBufferQueue<SAMPLE_TYPE> audioBufferQueue;
     ScopeDataCollector<SAMPLE_TYPE> scopeDataCollector { audioBufferQueue };
 
+    // latency of the synth's effects, as last seen on the audio thread
+    std::atomic<int> synthLatencySamples { 0 };
+    std::atomic<bool> latencyChanged { false };
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidisynthesiserAudioProcessor)
 };
 
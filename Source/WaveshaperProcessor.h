@@ -0,0 +1,420 @@
+/**
+ * A waveshaping distortion with antiderivative anti-aliasing (ADAA).
+ *
+ * Instead of applying the curve f(x) to each sample, ADAA applies it to the
+ * straight line between consecutive samples and takes the average:
+ *
+ *   1st order:  y[n] = (F1(x[n]) - F1(x[n-1])) / (x[n] - x[n-1])
+ *
+ * where F1 is the antiderivative of f.  2nd order does the same again with
+ * the second antiderivative F2, which suppresses aliasing further at the cost
+ * of one sample of latency (1st order adds half a sample).  Either way it
+ * costs about the same as running the curve at the normal rate, rather than
+ * the 2x to 8x of oversampling.  When consecutive samples are nearly equal the
+ * divisions are ill conditioned, so the curve (or its antiderivative) is
+ * evaluated at the midpoint instead, which is what the expressions tend to.
+ *
+ * The curves are polynomials up to a clipping point and flat beyond it, so
+ * their antiderivatives have simple closed forms that only need multiplies,
+ * adds and min/max, and are evaluated across whole blocks with
+ * juce::dsp::SIMDRegister.  The divisions lose a lot of precision when the
+ * samples are close together, so it's all done in double precision.
+ *
+ * Shapes:
+ *   TANH: the odd polynomial with slope (1 - (x/c)^2)^3, which is close to
+ *         tanh but reaches its ceiling of 1 at x = c (~2.19).
+ *   HARD_CLIP: clips at +/-1.
+ *   OBX_HORN: asymmetric: a soft (slope (1 - (x/c)^2)^2) curve up to 1 for
+ *         positive input, and a harder, lower (0.7) one for negative input.
+ *         The even harmonics give a square wave the "horned" look of the
+ *         OB-X.  The DC it adds is taken out by a DC blocker.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+#include "Config.h"
+
+class WaveshaperProcessor: public juce_igutil::Processor
+{
+public:
+
+    using Shape = config::WaveshaperShape;
+
+    /**
+     * Constructor.
+     *
+     * @param waveshaperShape the curve.
+     * @param antiderivativeOrder ADAA order, 1 or 2.
+     */
+    WaveshaperProcessor(const Shape waveshaperShape, const int antiderivativeOrder):
+        juce_igutil::Processor(),
+        adaaOrder(antiderivativeOrder)
+    {
+        jassert(adaaOrder == 1 || adaaOrder == 2);
+
+        switch (waveshaperShape) {
+            case Shape::TANH:
+                positive = Side(3, 1.0);
+                negative = positive;
+                break;
+            case Shape::HARD_CLIP:
+                positive = Side(0, 1.0);
+                negative = positive;
+                break;
+            case Shape::OBX_HORN:
+                positive = Side(2, 1.0);
+                negative = Side(1, 0.7);
+                break;
+        }
+    }
+
+    /** Destructor. */
+    virtual ~WaveshaperProcessor() = default;
+
+    /** Gain applied before the curve (smoothed). */
+    void setDrive(const float newDrive)
+    {
+        drive.setTargetValue(newDrive);
+    }
+
+    /** Gain applied after the curve (smoothed). */
+    void setLevel(const float newLevel)
+    {
+        level.setTargetValue(newLevel);
+    }
+
+    /** Prepare to process audio.  */
+    void prepare(const juce::dsp::ProcessSpec & spec) override
+    {
+        const int maxBlock = static_cast<int>(spec.maximumBlockSize);
+
+        // room for the history samples, rounded up to whole registers
+        const int scratchSize = (maxBlock + historySize + simdWidth - 1) / simdWidth * simdWidth;
+        inputStorage.assign(scratchSize + simdWidth, 0.0);
+        antiderivativeStorage.assign(scratchSize + simdWidth, 0.0);
+        pInput = SIMDType::getNextSIMDAlignedPtr(inputStorage.data());
+        pAntiderivative = SIMDType::getNextSIMDAlignedPtr(antiderivativeStorage.data());
+
+        driveRamp.resize(maxBlock);
+        levelRamp.resize(maxBlock);
+        channels.resize(spec.numChannels);
+
+        drive.reset(spec.sampleRate, config::parameterSmoothingSeconds);
+        level.reset(spec.sampleRate, config::parameterSmoothingSeconds);
+        dcCoef = 1.0 - juce::MathConstants<double>::twoPi * dcBlockerHz / spec.sampleRate;
+
+        reset();
+    }
+
+    /** Process audio. */
+    void process(juce::dsp::ProcessContextReplacing<float> & context) noexcept override
+    {
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        const int numChannels = juce::jmin(static_cast<int>(block.getNumChannels()),
+            static_cast<int>(channels.size()));
+        jassert(numSamples <= static_cast<int>(driveRamp.size()));
+
+        for (int ix = 0; ix < numSamples; ++ix) {
+            driveRamp[ix] = drive.getNextValue();
+            levelRamp[ix] = level.getNextValue();
+        }
+
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pSamples = block.getChannelPointer(chan);
+            if (adaaOrder == 1) {
+                processFirstOrder(channels[chan], pSamples, numSamples);
+            }
+            else {
+                processSecondOrder(channels[chan], pSamples, numSamples);
+            }
+        }
+    }
+
+    /** Reset the state. */
+    void reset() override
+    {
+        std::fill(channels.begin(), channels.end(), ChannelState());
+        drive.setCurrentAndTargetValue(drive.getTargetValue());
+        level.setCurrentAndTargetValue(level.getTargetValue());
+    }
+
+    /** The DC blocker settling by 100dB. */
+    int getTailSamples() const noexcept override
+    {
+        return historySize + static_cast<int>(std::ceil(std::log(1.0e-5) / std::log(dcCoef)));
+    }
+
+    /** Silent at level 0. */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        if (level.getTargetValue() != 0.0f) {
+            return false;
+        }
+        gain = 0.0f;
+        return true;
+    }
+
+    /** The ramps, the channels' state and the scratch. */
+    void prefault(juce_igutil::RealtimeMemory & memory) override
+    {
+        memory.add(driveRamp);
+        memory.add(levelRamp);
+        memory.add(channels);
+        memory.add(inputStorage);
+        memory.add(antiderivativeStorage);
+    }
+
+    /** 2nd order ADAA delays the signal by a sample; 1st order by half. */
+    int getLatencySamples() const noexcept override
+    {
+        return adaaOrder == 2 ? 1 : 0;
+    }
+
+private:
+
+    using SIMDType = juce::dsp::SIMDRegister<double>;
+    static constexpr int simdWidth = static_cast<int>(SIMDType::SIMDNumElements);
+
+    // previous input samples kept at the start of the scratch buffers
+    static const int historySize = 2;
+
+    // below this difference between samples, use the midpoint fallback
+    static constexpr double tolerance = 1.0e-5;
+
+    static constexpr double dcBlockerHz = 10.0;
+
+    /**
+     * One side (positive or negative input) of a curve:
+     *
+     *   f(x) = gain * p(x / gain)
+     *
+     * where p has slope (1 - (u/c)^2)^n, so it rises with slope 1 and goes
+     * flat at p(c) = 1.  n = 0 is a hard clip.  The polynomial coefficients of
+     * p and its first two antiderivatives are in powers of u^2.
+     */
+    struct Side
+    {
+        Side() = default;
+
+        Side(const int smoothness, const double ceiling)
+        {
+            jassert(smoothness >= 0 && smoothness < numCoefs);
+
+            // c is where the curve reaches 1: 1 / the integral of the slope
+            // over 0..1
+            double integral = 0.0;
+            for (int k = 0; k <= smoothness; ++k) {
+                integral += sign(k) * binomial(smoothness, k) / (2*k + 1);
+            }
+            clip = 1.0 / integral;
+
+            for (int k = 0; k <= smoothness; ++k) {
+                const double a = sign(k) * binomial(smoothness, k)
+                    / ((2*k + 1) * std::pow(clip, 2*k));
+                p[k] = a;
+                p1[k] = a / (2*k + 2);
+                p2[k] = a / ((2*k + 2) * (2*k + 3));
+            }
+
+            scale = ceiling;
+            invScale = 1.0 / ceiling;
+        }
+
+        static double sign(const int k) { return (k % 2) ? -1.0 : 1.0; }
+
+        static double binomial(const int n, const int k)
+        {
+            double b = 1.0;
+            for (int i = 1; i <= k; ++i) {
+                b = b * (n - k + i) / i;
+            }
+            return b;
+        }
+
+        static const int numCoefs = 4;
+        double p[numCoefs] = { 1.0, 0.0, 0.0, 0.0 };
+        double p1[numCoefs] = { 0.5, 0.0, 0.0, 0.0 };
+        double p2[numCoefs] = { 1.0 / 6.0, 0.0, 0.0, 0.0 };
+        double clip = 1.0;
+        double scale = 1.0;
+        double invScale = 1.0;
+    };
+
+    // per channel history
+    struct ChannelState
+    {
+        double x1 = 0.0;    // previous (driven) input
+        double x2 = 0.0;    // and the one before
+        double d1 = 0.0;    // previous 1st divided difference (2nd order)
+        double dcIn = 0.0;
+        double dcOut = 0.0;
+    };
+
+    static double clampTo(const double u, const double c) noexcept
+    {
+        return juce::jlimit(-c, c, u);
+    }
+
+    static SIMDType clampTo(const SIMDType u, const double c) noexcept
+    {
+        return SIMDType::max(SIMDType::min(u, SIMDType::expand(c)), SIMDType::expand(-c));
+    }
+
+    static double positivePart(const double x) noexcept { return juce::jmax(x, 0.0); }
+    static double negativePart(const double x) noexcept { return juce::jmin(x, 0.0); }
+    static SIMDType positivePart(const SIMDType x) noexcept { return SIMDType::max(x, SIMDType::expand(0.0)); }
+    static SIMDType negativePart(const SIMDType x) noexcept { return SIMDType::min(x, SIMDType::expand(0.0)); }
+
+    /**
+     * The curve (order 0) or its 1st or 2nd antiderivative on one side.  Past
+     * the clipping point the curve is flat, so the antiderivatives continue as
+     * a line and a parabola from their values there.  T is double or SIMDType.
+     */
+    template <int order, typename T>
+    static T evaluateSide(const Side & s, const T x) noexcept
+    {
+        const T u = x * s.invScale;
+        const T uc = clampTo(u, s.clip);
+        const T w = uc * uc;
+        const T p = uc * (((w * s.p[3] + s.p[2]) * w + s.p[1]) * w + s.p[0]);
+        if (order == 0) {
+            return p * s.scale;
+        }
+        const T e = u - uc;
+        const T p1 = w * (((w * s.p1[3] + s.p1[2]) * w + s.p1[1]) * w + s.p1[0]);
+        if (order == 1) {
+            return (p1 + e * p) * (s.scale * s.scale);
+        }
+        const T p2 = uc * w * (((w * s.p2[3] + s.p2[2]) * w + s.p2[1]) * w + s.p2[0]);
+        return (p2 + e * (p1 + e * p * 0.5)) * (s.scale * s.scale * s.scale);
+    }
+
+    // The whole curve or its antiderivative.  Both sides are zero at zero, so
+    // they can just be added.
+    template <int order, typename T>
+    T evaluate(const T x) const noexcept
+    {
+        return evaluateSide<order>(positive, positivePart(x))
+            + evaluateSide<order>(negative, negativePart(x));
+    }
+
+    // Evaluate for a whole (SIMD aligned) buffer.  numSamples is rounded up to
+    // whole registers.
+    template <int order>
+    void evaluateBuffer(const double * pIn, double * pOut, const int numSamples) const noexcept
+    {
+        for (int ix = 0; ix < numSamples; ix += simdWidth) {
+            evaluate<order>(SIMDType::fromRawArray(pIn + ix)).copyToRawArray(pOut + ix);
+        }
+    }
+
+    // Copy the driven input in after the history samples.
+    void loadInput(const float * pSamples, const int numSamples) noexcept
+    {
+        double * pX = pInput + historySize;
+        for (int ix = 0; ix < numSamples; ++ix) {
+            pX[ix] = static_cast<double>(pSamples[ix] * driveRamp[ix]);
+        }
+    }
+
+    // DC blocker and output level
+    void store(ChannelState & state, const double y, float * pSample, const int ix) noexcept
+    {
+        state.dcOut = y - state.dcIn + dcCoef * state.dcOut;
+        state.dcIn = y;
+        *pSample = static_cast<float>(state.dcOut) * levelRamp[ix];
+    }
+
+    // 1st order ADAA
+    void processFirstOrder(ChannelState & state, float * pSamples, const int numSamples) noexcept
+    {
+        // pX[-1] is the previous sample
+        double * pX = pInput + historySize;
+        double * pF = pAntiderivative + historySize;
+        pX[-1] = state.x1;
+        loadInput(pSamples, numSamples);
+        evaluateBuffer<1>(pInput, pAntiderivative, numSamples + historySize);
+
+        for (int ix = 0; ix < numSamples; ++ix) {
+            const double dx = pX[ix] - pX[ix - 1];
+            const double y = std::abs(dx) > tolerance ?
+                (pF[ix] - pF[ix - 1]) / dx :
+                evaluate<0>(0.5 * (pX[ix] + pX[ix - 1]));
+            store(state, y, pSamples + ix, ix);
+        }
+
+        state.x1 = pX[numSamples - 1];
+    }
+
+    // 2nd order ADAA
+    void processSecondOrder(ChannelState & state, float * pSamples, const int numSamples) noexcept
+    {
+        // pX[-1] and pX[-2] are the previous samples
+        double * pX = pInput + historySize;
+        double * pF = pAntiderivative + historySize;
+        pX[-2] = state.x2;
+        pX[-1] = state.x1;
+        loadInput(pSamples, numSamples);
+        evaluateBuffer<2>(pInput, pAntiderivative, numSamples + historySize);
+
+        double d1Prev = state.d1;
+        for (int ix = 0; ix < numSamples; ++ix) {
+            const double x0 = pX[ix];
+            const double x1 = pX[ix - 1];
+            const double x2 = pX[ix - 2];
+
+            // 1st divided difference of F2, an average of F1 over x1..x0
+            const double dx = x0 - x1;
+            const double d1 = std::abs(dx) > tolerance ?
+                (pF[ix] - pF[ix - 1]) / dx :
+                evaluate<1>(0.5 * (x0 + x1));
+
+            double y;
+            const double dx2 = x0 - x2;
+            if (std::abs(dx2) > tolerance) {
+                y = 2.0 * (d1 - d1Prev) / dx2;
+            }
+            else {
+                // x0 and x2 are about the same, so go out to the midpoint of
+                // them and x1 and back.
+                const double xBar = 0.5 * (x0 + x2);
+                const double delta = xBar - x1;
+                if (std::abs(delta) > tolerance) {
+                    y = (2.0 / delta) * (evaluate<1>(xBar)
+                        + (pF[ix - 1] - evaluate<2>(xBar)) / delta);
+                }
+                else {
+                    y = evaluate<0>(0.5 * (xBar + x1));
+                }
+            }
+            store(state, y, pSamples + ix, ix);
+            d1Prev = d1;
+        }
+
+        state.x2 = pX[numSamples - 2];
+        state.x1 = pX[numSamples - 1];
+        state.d1 = d1Prev;
+    }
+
+    const int adaaOrder;
+    Side positive;
+    Side negative;
+
+    juce::SmoothedValue<float> drive { 1.0f };
+    juce::SmoothedValue<float> level { 1.0f };
+    std::vector<float> driveRamp;
+    std::vector<float> levelRamp;
+
+    double dcCoef = 0.999;
+    std::vector<ChannelState> channels;
+
+    // Scratch: history then the block's driven input, and its antiderivative.
+    std::vector<double> inputStorage;
+    std::vector<double> antiderivativeStorage;
+    double * pInput = nullptr;
+    double * pAntiderivative = nullptr;
+};
@@ -3,6 +3,7 @@
 #include "JuceHeader.h"
 
 #include "Config.h"
+#include "ParameterSnapshot.h"
 
 #include "juce_igutil/Oscillator.h"
 
@@ -23,22 +24,18 @@ public:
      */
     WavetableOscillator(
         std::shared_ptr<juce_igutil::MTLogger> _pMTL,
-        std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParams,
+        std::shared_ptr<const ParameterSnapshot> pParameterSnapshot,
         const std::deque<juce::AudioBuffer<SAMPLE_TYPE>> & waveTableInUse
     ): 
         Oscillator(),
         pMTL(_pMTL),
-        wavetable(waveTableInUse)
+        wavetable(waveTableInUse),
+        pParams(pParameterSnapshot)
     {
-        using namespace config;
-
-        // empty
         jassert( !wavetable.empty() );
+        jassert( pParams );
 
-        pMTL->info("Oscillator: Connecting parameters...");
-        pWavetableIndexParam = pSynthParams->getRawParameterValue(waveIndexPN);
-
-        setWaves(pWavetableIndexParam);
+        setWaves(pParams->get().waveIndex);
     }
 
     // Default destructor
@@ -50,6 +47,9 @@ public:
     void prepare (const juce::dsp::ProcessSpec& spec) noexcept override
     {
         sampleRate = static_cast<float>(spec.sampleRate);
+        // Controller changes come at most once a window, so a ramp that 
+        // long joins up with the next one.
+        bendRampSamples = config::getMidiControllerWindowSamples(spec.sampleRate);
     }
 
     /**
@@ -60,13 +60,16 @@ public:
     void startNote (
         int midiNoteNumber, 
         float velocity,
-        int /*currentPitchWheelPosition*/
+        int currentPitchWheelPosition
     ) override
     {
         waveSampleIndex = 0.0;
         level = velocity;
         tailOff = 0.0;
 
+        // The wave index may have changed while the oscillator was idle.
+        setWaves(pParams->get().waveIndex);
+
         // for this note, this is the number of cycles per second.
         const double noteHertz = juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber);
         //const double cyclesPerSecond = noteHertz;
@@ -78,8 +81,13 @@ public:
 
         // The fraction of a cycle (in terms of number of samples in the wave,
         // rather than 2pi.
-        const juce::AudioBuffer<SAMPLE_TYPE> & wave = wavetable[static_cast<int>(*pWavetableIndexParam)];
-        waveCycleDelta = cyclesPerSample * (wave.getNumSamples());
+        const juce::AudioBuffer<SAMPLE_TYPE> & wave = *pLowWave;
+        noteCycleDelta = cyclesPerSample * (wave.getNumSamples());
+
+        // the note starts at the current bend
+        bendRatio = getPitchBendRatio(currentPitchWheelPosition);
+        bendSamplesLeft = 0;
+        waveCycleDelta = noteCycleDelta * bendRatio;
 
         /* 
         noteHertz = 2 
@@ -149,13 +157,19 @@ public:
         // Only generate waveform if there is a note currently assigned to this oscillator.
         if (waveCycleDelta > 0.0)
         {
-            // update wave(s) in use
-            setWaves(pWavetableIndexParam);
+            // update wave(s) in use.  While the wave index is ramping, that's
+            // every sample; the buffer is one block, so its sample indexes 
+            // are the ramp's.
+            const float * pWaveIndexRamp = pParams->getWaveIndexRamp();
+            if (pWaveIndexRamp == nullptr && pParams->hasChanged(ParameterSnapshot::waveIndexChanged))
+                setWaves(pParams->get().waveIndex);
 
             if (tailOff > 0.0) // [7]
             {
                 for (int n = 0; !noteDone && n < numSamples; ++n ) 
                 {
+                    if (pWaveIndexRamp)
+                        setWaves(pWaveIndexRamp[outputSampleIndex]);
                     outputNextSample(outputBuffer, outputSampleIndex);
 
                     // TODO add ADSR envelope
@@ -172,6 +186,8 @@ public:
             {
                 for (int n = 0; n < numSamples; ++n )
                 {
+                    if (pWaveIndexRamp)
+                        setWaves(pWaveIndexRamp[outputSampleIndex]);
                     outputNextSample(outputBuffer, outputSampleIndex);
                 }
             }
@@ -182,9 +198,19 @@ public:
     /** Called to let the voice know that the pitch wheel has been moved.
         This will be called during the rendering callback, so must be fast and thread-safe.
     */
-    void pitchWheelMoved (int /*newPitchWheelValue*/) override 
+    void pitchWheelMoved (int newPitchWheelValue) override 
     {
-        // no pitch wheel impl yet
+        // Ramp to the new bend, rather than step, so coalesced pitch wheel
+        // changes (see juce_igutil::MidiCoalescer) don't zipper.
+        bendTarget = getPitchBendRatio(newPitchWheelValue);
+        if (waveCycleDelta <= 0.0 || bendRampSamples <= 1) {
+            bendRatio = bendTarget;
+            bendSamplesLeft = 0;
+        }
+        else {
+            bendStep = (bendTarget - bendRatio) / bendRampSamples;
+            bendSamplesLeft = bendRampSamples;
+        }
     }
 
     /** Called to let the voice know that a midi controller has been moved.
@@ -200,9 +226,8 @@ private:
     /**
      *  Set the low and high waves based on the current wavetable index.
      */
-    inline void setWaves(const std::atomic<float> * pIndex)
+    inline void setWaves(const float index)
     {
-        const float index = *pIndex;
         const int low = static_cast<int>( index );
         const int high = ceil(index);
         jassert(low >= 0);
@@ -217,6 +242,13 @@ private:
         jassert( ratioHighToLow < 1.000000000001 );
     }
 
+    // The frequency ratio for a pitch wheel position
+    static double getPitchBendRatio(const int pitchWheelPosition)
+    {
+        const double semitones = (pitchWheelPosition - 8192) / 8192.0 * config::pitchBendSemitones;
+        return std::pow(2.0, semitones / 12.0);
+    }
+
     // get the sample from a wave
     inline SAMPLE_TYPE getSampleFromWave(const juce::AudioBuffer<SAMPLE_TYPE> & wave) 
     {
@@ -235,6 +267,12 @@ private:
     {
         using namespace juce;
 
+        // follow the pitch bend ramp
+        if (bendSamplesLeft > 0) {
+            bendRatio = (--bendSamplesLeft == 0) ? bendTarget : bendRatio + bendStep;
+            waveCycleDelta = noteCycleDelta * bendRatio;
+        }
+
         // bump the index and wrap
         waveSampleIndex += waveCycleDelta;
         if (waveSampleIndex > (double)pLowWave->getNumSamples() ) {
@@ -264,10 +302,6 @@ private:
         if (tailOff > 0.0)
             currentSample *= tailOff;
 
-        if (currentSample > 0.99 || currentSample < -0.99) {
-            pMTL->error("ERROR - getNextSample() returned out-of-bounds value "+String(currentSample));
-        }
-
         return static_cast<SAMPLE_TYPE>(currentSample);
     }
 
@@ -295,6 +329,15 @@ private:
     double waveSampleIndex = 0.0;
     double waveCycleDelta = 0.0;
 
+    // The note's delta without pitch bend, and the bend, ramping to 
+    // bendTarget over bendRampSamples
+    double noteCycleDelta = 0.0;
+    double bendRatio = 1.0;
+    double bendTarget = 1.0;
+    double bendStep = 0.0;
+    int bendSamplesLeft = 0;
+    int bendRampSamples = 1;
+
     double level = 0.0;
     double tailOff = 0.0;
 
@@ -307,7 +350,7 @@ private:
     float ratioHighToLow = 1.0;
     const juce::AudioBuffer<SAMPLE_TYPE> * pHighWave;
 
-    // Params
-    const std::atomic<float> * pWavetableIndexParam;
+    // Params, as of the start of the block
+    std::shared_ptr<const ParameterSnapshot> pParams;
 };
 
@@ -4,11 +4,15 @@
 
 #include "juce_igutil/ConfigurableSynthAudioSource.h"
 #include "juce_igutil/EffectProcessor.h"
+#include "juce_igutil/PipelinedProcessor.h"
+#include "juce_igutil/SharedService.h"
 #include "juce_igutil/Processor.h"
 #include "WavetableSynthVoice.h"
 #include "Debug.h"
 #include "DelayProcessor.h"
 #include "EffectCreator.h"
+#include "LimiterProcessor.h"
+#include "ParameterSnapshot.h"
 
 using namespace config;
 using namespace effect_creator;
@@ -25,25 +29,18 @@ WavetableSynth::WavetableSynth(
     std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParameters,
     juce::SynthesiserSound::Ptr pSynthSound,
     std::deque<juce::AudioBuffer<WTSampleType>> wavetableToUse,
-    const int numVoices,
-    juce::MidiKeyboardState & keyState
+    const int numVoices
 ): 
     SynthAudioSource(),
     pMTL(_pMTL),
     pParams(pSynthParameters),
     wavetable(move(wavetableToUse)),
-    fxSetters(maxEffects)
+    fxSetters(maxEffects),
+    realtimeMemory(RealtimeMemory::Options{ lockRealtimeMemory })
 {
     // set up parameter links
     pMTL->info("WavetableSynth: Connecting parameters...");
-    pWavetableIndexParam = pParams->getRawParameterValue("waveIndex");
-    jassert(pWavetableIndexParam != nullptr);
-    for (int ix = 0; ix < maxEffects; ++ix) {
-        fxParams.push_back( FxParamGroup{
-            pParams->getRawParameterValue(getEffectPN(typeSelectorPN, ix)),
-            pParams->getRawParameterValue(getEffectPN(fxLevelPN, ix))
-        });
-    }
+    pParamSnapshot = make_shared<ParameterSnapshot>(*pParams);
 
     pMTL->info("WavetableSynth: Creating synth...");
 
@@ -53,22 +50,56 @@ WavetableSynth::WavetableSynth(
         synthVoices.push_back( new WavetableSynthVoice(
             pMTL
             ,wavetable 
-            ,pParams
+            ,pParamSnapshot
         ));
     }
 
+    pImpulseResponseLoader = make_shared<ImpulseResponseLoader>(pMTL, pParams);
+    // Background threads are shared by every synth in the process, so more
+    // instances don't mean more threads.  Both take work from any number of 
+    // audio threads.
+    pConvolutionTailWorker = SharedService<ConvolutionTailWorker>::get([]() {
+        return make_shared<ConvolutionTailWorker>();
+    });
+    pFxWorkerPool = SharedService<RealtimeWorkerPool>::get([]() {
+        return make_shared<RealtimeWorkerPool>(fxWorkerThreads);
+    });
+
     pFxSequence = make_shared<ProcessorSequence>();
     createEffects();
     // the effects sequence is set later.
 
+    // The limiter runs after the overall gain, so it sees the level that 
+    // goes out, and the effects can still be folded into that gain when 
+    // they're just a gain themselves.  It's in a sequence of its own so it's
+    // skipped once the output has been silent for its lookahead.
+    pLimiter = make_shared<LimiterProcessor>(
+        limiterCeiling, limiterLookaheadSeconds, limiterReleaseSeconds, limiterTruePeak);
+    shared_ptr<Processor> pFxProcessor = pFxSequence;
+
+    // When pipelined, the effects run on their own thread, and can only be
+    // changed between its blocks.
+    if (pipelinedFx) {
+        pMTL->info("WavetableSynth: Running the effects pipelined.");
+        pFxProcessor = make_shared<PipelinedProcessor>(
+            pFxProcessor, pipelinedFxChunkSamples, [this]() { updateEffects(); });
+    }
+
     pSynth.reset( new ConfigurableSynthAudioSource(
         pMTL, 
         pParams, 
         pSynthSound, 
         synthVoices,
-        keyState,
-        pFxSequence
+        pFxProcessor
     ));
+    pSynth->setOutputProcessor(make_shared<ProcessorSequence>(pLimiter));
+    pSynth->setControllerSubBlockSize(midiControllerSubBlockSize);
+    pSynth->setOutputClipLevel(outputClipLevel);
+    if (validateOutput) {
+        pOutputValidator = make_shared<BufferValidator>(outputClipLevel);
+        pOutputValidator->startReporting(pMTL, "WavetableSynth output", outputValidatorLogIntervalMs);
+        pSynth->setOutputValidator(pOutputValidator);
+    }
 }
 
 /**
@@ -79,14 +110,16 @@ void WavetableSynth::createEffects()
 {
     jassert(processorPool.empty() && "don't call this more than once.");
 
-    // Init the pool with an empty deque for every key.
+    // Init the pool with an empty vector for every key, with room for every
+    // effect of its type.
     for (int ifx = FIRST_EFFECT; ifx <= LAST_EFFECT; ++ifx ) {  
-        processorPool[static_cast<EffectType>(ifx)] = deque<ProcessorAndFxSetter>();
+        processorPool[static_cast<EffectType>(ifx)] = vector<ProcessorAndFxSetter>();
+        processorPool[static_cast<EffectType>(ifx)].reserve(maxEffects);
     }
 
     // Create shared null FX setter which doesn't do anything, this prevents an 
     // if check in setGain()
-    static FxSetterFunc nullFxSetter = [](int index){};
+    static FxSetterFunc nullFxSetter = [](float level){};
     auto pNullFxSetter = make_shared<FxSetter>();
     pNullFxSetter->fxGainSetter = nullFxSetter;
 
@@ -95,15 +128,39 @@ void WavetableSynth::createEffects()
         processorPool[NULL_EFFECT].push_back( 
             ProcessorAndFxSetter { make_shared<NullProcessor>(), pNullFxSetter } );
 
-        processorPool[CHORUS_EFFECT].push_back( createChorus(fxParams) );
-        processorPool[DELAY_EFFECT].push_back( createDelay(fxParams) );
-        processorPool[REVERB_EFFECT].push_back( createReverb(fxParams) );
-        processorPool[DISTORTION_EFFECT].push_back( createDistortion(fxParams) );
+        // The time based effects don't need the full rate at 96k and up; the
+        // distortions do, for their harmonics.
+        processorPool[CHORUS_EFFECT].push_back( atReducedRate(createChorus()) );
+        processorPool[DELAY_EFFECT].push_back( atReducedRate(createDelay()) );
+        processorPool[REVERB_EFFECT].push_back( atReducedRate(createReverb()) );
+        processorPool[CONVOLUTION_EFFECT].push_back( atReducedRate(createConvolutionReverb(
+            pImpulseResponseLoader, pConvolutionTailWorker)) );
+        processorPool[DISTORTION_EFFECT].push_back( createDistortion() );
+        processorPool[WAVESHAPER_EFFECT].push_back( createWaveshaper() );
+        processorPool[DELAY_REVERB_EFFECT].push_back( 
+            atReducedRate(createDelayReverb(pFxWorkerPool)) );
 
         // initialize this too, this is used in setEffectsSequence() to detect
         // the first time we init this.
         lastSelectedFxTypes.push_back(INVALID_EFFECT);
     }
+
+    for ( auto & mapItem : processorPool ) {
+        for ( auto & pfx : mapItem.second ) {
+            allEffects.push_back(pfx.pProcessor);
+        }
+    }
+}
+
+/**
+ * Message thread.  The effects are polled directly rather than through the
+ * FX sequence, whose slots the audio thread changes.
+ */
+void WavetableSynth::handlePendingUpdates()
+{
+    for ( auto & pEffect : allEffects ) {
+        pEffect->handlePendingUpdates();
+    }
 }
 
 /**
@@ -112,7 +169,7 @@ void WavetableSynth::createEffects()
  */
 const EffectType WavetableSynth::getEffectiveFxType(const int index) 
 {
-    int t = static_cast<int>(*(fxParams.at(index).pTypeSelector));
+    int t = static_cast<int>(pParamSnapshot->get().fxType[index]);
 
     if (t < FIRST_REAL_EFFECT ) {
         t = NULL_EFFECT;
@@ -138,6 +195,10 @@ void WavetableSynth::setEffectsSequence()
     //}
     //pMTL->debug(debugSS.str());
 
+    if ((pendingFxChanges & ParameterSnapshot::anyFxTypeChanged) == 0) {
+        return;
+    }
+
     // check for changed effects and put in place the correct processor.
     for ( int ix = 0; ix < maxEffects; ++ix ) 
     {
@@ -147,25 +208,34 @@ void WavetableSynth::setEffectsSequence()
         // If it was never set, or if the effect type changed from previous, update it
         if (INVALID_EFFECT == lastFxType || fxType != lastFxType) 
         {
-            // get an unused one from the pool and reset it
-            deque<ProcessorAndFxSetter> pnf = processorPool.at(fxType);
-            //int size = pProcs->size();
-            shared_ptr<Processor> pNewEffect(pnf.front().pProcessor);
-            shared_ptr<FxSetter> pFxSetter(pnf.front().pFxSetter);
-            pnf.pop_front();
+            // get an unused one from the pool and reset it.  (Take it out of 
+            // the pool itself, not a copy, or every slot of the same type 
+            // would end up sharing one processor.)
+            vector<ProcessorAndFxSetter> & pnf = processorPool.at(fxType);
+            jassert(!pnf.empty());
+            shared_ptr<Processor> pNewEffect(std::move(pnf.back().pProcessor));
+            shared_ptr<FxSetter> pFxSetter(std::move(pnf.back().pFxSetter));
+            pnf.pop_back();
             pNewEffect->reset();
+            pNewEffect->setActive(true);
+            pFxSetter->fxGainSetter(pParamSnapshot->get().fxLevel[ix]);
             // put the new items in place
             auto pOldProc = 
                 pFxSequence->replaceProcessor(ix, pNewEffect);
             auto pOldFxSetter = fxSetters[ix];
             fxSetters[ix] = pFxSetter;
-            // and add the replaced ones back to the pool.
-            // (only if we replaced one)
+            // and add the replaced ones back to the pool they came from.
+            // (only if we replaced one)  There's always room, as it was
+            // taken from there.
             if (pOldProc || pOldFxSetter) {
                 jassert(pOldProc);
                 jassert(pOldFxSetter);
-                processorPool[fxType].push_back(
-                    ProcessorAndFxSetter{pOldProc, pOldFxSetter}
+                jassert(INVALID_EFFECT != lastFxType);
+                pOldProc->setActive(false);
+                vector<ProcessorAndFxSetter> & oldPnf = processorPool.at(lastFxType);
+                jassert(oldPnf.size() < oldPnf.capacity());
+                oldPnf.push_back(
+                    ProcessorAndFxSetter{std::move(pOldProc), std::move(pOldFxSetter)}
                 );
             }
 
@@ -178,9 +248,23 @@ void WavetableSynth::setEffectsSequence()
 /**
  * Prepare the synth for audio generation
  */
-void WavetableSynth::prepareToPlay(const juce::dsp::ProcessSpec & spec)
+void WavetableSynth::prepareToPlay(const juce::dsp::ProcessSpec & hostSpec)
 {
+    // the buffers are about to be reallocated
+    realtimeMemory.release();
+
     setEffectsSequence();
+    applyNonRealtime();
+
+    // Everything below only ever sees a micro-block at a time.
+    const dsp::ProcessSpec spec{
+        hostSpec.sampleRate,
+        static_cast<juce::uint32>(microBlockSize),
+        hostSpec.numChannels
+    };
+    microBlockMidi.ensureSize(microBlockMidiBytes);
+    midiCoalescer.prepare(getMidiControllerWindowSamples(spec.sampleRate), coalescedMidiBytes);
+    pParamSnapshot->prepare(spec.sampleRate, microBlockSize);
 
     // Call prepare() on all the effects in the pool, so they know what's up
     // even though they might not be set in the FX processor yet.
@@ -192,16 +276,69 @@ void WavetableSynth::prepareToPlay(const juce::dsp::ProcessSpec & spec)
 
     processSpec = spec;
     pSynth->prepareToPlay(processSpec);
+
+    makeResident();
+}
+
+/**
+ * Write to every page of every effect's buffers, in a slot or not, and the 
+ * wavetable, so the audio thread doesn't take page faults on the first notes
+ * or the first time an effect is put in a slot.  Then render some silence 
+ * through all of it, so the code and data are in the caches.
+ */
+void WavetableSynth::makeResident()
+{
+    for ( auto & mapItem : processorPool ) {
+        for ( auto & pfx : mapItem.second ) {
+            pfx.pProcessor->prefault(realtimeMemory);
+        }
+    }
+    pSynth->prefault(realtimeMemory);
+    for ( auto & wave : wavetable ) {
+        realtimeMemory.add(wave);
+    }
+
+    // The effects are run directly: a sequence would skip them, as their 
+    // input is silent.  Each is reset afterwards, as it is when it's put in a
+    // slot.
+    AudioBuffer<float> scratch(
+        static_cast<int>(processSpec.numChannels), 
+        static_cast<int>(processSpec.maximumBlockSize));
+    auto warmUp = [&scratch](Processor & processor) {
+        for (int block = 0; block < warmUpMicroBlocks; ++block) {
+            scratch.clear();
+            dsp::AudioBlock<float> audioBlock(scratch);
+            dsp::ProcessContextReplacing<float> context(audioBlock);
+            processor.process(context);
+        }
+        processor.reset();
+    };
+    for ( auto & mapItem : processorPool ) {
+        for ( auto & pfx : mapItem.second ) {
+            warmUp(*pfx.pProcessor);
+        }
+    }
+    for ( int ix = 0; ix < pFxSequence->getProcessorsCount(); ++ix ) {
+        warmUp(*pFxSequence->getExactProcessor<Processor>(ix));
+    }
+    pFxSequence->reset();
+    warmUp(*pLimiter);
+    pSynth->warmUpVoices(warmUpMicroBlocks);
+
+    pMTL->info("WavetableSynth: realtime memory: " + RealtimeMemory::describe(realtimeMemory.getStats()) + ".");
 }
 
 /**
- * Set the level for all the gain processors according to the parameters.
+ * Set the level for the gain processors whose parameters changed.  (Effects
+ * get their level when they're put in a slot.)
  */
 void WavetableSynth::setGain() 
 {
+    const auto & params = pParamSnapshot->get();
     for ( int ix = 0; ix < maxEffects; ++ix ) {
-        auto setter = fxSetters[ix]->fxGainSetter;
-        setter(ix);
+        if ((pendingFxChanges & ParameterSnapshot::fxLevelChanged(ix)) != 0) {
+            fxSetters[ix]->fxGainSetter(params.fxLevel[ix]);
+        }
     }
 }
 
@@ -213,49 +350,147 @@ void WavetableSynth::renderNextBlock(
     juce::MidiBuffer & inputMidi,
     int startSample)
 {
-    setEffectsSequence();
+    // Render in micro-blocks, each with its own slice of the midi (its 
+    // controllers thinned out first).  The micro-block buffers refer to 
+    // outputAudio rather than copying it.
+    const int numSamples = outputAudio.getNumSamples();
+    const MidiBuffer & blockMidi = midiCoalescer.process(inputMidi);
+    float peak = 0.0f;
+    for (int start = 0; start < numSamples; start += microBlockSize) {
+        const int count = jmin(microBlockSize, numSamples - start);
+        pParamSnapshot->update(count);
+        pendingFxChanges |= pParamSnapshot->get().changed;
+
+        // The pipeline does this itself, once a chunk, when the effects
+        // thread is done with the previous one.
+        if (!pipelinedFx) {
+            updateEffects();
+        }
+
+        AudioBuffer<float> microBlock(
+            outputAudio.getArrayOfWritePointers(), 
+            outputAudio.getNumChannels(), 
+            start, 
+            count);
+        sliceMidi(blockMidi, start, count);
+        pSynth->renderNextBlock(microBlock, microBlockMidi, 0);
+        peak = jmax(peak, pSynth->getOutputLevels().peak);
+    }
+    if (peak > outputClipLevel) {
+        clippedBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Copy the midi events for a micro-block into microBlockMidi, with their 
+ * times relative to the start of it.
+ */
+void WavetableSynth::sliceMidi(
+    const juce::MidiBuffer & inputMidi, 
+    const int start, 
+    const int count)
+{
+    microBlockMidi.clear();
+    for (auto it = inputMidi.findNextSamplePosition(start); it != inputMidi.cend(); ++it) {
+        const auto metadata = *it;
+        if (metadata.samplePosition >= start + count) 
+            break;
+        microBlockMidi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition - start);
+    }
+}
 
+/**
+ * Apply the effect selections, offline mode and levels
+ */
+void WavetableSynth::updateEffects()
+{
+    setEffectsSequence();
+    applyNonRealtime();
     setGain();
+    pendingFxChanges = 0;
+}
 
-    pSynth->renderNextBlock(outputAudio, inputMidi, startSample);
-    clampOutput(outputAudio);
+/**
+ * Idle fast path.  Parameter changes made while idle (effect types, gain) are
+ * picked up by the first renderNextBlock() after it.
+ */
+bool WavetableSynth::renderIdleBlock(
+    juce::AudioBuffer<float> & outputAudio,
+    juce::MidiBuffer & inputMidi,
+    int startSample)
+{
+    return pSynth->renderIdleBlock(outputAudio, inputMidi, startSample);
 }
 
 /**
- * release resources
+ * Latency of the current effects
  */
-void WavetableSynth::releaseResources()
+int WavetableSynth::getLatencySamples()
 {
-    pSynth->releaseResources();
+    return pSynth->getLatencySamples();
 }
 
-// Manually enforce the output to be within normal limits in case the resonance 
-// gets out of hand.  TODO a better way would be to simulate some analog clipping.
-void WavetableSynth::clampOutput(juce::AudioBuffer<float> & outputAudio, bool silent)
+/**
+ * Request realtime or offline rendering.  This can come from any thread, so
+ * it's only recorded here and applied on the audio thread.
+ */
+void WavetableSynth::setNonRealtime(const bool isNonRealtime)
 {
-    static const float highestAllowed = 0.97f;
-    std::stringstream errors;
-
-    for (int chan = 0; chan < outputAudio.getNumChannels(); ++chan) {
-        const float * p = outputAudio.getReadPointer(chan);
-        for (int ix=0; ix<outputAudio.getNumSamples(); ++ix, ++p) {
-            if ( *p < -highestAllowed || *p > highestAllowed ) {
-                if ( !silent ) {
-                    errors << "ERROR: sample out of bounds (" << *p << "), channel (" << chan << "), index (" << ix << ")" << endl;
-                }
-                float newValue = highestAllowed;
-                if (*p < 0) {
-                    newValue = -highestAllowed;
-                }
-                *(outputAudio.getWritePointer(chan, ix)) = newValue;
-            }
-        }
+    nonRealtime.store(isNonRealtime);
+}
+
+/**
+ * Pass a realtime/offline change on to all the processors, in use or not.
+ */
+void WavetableSynth::applyNonRealtime()
+{
+    const bool isNonRealtime = nonRealtime.load();
+    if (isNonRealtime == appliedNonRealtime) {
+        return;
     }
-    std::string errorsStr = errors.str();
-    if ( ! errorsStr.empty() ) {
-        pMTL->debug(String(errorsStr));
+    appliedNonRealtime = isNonRealtime;
+
+    for ( auto & mapItem : processorPool ) {
+        for ( auto & pfx : mapItem.second ) {
+            pfx.pProcessor->setNonRealtime(isNonRealtime);
+        }
     }
+    pSynth->setNonRealtime(isNonRealtime);
 }
 
+/**
+ * The output is tapped after the gain and clipping, one micro-block at a time.
+ */
+void WavetableSynth::setOutputTap(
+    std::function<void(const float * pSamples, int numSamples)> tap,
+    const int channel)
+{
+    pSynth->setOutputTap(std::move(tap), channel);
+}
 
+/**
+ * release resources
+ */
+void WavetableSynth::releaseResources()
+{
+    pSynth->releaseResources();
+    logOutputDiagnostics();
+}
 
+/**
+ * Log what the limiter and the clipping have had to do since last time.  Not
+ * from the audio thread.
+ */
+void WavetableSynth::logOutputDiagnostics()
+{
+    const auto limiter = pLimiter->getDiagnostics();
+    const int clipped = clippedBlocks.exchange(0);
+    pLimiter->resetDiagnostics();
+    if (limiter.limitedSamples > 0) {
+        pMTL->info("WavetableSynth: the limiter reduced the gain for " + String(limiter.limitedSamples) 
+            + " samples, by up to " + String(limiter.maxGainReductionDb, 1) + "dB.");
+    }
+    if (clipped > 0) {
+        pMTL->info("WavetableSynth: the output was clipped in " + String(clipped) + " blocks.");
+    }
+}
@@ -12,12 +12,20 @@
 
 #include <JuceHeader.h>
 
+#include "juce_igutil/BufferValidator.h"
 #include "juce_igutil/ConfigurableSynthAudioSource.h"
+#include "juce_igutil/MidiCoalescer.h"
 #include "juce_igutil/MTLogger.h"
 #include "juce_igutil/ProcessorSequence.h"
+#include "juce_igutil/RealtimeMemory.h"
+#include "juce_igutil/RealtimeWorkerPool.h"
 #include "juce_igutil/SynthAudioSource.h"
 #include "Config.h"
+#include "ConvolutionTailWorker.h"
 #include "EffectUtil.h"
+#include "ImpulseResponseLoader.h"
+#include "LimiterProcessor.h"
+#include "ParameterSnapshot.h"
 
 /**
  * ConfigurableSynthAudioSource
@@ -34,8 +42,7 @@ public:
         std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParameters,
         juce::SynthesiserSound::Ptr pSynthSound,
         std::deque<juce::AudioBuffer<config::WTSampleType>> wavetableToUse,
-        const int numVoices,
-        juce::MidiKeyboardState & keyState // todo is this the best place for this?
+        const int numVoices
     );
 
     // destructor
@@ -50,6 +57,12 @@ public:
         juce::MidiBuffer& inputMidi,
         int startSample) override;
 
+    // Idle fast path: just clear the block while nothing's sounding
+    bool renderIdleBlock(
+        juce::AudioBuffer<float>& outputAudio,
+        juce::MidiBuffer& inputMidi,
+        int startSample) override;
+
     // release resources
     void releaseResources() override;
 
@@ -57,11 +70,36 @@ public:
     std::shared_ptr<juce::AudioProcessorValueTreeState> getSynthParams() override {
         return pSynth->getSynthParams();
     }
+
+    // Latency of the current effects
+    int getLatencySamples() override;
+
+    // Switch the effects between their realtime and offline settings.  The 
+    // change is applied at the start of the next block.
+    void setNonRealtime(const bool isNonRealtime) override;
+
+    // Tap the final output of a channel
+    void setOutputTap(
+        std::function<void(const float * pSamples, int numSamples)> tap,
+        const int channel = 0) override;
+
+    // Let every effect, in a slot or not, do what it's asked for on the
+    // message thread
+    void handlePendingUpdates() override;
+
+    // What prepareToPlay() made resident
+    juce_igutil::RealtimeMemory::Stats getRealtimeMemoryStats() const override {
+        return realtimeMemory.getStats();
+    }
  
 private:
 
-    // manually enforce the output to be within normal limits in case of error.
-    void clampOutput(juce::AudioBuffer<float> & outputAudio, bool silent=false);
+    // Make everything the audio thread uses resident, and warm it up.
+    void makeResident();
+
+    // Log what the limiter and the output clipping have done.  Not from the 
+    // audio thread.
+    void logOutputDiagnostics();
 
     // Create efects objects ahead of time so there is no object creation penalty
     // when they are switched.
@@ -73,18 +111,34 @@ private:
     // get the effective FX type based on the selected (or not selected) type
     inline const config::EffectType getEffectiveFxType(const int index);
 
-    // prior to rendering, set the gain for each proc from the gain params.
+    // prior to rendering, set the gain for each proc whose gain param changed.
     inline void setGain();
 
+    // pass a realtime/offline change on to all the processors.
+    void applyNonRealtime();
+
+    // Apply the effect selections, offline mode and levels for the next 
+    // block.  Only while the effects aren't running.
+    void updateEffects();
+
+    // Copy a micro-block's midi events into microBlockMidi.
+    void sliceMidi(const juce::MidiBuffer & inputMidi, const int start, const int count);
+
     // logger
     std::shared_ptr<juce_igutil::MTLogger> pMTL;
 
     // cached synth parameters from value tree
     std::shared_ptr<juce::AudioProcessorValueTreeState> pParams;
-    std::atomic<float> * pWavetableIndexParam = nullptr;
-    std::deque<FxParamGroup> fxParams;
     std::deque<config::EffectType> lastSelectedFxTypes;
 
+    // The parameters as of the start of the micro-block, shared with the 
+    // voices.
+    std::shared_ptr<ParameterSnapshot> pParamSnapshot;
+
+    // The snapshot's change bits since the effects were last updated, which
+    // is every micro-block, or every chunk when they're pipelined.
+    juce::uint32 pendingFxChanges = ~0u;
+
     // Wrapped synth:
     std::unique_ptr<juce_igutil::ConfigurableSynthAudioSource> pSynth;
 
@@ -94,16 +148,57 @@ private:
     // Process spec
     juce::dsp::ProcessSpec processSpec{0,0,0};
 
-    // The unused processors we have available.
+    // The unused processors we have available.  Each type's vector has room
+    // for all of that type, so the audio thread can put them back without
+    // allocating.
     // FxSetterFunc: the fxSlot (index) is passed in to get the right param.
     std::map<
         config::EffectType, 
-        std::deque<ProcessorAndFxSetter>
+        std::vector<ProcessorAndFxSetter>
     > processorPool;
 
+    // Every effect, wherever it is.  Fixed once the effects are created, so
+    // the message thread can go through it while the audio thread moves them
+    // between the pool and the slots.
+    std::vector<std::shared_ptr<juce_igutil::Processor>> allEffects;
+
+    // Background threads for the convolution reverb, shared by all of its
+    // instances.
+    std::shared_ptr<ImpulseResponseLoader> pImpulseResponseLoader;
+    std::shared_ptr<ConvolutionTailWorker> pConvolutionTailWorker;
+
+    // Threads for running parallel effect branches
+    std::shared_ptr<juce_igutil::RealtimeWorkerPool> pFxWorkerPool;
+
+    // The midi for the micro-block being rendered, and the space reserved for
+    // it so adding events doesn't allocate.
+    static const int microBlockMidiBytes = 4096;
+    juce::MidiBuffer microBlockMidi;
+
+    // Thins out the block's controllers before it's sliced up
+    static const int coalescedMidiBytes = 16384;
+    juce_igutil::MidiCoalescer midiCoalescer;
+
     // FX processor sequence.
     std::shared_ptr<juce_igutil::ProcessorSequence> pFxSequence;
 
+    // Output limiter, after the effects
+    std::shared_ptr<LimiterProcessor> pLimiter;
+
+    // Checks the output for bad samples
+    std::shared_ptr<juce_igutil::BufferValidator> pOutputValidator;
+
+    // Blocks the output stage had to clip, counted on the audio thread
+    std::atomic<int> clippedBlocks { 0 };
+
     // FxSetters for every FX slot.  Corresponds to the fX sequence above.
     std::deque<std::shared_ptr<FxSetter>> fxSetters;
+
+    // Prefaults (and maybe locks) the buffers at prepare time
+    juce_igutil::RealtimeMemory realtimeMemory;
+
+    // Offline rendering as requested by the host, and as last applied to the 
+    // processors from the audio thread.
+    std::atomic<bool> nonRealtime { false };
+    bool appliedNonRealtime = false;
 };
@@ -9,8 +9,10 @@
 #include "juce_igutil/NullProcessor.h"
 #include "juce_igutil/Oscillator.h"
 #include "juce_igutil/Processor.h"
+#include "juce_igutil/ProcessorSequence.h"
 
 #include "Config.h"
+#include "ParameterSnapshot.h"
 #include "UnlimitedSynthSound.h"
 #include "WavetableOscillator.h"
 
@@ -28,21 +30,19 @@ public:
     WavetableSynthVoice(
         std::shared_ptr<juce_igutil::MTLogger> _pMTL,
         const std::deque<juce::AudioBuffer<SAMPLE_TYPE>> & waveTableInUse, 
-        std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParams
+        std::shared_ptr<const ParameterSnapshot> pParameterSnapshot
     ): 
         juce::SynthesiserVoice(),
         pMTL(_pMTL),
         processSpec{48000.0, 0, 0},
         pOscillator(std::make_unique<WavetableOscillator>(
             _pMTL,
-            pSynthParams, 
+            pParameterSnapshot, 
             waveTableInUse
-        ))
+        )),
+        pParams(pParameterSnapshot)
     {
         using namespace juce;
-        
-        pCutoffParam = pSynthParams->getRawParameterValue(config::cutoffPN);
-        pResonanceParam = pSynthParams->getRawParameterValue(config::resonancePN);
 
         // Create the filter processor
         pFilter = std::make_shared<FilterType>();
@@ -52,7 +52,17 @@ public:
         pFilter->setResonance(0.7f);
         pFilter->setMode(dsp::LadderFilterMode::LPF24);
 
-        pFxProcessor = std::make_unique<juce_igutil::EffectProcessor<FilterType>>(pFilter);
+        // In a sequence so the filter can be skipped (with a crossfade) when
+        // it's wide open.
+        auto pFilterProc = std::make_shared<juce_igutil::EffectProcessor<FilterType>>(pFilter);
+        pFilterProc->setPureGainFunc( [this](float & gain) {
+            const auto & params = pParams->get();
+            if (params.cutoff < config::filterOpenCutoffHz || params.resonance > 0.0f)
+                return false;
+            gain = 1.0f;
+            return true;
+        });
+        pFxProcessor = std::make_unique<juce_igutil::ProcessorSequence>(pFilterProc);
     }
 
     // Default destructor
@@ -70,12 +80,15 @@ public:
     virtual void setCurrentPlaybackSampleRate (double newRate) override {
         juce::SynthesiserVoice::setCurrentPlaybackSampleRate(newRate);
 
-        // The actual channels are determined by the current output AudioBuffer.
-        // The WavetableOscillator does not depend on anything other than the 
-        // sample rate.
-        processSpec = juce::dsp::ProcessSpec{ newRate, 4096, 2 };
+        // The synth renders in micro-blocks, so that's the most the voice is
+        // ever asked for at once.
+        processSpec = juce::dsp::ProcessSpec{ 
+            newRate, static_cast<juce::uint32>(config::microBlockSize), 2 };
         pOscillator->prepare(processSpec);
         pFxProcessor->prepare(processSpec);
+        voiceBuffer.setSize(
+            static_cast<int>(processSpec.numChannels), 
+            static_cast<int>(processSpec.maximumBlockSize));
     }
 
     /**
@@ -88,6 +101,8 @@ public:
         int currentPitchWheelPosition
     ) override 
     {
+        // The filter settings may have changed while the voice was idle.
+        setFilter();
         pOscillator->startNote(midiNoteNumber, velocity, currentPitchWheelPosition);
     }
 
@@ -127,17 +142,35 @@ public:
     {
         using namespace juce;
 
-        // set cutoff and resonance before processing
-        pFilter->setCutoffFrequencyHz(*pCutoffParam);
-        pFilter->setResonance(*pResonanceParam);
+        // set cutoff and resonance before processing, if they've changed
+        if (pParams->hasChanged(ParameterSnapshot::cutoffChanged | ParameterSnapshot::resonanceChanged))
+            setFilter();
 
-        if (pOscillator->renderNextBlock(outputBuffer, startSample, numSamples))
-            clearCurrentNote();
+        // Render into the voice's own buffer so the effects only see this
+        // voice, then add it to the output.  The output is one micro-block,
+        // and the voice buffer keeps its sample positions so they line up
+        // with the parameter ramps.
+        jassert(startSample + numSamples <= voiceBuffer.getNumSamples());
+        const int numChannels = jmin(outputBuffer.getNumChannels(), voiceBuffer.getNumChannels());
+        voiceBuffer.clear(startSample, numSamples);
+        const bool finished = pOscillator->renderNextBlock(voiceBuffer, startSample, numSamples);
 
         // Run the effects
-        dsp::AudioBlock<float> block(outputBuffer);
-        dsp::ProcessContextReplacing<float> context(block);
+        dsp::AudioBlock<float> block(
+            voiceBuffer.getArrayOfWritePointers(), 
+            static_cast<size_t>(numChannels), 
+            static_cast<size_t>(startSample + numSamples));
+        auto voiceBlock = block.getSubBlock(
+            static_cast<size_t>(startSample), static_cast<size_t>(numSamples));
+        dsp::ProcessContextReplacing<float> context(voiceBlock);
         pFxProcessor->process(context);
+
+        for (int chan = 0; chan < numChannels; ++chan) {
+            outputBuffer.addFrom(chan, startSample, voiceBuffer, chan, startSample, numSamples);
+        }
+
+        if (finished)
+            clearCurrentNote();
     }
 
     /** A double-precision version of renderNextBlock() */
@@ -148,19 +181,31 @@ public:
     ) override
     {
         // Supporting 64bit is not supported...
-        pMTL->error("ERROR - calling 64-bit (double precision) version of WavetableSynthVoice::renderNextBlock() is not supported (yet)."); 
+        pMTL->log("ERROR - calling 64-bit (double precision) version of WavetableSynthVoice::renderNextBlock() is not supported (yet)."); 
         jassert(false);
     }
 
 private:
 
+    // Apply the cutoff and resonance
+    void setFilter()
+    {
+        const auto & params = pParams->get();
+        pFilter->setCutoffFrequencyHz(params.cutoff);
+        pFilter->setResonance(params.resonance);
+    }
+
     // logger
     std::shared_ptr<juce_igutil::MTLogger> pMTL;
 
     // The process spec.  Set via setCurrentPlaybackSampleRate() override.  
-    // Only samplerate is set.  Size of buffer is determined by the buffer itself.
+    // The block size is one micro-block.
     juce::dsp::ProcessSpec processSpec;
 
+    // This voice's samples, before they're added to the output.  One 
+    // micro-block.
+    juce::AudioBuffer<float> voiceBuffer;
+
     // Oscillator
     // TODO add abilitiy for multiple oscillators per voice (a la P12)
     std::unique_ptr<juce_igutil::Oscillator> pOscillator;
@@ -175,9 +220,8 @@ private:
     using FilterType = juce::dsp::LadderFilter<float>;
     std::shared_ptr<FilterType> pFilter;
 
-    // Per-voice Params
-    const std::atomic<float> * pCutoffParam;
-    const std::atomic<float> * pResonanceParam;
+    // Params, as of the start of the block
+    std::shared_ptr<const ParameterSnapshot> pParams;
 };
 
 
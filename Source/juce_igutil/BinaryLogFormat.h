@@ -0,0 +1,109 @@
+/**
+ * The layout of MTLogger's binary log files, shared by BinaryLogSink and the
+ * offline decoder (tools/mtlogdecode).  Only uses the standard library, so the
+ * decoder doesn't need Juce.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace juce_igutil {
+namespace binarylog {
+
+// A log file is a FileHeader followed by records.  Each record starts with a
+// one byte RecordType; the fields after it are listed with each type.  Numbers
+// are in the writer's byte order (little endian everywhere this is built).
+static const char magic[4] = { 'M', 'T', 'L', 'B' };
+static const std::uint32_t version = 2;
+
+// The tag id of a message without a tag
+static const std::uint16_t noTag = 0xffff;
+
+struct FileHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    // for turning record ticks into seconds
+    std::int64_t ticksPerSecond;
+    // the logger's start, in ticks and in milliseconds since 1970
+    std::int64_t startTicks;
+    std::int64_t startTimeMs;
+};
+
+enum RecordType: std::uint8_t
+{
+    // uint16 id, uint16 length, the text of a format or a tag.  Comes before
+    // the first record that uses the id in the same file.
+    stringDefinition = 1,
+    // int64 ticks, uint16 tag id, uint16 length, the message's UTF-8 text
+    textMessage = 2,
+    // int64 ticks, uint16 tag id, uint16 format id, uint8 number of args,
+    // then each arg as a uint8 ArgType and 8 bytes (an int64 or a double)
+    formattedMessage = 3,
+    // int64 ticks, uint32 number of messages dropped
+    droppedMessages = 4
+};
+
+enum ArgType: std::uint8_t
+{
+    integerArg = 0,
+    realArg = 1
+};
+
+// A number to go in a format
+struct Arg
+{
+    bool isInteger;
+    std::int64_t integer;
+    double real;
+};
+
+/**
+ * Replace each "{}" in a format with the next arg.  Used for writing text logs
+ * and for decoding binary ones, so both read the same.
+ */
+inline std::string formatMessage(const char * format, const Arg * args, const int numArgs)
+{
+    std::string text;
+    int nextArg = 0;
+    for (const char * p = format; *p != 0; ++p) {
+        if (p[0] == '{' && p[1] == '}' && nextArg < numArgs) {
+            const Arg & arg = args[nextArg++];
+            char number[32];
+            if (arg.isInteger) {
+                std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(arg.integer));
+            }
+            else {
+                std::snprintf(number, sizeof(number), "%g", arg.real);
+            }
+            text += number;
+            ++p;
+        }
+        else {
+            text += *p;
+        }
+    }
+    return text;
+}
+
+/**
+ * A record's time since the logger started, and its tag if it has one, as
+ * they're shown in the logs.
+ */
+inline std::string formatPrefix(const std::int64_t ticks, const FileHeader & header, const char * tag)
+{
+    char time[32];
+    std::snprintf(time, sizeof(time), "[%.3f] ",
+        static_cast<double>(ticks - header.startTicks) / static_cast<double>(header.ticksPerSecond));
+    std::string prefix(time);
+    if (tag != nullptr) {
+        prefix = prefix + "[" + tag + "] ";
+    }
+    return prefix;
+}
+
+}
+}
@@ -0,0 +1,227 @@
+#include "BinaryLogSink.h"
+
+using namespace juce;
+using namespace juce_igutil;
+using namespace std;
+
+/**
+ * Constructor
+ */
+BinaryLogSink::BinaryLogSink(
+    const File & file,
+    const int64 maxFileBytes,
+    const int maxFiles
+) :
+    logFile(file),
+    maxBytes(maxFileBytes),
+    numFiles(jmax(1, maxFiles))
+{
+    std::memcpy(header.magic, binarylog::magic, sizeof(header.magic));
+    header.version = binarylog::version;
+    header.ticksPerSecond = Time::getHighResolutionTicksPerSecond();
+    header.startTicks = Time::getHighResolutionTicks();
+    header.startTimeMs = Time::currentTimeMillis();
+
+    batch.reserve(batchBytes + 1024);
+    logFile.getParentDirectory().createDirectory();
+    if (logFile.exists()) {
+        rotate();
+    }
+    else {
+        openFile();
+    }
+}
+
+/**
+ * Destructor
+ */
+BinaryLogSink::~BinaryLogSink()
+{
+    flush();
+}
+
+/**
+ * A message logged as text
+ */
+void BinaryLogSink::writeText(const int64 ticks, const char * tag, const char * pText, const size_t numBytes)
+{
+    const uint16 length = static_cast<uint16>(jmin(numBytes, static_cast<size_t>(0xffff)));
+    makeRoom(1 + sizeof(int64) + 2 * sizeof(uint16) + length, tag, nullptr);
+    const uint16 tagId = getId(tag);
+    put(binarylog::textMessage);
+    put(ticks);
+    put(tagId);
+    put(length);
+    putBytes(pText, length);
+}
+
+/**
+ * A message logged with a format and numbers.  The format and the tag are
+ * identified by their pointers (string literals, and kept by the logger).
+ */
+void BinaryLogSink::writeFormatted(
+    const int64 ticks,
+    const char * tag,
+    const char * format,
+    const binarylog::Arg * pArgs,
+    const int numArgs
+)
+{
+    if (stringIds.size() >= binarylog::noTag - 2) {
+        // out of ids; write it out as text instead
+        const string text = binarylog::formatMessage(format, pArgs, numArgs);
+        writeText(ticks, tag, text.c_str(), text.size());
+        return;
+    }
+
+    makeRoom(1 + sizeof(int64) + 2 * sizeof(uint16) + 1 + numArgs * (1 + sizeof(int64)), tag, format);
+    const uint16 tagId = getId(tag);
+    const uint16 formatId = getId(format);
+    put(binarylog::formattedMessage);
+    put(ticks);
+    put(tagId);
+    put(formatId);
+    put(static_cast<uint8>(numArgs));
+    for (int ix = 0; ix < numArgs; ++ix) {
+        if (pArgs[ix].isInteger) {
+            put(binarylog::integerArg);
+            put(pArgs[ix].integer);
+        }
+        else {
+            put(binarylog::realArg);
+            put(pArgs[ix].real);
+        }
+    }
+}
+
+/**
+ * The size of a definition of text, or 0 if it's already defined or null.
+ */
+size_t BinaryLogSink::getDefinitionBytes(const char * text) const
+{
+    if (text == nullptr || stringIds.count(text) > 0)
+        return 0;
+    return 1 + 2 * sizeof(uint16) + jmin(strlen(text), static_cast<size_t>(0xffff));
+}
+
+/**
+ * text's id, defining it in the file if it's the first time it's been seen.
+ * Call after makeRoom(), which may start a new file with nothing defined.
+ */
+uint16 BinaryLogSink::getId(const char * text)
+{
+    if (text == nullptr)
+        return binarylog::noTag;
+
+    auto it = stringIds.find(text);
+    if (it != stringIds.end())
+        return it->second;
+
+    const uint16 id = static_cast<uint16>(stringIds.size());
+    const uint16 length = static_cast<uint16>(jmin(strlen(text), static_cast<size_t>(0xffff)));
+    stringIds.emplace(text, id);
+    put(binarylog::stringDefinition);
+    put(id);
+    put(length);
+    putBytes(text, length);
+    return id;
+}
+
+/**
+ * Messages that didn't fit in the logger's queue
+ */
+void BinaryLogSink::writeDropped(const int64 ticks, const uint32 count)
+{
+    makeRoom(1 + sizeof(int64) + sizeof(uint32));
+    put(binarylog::droppedMessages);
+    put(ticks);
+    put(count);
+}
+
+/**
+ * Write the batch to the file, in one write (the stream has no buffer of its
+ * own).
+ */
+void BinaryLogSink::flush()
+{
+    if (batch.empty())
+        return;
+    if (pStream != nullptr && pStream->openedOk()) {
+        pStream->write(batch.data(), batch.size());
+    }
+    fileBytes += static_cast<int64>(batch.size());
+    batch.clear();
+}
+
+/**
+ * Make room in the batch and the file for a record, writing the batch out
+ * if it's full and starting a new file if the record would take this one
+ * over its limit.
+ */
+void BinaryLogSink::makeRoom(const size_t recordBytes)
+{
+    const int64 currentBytes = fileBytes + static_cast<int64>(batch.size());
+    if (currentBytes + static_cast<int64>(recordBytes) > maxBytes
+        && currentBytes > static_cast<int64>(sizeof(header))) {
+        flush();
+        rotate();
+    }
+    else if (batch.size() + recordBytes > batchBytes) {
+        flush();
+    }
+}
+
+/**
+ * A new file has nothing defined in it, so if the first makeRoom() started
+ * one, the definitions are counted again.  Otherwise the second one finds
+ * there's already room.
+ */
+void BinaryLogSink::makeRoom(const size_t messageBytes, const char * tag, const char * format)
+{
+    makeRoom(getDefinitionBytes(tag) + getDefinitionBytes(format) + messageBytes);
+    makeRoom(getDefinitionBytes(tag) + getDefinitionBytes(format) + messageBytes);
+}
+
+/**
+ * Move the current file and the older ones along, dropping the oldest, and
+ * start a new file.
+ */
+void BinaryLogSink::rotate()
+{
+    pStream.reset();
+    getRotatedFile(numFiles - 1).deleteFile();
+    for (int ix = numFiles - 2; ix >= 0; --ix) {
+        const File older = getRotatedFile(ix);
+        if (older.exists()) {
+            older.moveFileTo(getRotatedFile(ix + 1));
+        }
+    }
+    openFile();
+}
+
+/**
+ * Start a new file with its header.  If it can't be opened, the logs are
+ * thrown away until it's time for the next one.
+ */
+void BinaryLogSink::openFile()
+{
+    logFile.deleteFile();
+    pStream.reset(new FileOutputStream(logFile, 0));
+    jassert(pStream->openedOk());
+
+    stringIds.clear();
+    batch.clear();
+    fileBytes = 0;
+    put(header);
+}
+
+/**
+ * name.ext for 0, otherwise name.index.ext
+ */
+File BinaryLogSink::getRotatedFile(const int index) const
+{
+    if (index == 0)
+        return logFile;
+    return logFile.getSiblingFile(
+        logFile.getFileNameWithoutExtension() + "." + String(index) + logFile.getFileExtension());
+}
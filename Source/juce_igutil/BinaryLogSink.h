@@ -0,0 +1,118 @@
+/**
+ * Writes MTLogger's messages to compact binary log files, in large batches,
+ * starting a new file when one gets too big.  tools/mtlogdecode turns the
+ * files back into text.
+ *
+ * A formatted message is written as its format's id and its numbers, and a
+ * message's tag as the tag's id; the text of a format or tag is written once
+ * per file, the first time it's used.  Records
+ * are collected in a batch buffer and the batch is written with a single
+ * write when it fills up or when the logger thread has nothing more to do,
+ * so heavy logging is a few large writes rather than a write and a flush per
+ * line.  When a file would go over maxFileBytes, it's renamed to
+ * name.1.ext (name.1 to name.2, and so on), the oldest is deleted so there
+ * are at most maxFiles, and a new file is started.  Every file starts with
+ * its own header and format definitions, so each can be decoded on its own.
+ *
+ * Only to be used by one thread: MTLogger's logger thread.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BinaryLogFormat.h"
+
+namespace juce_igutil {
+
+class BinaryLogSink
+{
+public:
+
+    /**
+     * Constructor.  A log already at file is rotated away.
+     *
+     * @param file the log file; older ones go next to it.
+     * @param maxFileBytes start a new file before one gets bigger than this.
+     * @param maxFiles how many files to keep, counting the current one.
+     */
+    BinaryLogSink(
+        const juce::File & file,
+        const juce::int64 maxFileBytes,
+        const int maxFiles);
+
+    // Destructor.  Writes out what's left.
+    virtual ~BinaryLogSink();
+
+    // Add records to the batch.  tag may be null.
+    void writeText(
+        const juce::int64 ticks,
+        const char * tag,
+        const char * pText,
+        const size_t numBytes);
+    void writeFormatted(
+        const juce::int64 ticks,
+        const char * tag,
+        const char * format,
+        const binarylog::Arg * pArgs,
+        const int numArgs);
+    void writeDropped(const juce::int64 ticks, const juce::uint32 count);
+
+    // Write the batch out.
+    void flush();
+
+    // When this was created, in high resolution ticks.  Times in the logs
+    // are shown from here.
+    juce::int64 getStartTicks() const {
+        return header.startTicks;
+    }
+
+    // The batch is written out once it's this big.
+    static const size_t batchBytes = 64 * 1024;
+
+private:
+
+    // Room for a record of this many bytes, starting a new file if need be.
+    void makeRoom(const size_t recordBytes);
+
+    // Room for a message of this many bytes and the definitions of its tag
+    // and format, as they stand once any new file has been started.
+    void makeRoom(const size_t messageBytes, const char * tag, const char * format);
+
+    // The bytes needed to define a format or tag, if it isn't yet; then its
+    // id, defining it if need be.
+    size_t getDefinitionBytes(const char * text) const;
+    juce::uint16 getId(const char * text);
+    void rotate();
+    void openFile();
+
+    // A file name in the rotation: 0 is the current file.
+    juce::File getRotatedFile(const int index) const;
+
+    template <typename T>
+    void put(const T value)
+    {
+        const char * p = reinterpret_cast<const char *>(&value);
+        batch.insert(batch.end(), p, p + sizeof(T));
+    }
+
+    void putBytes(const char * p, const size_t numBytes)
+    {
+        batch.insert(batch.end(), p, p + numBytes);
+    }
+
+    const juce::File logFile;
+    const juce::int64 maxBytes;
+    const int numFiles;
+    binarylog::FileHeader header;
+
+    std::unique_ptr<juce::FileOutputStream> pStream;
+    // bytes written to the current file, not counting the batch
+    juce::int64 fileBytes = 0;
+    std::vector<char> batch;
+
+    // The formats and tags defined so far in the current file
+    std::unordered_map<const char *, juce::uint16> stringIds;
+};
+
+}
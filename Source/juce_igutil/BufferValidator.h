@@ -0,0 +1,289 @@
+/**
+ * Checks audio buffers for NaNs, infinities, denormals and samples over a
+ * level, cheaply enough to leave on in release builds.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/MTLogger.h"
+
+namespace juce_igutil {
+
+/**
+ * Counts the NaN, infinite, denormal and over-level samples in a buffer in one
+ * pass over each channel.  The samples' bit patterns are classified in
+ * juce::dsp::SIMDRegister lanes (a float's magnitude orders the same way as
+ * its bits with the sign masked off), so a clean buffer costs a few
+ * compares per register and no branches.  Only when something is found is
+ * the buffer gone over again to find the first bad sample.
+ *
+ * Totals are kept in atomics, so they can be read from any thread.  Nothing
+ * is ever logged from check(): startReporting() logs a summary of anything
+ * new from the message thread, at most once per interval.
+ */
+class BufferValidator
+{
+public:
+
+    // What's been found since the last resetReport()
+    struct Report
+    {
+        juce::int64 nans = 0;
+        juce::int64 infinities = 0;
+        juce::int64 denormals = 0;
+        juce::int64 overs = 0;
+        // buffers with anything wrong in them
+        juce::int64 badBuffers = 0;
+        // where the first bad sample was, in the last bad buffer
+        int lastBadChannel = -1;
+        int lastBadIndex = -1;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param overThreshold samples whose magnitude is over this are counted
+     *                      as overs.
+     */
+    explicit BufferValidator(const float overThreshold):
+        overBits(juce::jmin(floatBits(std::abs(overThreshold)), infinityBits))
+    {
+        // empty
+    }
+
+    /** Destructor. */
+    ~BufferValidator() = default;
+
+    /**
+     * Check a buffer.  Returns true if it's clean.  Audio thread; doesn't
+     * allocate, lock or log.
+     */
+    bool check(const juce::AudioBuffer<float> & buffer) noexcept
+    {
+        const int numChannels = buffer.getNumChannels();
+        const int numSamples = buffer.getNumSamples();
+
+        juce::int64 counts[numKinds] = {};
+        for (int chan = 0; chan < numChannels; ++chan) {
+            countChannel(buffer.getReadPointer(chan), numSamples, counts);
+        }
+        if (counts[nan] + counts[infinity] + counts[denormal] + counts[over] == 0) {
+            return true;
+        }
+
+        recordFirstBadSample(buffer);
+        for (int kind = 0; kind < numKinds; ++kind) {
+            totals[kind].fetch_add(counts[kind], std::memory_order_relaxed);
+        }
+        badBuffers.fetch_add(1, std::memory_order_release);
+        return false;
+    }
+
+    /**
+     * What's been found.  Any thread.
+     */
+    Report getReport() const noexcept
+    {
+        Report report;
+        report.badBuffers = badBuffers.load(std::memory_order_acquire);
+        report.nans = totals[nan].load(std::memory_order_relaxed);
+        report.infinities = totals[infinity].load(std::memory_order_relaxed);
+        report.denormals = totals[denormal].load(std::memory_order_relaxed);
+        report.overs = totals[over].load(std::memory_order_relaxed);
+        report.lastBadChannel = lastBadChannel.load(std::memory_order_relaxed);
+        report.lastBadIndex = lastBadIndex.load(std::memory_order_relaxed);
+        return report;
+    }
+
+    /** Start counting again.  Any thread. */
+    void resetReport() noexcept
+    {
+        for (auto & total : totals) {
+            total.store(0, std::memory_order_relaxed);
+        }
+        badBuffers.store(0, std::memory_order_relaxed);
+        lastBadChannel.store(-1, std::memory_order_relaxed);
+        lastBadIndex.store(-1, std::memory_order_relaxed);
+    }
+
+    /** A report as one line of text. */
+    static juce::String describe(const Report & report)
+    {
+        return juce::String(report.badBuffers) + " bad buffers: "
+            + juce::String(report.nans) + " NaN, "
+            + juce::String(report.infinities) + " infinite, "
+            + juce::String(report.denormals) + " denormal and "
+            + juce::String(report.overs) + " over-level samples; the last started at channel "
+            + juce::String(report.lastBadChannel) + ", sample " + juce::String(report.lastBadIndex) + ".";
+    }
+
+    /**
+     * Log whatever's new, as one line every intervalMs at most, until this is
+     * destroyed.  Message thread.
+     */
+    void startReporting(
+        std::shared_ptr<MTLogger> pLogger,
+        const juce::String & name,
+        const int intervalMs)
+    {
+        pReporter.reset(new Reporter(*this, pLogger, name));
+        pReporter->startTimer(intervalMs);
+    }
+
+private:
+
+    // Kinds of bad sample
+    static const int clean = -1;
+    static const int nan = 0;
+    static const int infinity = 1;
+    static const int denormal = 2;
+    static const int over = 3;
+    static const int numKinds = 4;
+
+    // Bit patterns, with the sign masked off
+    static const juce::uint32 magnitudeMask = 0x7fffffffu;
+    static const juce::uint32 infinityBits = 0x7f800000u;
+    static const juce::uint32 smallestNormalBits = 0x00800000u;
+
+    using SIMDType = juce::dsp::SIMDRegister<juce::uint32>;
+    static constexpr int simdWidth = static_cast<int>(SIMDType::SIMDNumElements);
+    static_assert(juce::dsp::SIMDRegister<float>::SIMDNumElements == SIMDType::SIMDNumElements,
+        "floats and their bits must fill the same registers");
+
+    static juce::uint32 floatBits(const float value) noexcept
+    {
+        juce::uint32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    int classify(const juce::uint32 bits) const noexcept
+    {
+        const juce::uint32 magnitude = bits & magnitudeMask;
+        if (magnitude > infinityBits) return nan;
+        if (magnitude == infinityBits) return infinity;
+        if (magnitude != 0 && magnitude < smallestNormalBits) return denormal;
+        if (magnitude > overBits) return over;
+        return clean;
+    }
+
+    // Find the first bad sample in a buffer that has one.
+    void recordFirstBadSample(const juce::AudioBuffer<float> & buffer) noexcept
+    {
+        for (int chan = 0; chan < buffer.getNumChannels(); ++chan) {
+            const float * pSamples = buffer.getReadPointer(chan);
+            for (int ix = 0; ix < buffer.getNumSamples(); ++ix) {
+                if (classify(floatBits(pSamples[ix])) != clean) {
+                    lastBadChannel.store(chan, std::memory_order_relaxed);
+                    lastBadIndex.store(ix, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        }
+    }
+
+    // Count a channel's bad samples into counts.
+    void countChannel(const float * pSamples, const int numSamples, juce::int64 * counts) const noexcept
+    {
+        const juce::uint32 * pBits = reinterpret_cast<const juce::uint32 *>(pSamples);
+        const int head = juce::jmin(
+            numSamples,
+            static_cast<int>(SIMDType::getNextSIMDAlignedPtr(const_cast<juce::uint32 *>(pBits)) - pBits));
+        const int numVectors = (numSamples - head) / simdWidth;
+        const int tail = head + numVectors * simdWidth;
+
+        for (int ix = 0; ix < head; ++ix) {
+            countSample(pBits[ix], counts);
+        }
+
+        if (numVectors > 0) {
+            const SIMDType magnitudeMasks = SIMDType::expand(magnitudeMask);
+            const SIMDType infinities = SIMDType::expand(infinityBits);
+            const SIMDType smallestNormals = SIMDType::expand(smallestNormalBits);
+            const SIMDType overs = SIMDType::expand(overBits);
+            const SIMDType zeros = SIMDType::expand(0);
+            const SIMDType ones = SIMDType::expand(1);
+
+            // per lane counts
+            SIMDType nans = zeros;
+            SIMDType infs = zeros;
+            SIMDType denormals = zeros;
+            SIMDType overCounts = zeros;
+
+            for (const juce::uint32 * p = pBits + head; p < pBits + tail; p += simdWidth) {
+                const SIMDType magnitude = SIMDType::fromRawArray(p) & magnitudeMasks;
+                nans += SIMDType::greaterThan(magnitude, infinities) & ones;
+                infs += SIMDType::equal(magnitude, infinities) & ones;
+                denormals += SIMDType::lessThan(magnitude, smallestNormals)
+                    & SIMDType::notEqual(magnitude, zeros) & ones;
+                overCounts += SIMDType::greaterThan(magnitude, overs)
+                    & SIMDType::lessThan(magnitude, infinities) & ones;
+            }
+
+            counts[nan] += nans.sum();
+            counts[infinity] += infs.sum();
+            counts[denormal] += denormals.sum();
+            counts[over] += overCounts.sum();
+        }
+
+        for (int ix = tail; ix < numSamples; ++ix) {
+            countSample(pBits[ix], counts);
+        }
+    }
+
+    void countSample(const juce::uint32 bits, juce::int64 * counts) const noexcept
+    {
+        const int kind = classify(bits);
+        if (kind != clean) {
+            ++counts[kind];
+        }
+    }
+
+    // Logs what's new, from the message thread.
+    class Reporter: public juce::Timer
+    {
+    public:
+        Reporter(BufferValidator & owner, std::shared_ptr<MTLogger> pLogger, const juce::String & name):
+            validator(owner),
+            pMTL(pLogger),
+            sourceName(name)
+        {
+            // empty
+        }
+
+        ~Reporter() override
+        {
+            stopTimer();
+        }
+
+        void timerCallback() override
+        {
+            const Report report = validator.getReport();
+            if (report.badBuffers == lastReportedBadBuffers) {
+                return;
+            }
+            lastReportedBadBuffers = report.badBuffers;
+            pMTL->error("ERROR - " + sourceName + ": " + describe(report));
+        }
+
+    private:
+        BufferValidator & validator;
+        std::shared_ptr<MTLogger> pMTL;
+        const juce::String sourceName;
+        juce::int64 lastReportedBadBuffers = 0;
+    };
+
+    const juce::uint32 overBits;
+
+    // Totals
+    std::atomic<juce::int64> totals[numKinds] = {};
+    std::atomic<juce::int64> badBuffers { 0 };
+    std::atomic<int> lastBadChannel { -1 };
+    std::atomic<int> lastBadIndex { -1 };
+
+    std::unique_ptr<Reporter> pReporter;
+};
+
+}
@@ -19,7 +19,6 @@ static const std::string gainParam("gain");
  * @param synthVoices - synth voices to use (all voices in the provided 
  *                     container will be added.  We take ownership of the
  *                     objects.)
- * @param keyState - keystate tracker used with onscreen virtual keyboard
  * @param pEffectsProcessor - optional effects processor.  Defaults to a null 
  *                          processor if not specified.
  */
@@ -28,12 +27,10 @@ ConfigurableSynthAudioSource::ConfigurableSynthAudioSource(
     std::shared_ptr<AudioProcessorValueTreeState> pSynthParameters,
     juce::SynthesiserSound::Ptr pSynthSound,
     std::vector<juce::SynthesiserVoice*> synthVoices,
-    juce::MidiKeyboardState & keyState, // todo is this the best place for this?
     std::shared_ptr<Processor> pEffectProcessor
 ): 
     SynthAudioSource(),
     pSynthParams(pSynthParameters),
-    keyboardState (keyState),
     processSpec{0,0,0},
     pFxProcessor(pEffectProcessor)
 {
@@ -43,6 +40,10 @@ ConfigurableSynthAudioSource::ConfigurableSynthAudioSource(
     // interface used elsewhere.
     synth.setCurrentPlaybackSampleRate(1);
 
+    // Split the block exactly at every event; controllers are kept from 
+    // splitting it too finely by scheduleMidi() instead.
+    synth.setMinimumRenderingSubdivisionSize(1, true);
+
     for (auto pVoice: synthVoices)
         synth.addVoice( pVoice );
 
@@ -62,6 +63,9 @@ void ConfigurableSynthAudioSource::prepareToPlay(
 {
     // init this
     previousGain = *pGainParam;
+    previousFxGain = 1.0f;
+    fxFolded = false;
+    this->processSpec = processSpec;
 
     synth.setCurrentPlaybackSampleRate (processSpec.sampleRate);
 
@@ -72,6 +76,61 @@ void ConfigurableSynthAudioSource::prepareToPlay(
     }
 
     pFxProcessor->prepare(processSpec);
+    if (pOutputProcessor)
+        pOutputProcessor->prepare(processSpec);
+    scheduledMidi.ensureSize(scheduledMidiBytes);
+
+    silentSamples = 0;
+    idle = false;
+}
+
+/**
+ * A note at no velocity: the oscillators and filters run, but make no sound, 
+ * and the voice is stopped and free again afterwards.
+ */
+void ConfigurableSynthAudioSource::warmUpVoices(const int numBlocks)
+{
+    auto pSound = synth.getSound(0);
+    if (pSound == nullptr || processSpec.maximumBlockSize == 0)
+        return;
+
+    AudioBuffer<float> scratch(
+        static_cast<int>(processSpec.numChannels), 
+        static_cast<int>(processSpec.maximumBlockSize));
+    for (int i=0; i < synth.getNumVoices(); ++i) {
+        SynthesiserVoice * pVoice = synth.getVoice(i);
+        if (pVoice->isVoiceActive())
+            continue;
+        pVoice->startNote(60, 0.0f, pSound.get(), 8192);
+        for (int block = 0; block < numBlocks; ++block) {
+            scratch.clear();
+            pVoice->renderNextBlock(scratch, 0, scratch.getNumSamples());
+        }
+        pVoice->stopNote(0.0f, false);
+    }
+}
+
+/**
+ * The idle fast path.  While idle, a block with no midi (the host's, with 
+ * anything injected already merged in) is just cleared.  The first event 
+ * ends the idle state.
+ */
+bool ConfigurableSynthAudioSource::renderIdleBlock(
+    juce::AudioBuffer<float> & outputAudio,
+    juce::MidiBuffer & inputMidi,
+    int startSample)
+{
+    ignoreUnused(startSample);
+    if (!idle)
+        return false;
+
+    if (inputMidi.isEmpty()) {
+        outputAudio.clear();
+        return true;
+    }
+
+    idle = false;
+    return false;
 }
 
 /**
@@ -85,38 +144,158 @@ void ConfigurableSynthAudioSource::renderNextBlock(
     // Synths usually need to do this.
     outputAudio.clear();
 
-    keyboardState.processNextMidiBuffer(
-        inputMidi, 
-        startSample,
-        outputAudio.getNumSamples(), 
-        true
-    );
+    idle = false;
 
+    // If no voice rendered anything, the effects don't need to look for
+    // silence.
+    synth.getAndClearVoiceRendered();
     synth.renderNextBlock(
         outputAudio, 
-        inputMidi,
+        scheduleMidi(inputMidi, startSample),
         startSample,
         outputAudio.getNumSamples()
     );
 
     //pMTL->debug("ConfigurableSynthAudioSource: gain = "+ String(*pGainParam));// +", waveIndex = "+String(*pWaveIndexParam));
 
-    // create the context for dsp
-    dsp::AudioBlock<float> block(outputAudio);
-    dsp::ProcessContextReplacing<float> context(block);
-    pFxProcessor->process(context);
+    // Run the effects, unless they're just a gain; then that's folded into the
+    // overall gain.
+    const bool inputSilent = !synth.getAndClearVoiceRendered();
+    float fxGain = 1.0f;
+    bool fxSkipped = true;
+    const bool wasFxFolded = fxFolded;
+    fxFolded = pFxProcessor->getPureGain(fxGain);
+    if (!fxFolded)
+    {
+        fxGain = 1.0f;
+        dsp::AudioBlock<float> block(outputAudio);
+        dsp::ProcessContextReplacing<float> context(block);
+        pFxProcessor->setInputSilent(inputSilent);
+        pFxProcessor->process(context);
+        fxSkipped = pFxProcessor->isSkipping();
+    }
 
-    // Overall gain
+    // Overall gain, ramped if it changed, then clipping, metering and the 
+    // tap, all in one pass.  When the effects go from a folded gain to
+    // running or back, they crossfade between their gain and their output
+    // themselves, so the folded part steps at the start of the block rather
+    // than being ramped on top of that.
     const float currentGain = *pGainParam;
-    if (currentGain == previousGain)
+    const float startFxGain = fxFolded == wasFxFolded ? previousFxGain : fxGain;
+    if (pOutputProcessor)
     {
-        outputAudio.applyGain(currentGain);
+        // The output processor has to see the gain, so it's given the ramp to
+        // apply in its own pass (only if it can't is there a pass for it 
+        // here).  If it bounds its output within the clip level, e.g. a 
+        // limiter, the output stage only has the metering and the tap left.
+        // Its input is silent if the effects' was and they didn't add 
+        // anything.
+        const float startGain = previousGain * startFxGain;
+        const float endGain = currentGain * fxGain;
+        if (!pOutputProcessor->setInputGain(startGain, endGain))
+            outputAudio.applyGainRamp(0, outputAudio.getNumSamples(), startGain, endGain);
+        dsp::AudioBlock<float> block(outputAudio);
+        dsp::ProcessContextReplacing<float> context(block);
+        pOutputProcessor->setInputSilent(inputSilent && (fxFolded || fxSkipped));
+        pOutputProcessor->process(context);
+        fxSkipped = fxSkipped && pOutputProcessor->isSkipping();
+        if (outputStage.needsClipping(pOutputProcessor->getOutputCeiling()))
+            outputStage.process(outputAudio, 1.0f, 1.0f);
+        else
+            outputStage.measure(outputAudio);
     }
     else
     {
-        outputAudio.applyGainRamp(0, outputAudio.getNumSamples(), previousGain, currentGain);
-        previousGain = currentGain;
+        outputStage.process(outputAudio, previousGain * startFxGain, currentGain * fxGain);
     }
+    previousGain = currentGain;
+    previousFxGain = fxGain;
+
+    // Check what actually goes out.
+    if (pOutputValidator)
+        pOutputValidator->check(outputAudio);
+
+    updateIdle(outputAudio, inputSilent, fxSkipped);
+}
+
+/**
+ * Set the controller quantising.
+ */
+void ConfigurableSynthAudioSource::setControllerSubBlockSize(const int numSamples)
+{
+    jassert(numSamples >= 1);
+    controllerSubBlockSize = jmax(1, numSamples);
+}
+
+/**
+ * The synth renders up to each event before handling it, so every event 
+ * position is a split.  Controller events are moved back to the start of 
+ * their sub-block (but never before the note event ahead of them, so e.g. a
+ * sustain pedal still comes after a note off before it).  Note events keep
+ * their exact positions.  The order of the events doesn't change.
+ */
+const juce::MidiBuffer & ConfigurableSynthAudioSource::scheduleMidi(
+    const juce::MidiBuffer & inputMidi,
+    int startSample)
+{
+    if (controllerSubBlockSize <= 1 || inputMidi.isEmpty())
+        return inputMidi;
+
+    scheduledMidi.clear();
+    int lastNotePosition = startSample;
+    for (const auto metadata : inputMidi) {
+        int position = metadata.samplePosition;
+        const int type = metadata.numBytes > 0 ? (metadata.data[0] & 0xf0) : 0;
+        const bool isController = type == 0xa0 || type == 0xb0 || type == 0xd0 || type == 0xe0;
+        if (isController) {
+            const int gridPosition = startSample 
+                + ((position - startSample) / controllerSubBlockSize) * controllerSubBlockSize;
+            position = jmax(gridPosition, lastNotePosition);
+        }
+        else {
+            lastNotePosition = position;
+        }
+        scheduledMidi.addEvent(metadata.data, metadata.numBytes, position);
+    }
+    return scheduledMidi;
+}
+
+/**
+ * We're idle once the effects have had silent input for longer than their
+ * tail and the output processor's, both skipped every processor (or the
+ * effects are just a gain), and the output is silent too.  An infinite tail 
+ * (e.g. a frozen reverb) keeps us out of it.
+ */
+void ConfigurableSynthAudioSource::updateIdle(
+    const juce::AudioBuffer<float> & outputAudio,
+    const bool inputSilent,
+    const bool fxSkipped)
+{
+    const int numSamples = outputAudio.getNumSamples();
+    if (!inputSilent) {
+        silentSamples = 0;
+        return;
+    }
+    silentSamples = jmin(silentSamples, std::numeric_limits<int>::max() - numSamples) + numSamples;
+    if (silentSamples <= getTailSamples() || !fxSkipped)
+        return;
+
+    // The output stage has already measured the block.
+    if (outputStage.getLevels().peak > 0.0f)
+        return;
+    idle = true;
+}
+
+/**
+ * The two tails one after the other, or infinite if either is.
+ */
+int ConfigurableSynthAudioSource::getTailSamples() const noexcept
+{
+    const int fxTail = pFxProcessor->getTailSamples();
+    const int outputTail = pOutputProcessor ? pOutputProcessor->getTailSamples() : 0;
+    if (fxTail >= Processor::infiniteTail - outputTail)
+        return Processor::infiniteTail;
+    return fxTail + outputTail;
 }
 
 /**
@@ -124,6 +303,10 @@ void ConfigurableSynthAudioSource::renderNextBlock(
  */
 void ConfigurableSynthAudioSource::releaseResources() {
     pFxProcessor->reset();
+    if (pOutputProcessor)
+        pOutputProcessor->reset();
+    silentSamples = 0;
+    idle = false;
     // note sure if this is needed - TODO test
     //synth.allNotesOff();
 }
@@ -12,7 +12,9 @@
 #include <JuceHeader.h>
 
 #include "juce_igutil/Processor.h"
+#include "juce_igutil/BufferValidator.h"
 #include "juce_igutil/NullProcessor.h"
+#include "juce_igutil/OutputStage.h"
 
 #include "SynthAudioSource.h"
 #include "MTLogger.h"
@@ -34,7 +36,6 @@ public:
         std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParameters,
         juce::SynthesiserSound::Ptr pSynthSound,
         std::vector<juce::SynthesiserVoice*> synthVoices,
-        juce::MidiKeyboardState & keyState, // todo is this the best place for this?
         std::shared_ptr<Processor> pEffectsProcessor = 
             std::make_shared<juce_igutil::NullProcessor>()
     );
@@ -51,6 +52,12 @@ public:
         juce::MidiBuffer& inputMidi,
         int startSample) override;
 
+    // Clear the block without rendering while idle and no midi comes in
+    bool renderIdleBlock(
+        juce::AudioBuffer<float>& outputAudio,
+        juce::MidiBuffer& inputMidi,
+        int startSample) override;
+
     // release resources
     void releaseResources() override;
 
@@ -59,30 +66,160 @@ public:
         return pSynthParams;
     }
 
+    // Latency of the effects and output processors.  Audio thread.
+    int getLatencySamples() override {
+        return pFxProcessor->getLatencySamples() 
+            + (pOutputProcessor ? pOutputProcessor->getLatencySamples() : 0);
+    }
+
+    // Pass offline rendering on to the effects and output processors.  Audio
+    // thread.
+    void setNonRealtime(const bool isNonRealtime) override {
+        pFxProcessor->setNonRealtime(isNonRealtime);
+        if (pOutputProcessor)
+            pOutputProcessor->setNonRealtime(isNonRealtime);
+    }
+
+    // Run this after the overall gain, e.g. a limiter, which has to see the
+    // level that goes out.  Null (the default) runs nothing there.  Before
+    // prepareToPlay().
+    void setOutputProcessor(std::shared_ptr<Processor> pProcessor) {
+        pOutputProcessor = pProcessor;
+    }
+
+    // Controller changes (CC, pitch wheel, aftertouch) are moved back to a 
+    // multiple of this many samples, so dense controller streams don't split 
+    // the block into tiny pieces.  Note events always start at their exact 
+    // sample.  1 (the default) leaves controllers where they are.
+    void setControllerSubBlockSize(const int numSamples);
+
+    // Clip the output to +/- this level after the gain.  0 (the default)
+    // doesn't clip.
+    void setOutputClipLevel(const float clipLevel) {
+        outputStage.setClipLevel(clipLevel);
+    }
+
+    // Give the final samples of an output channel to a tap as they're
+    // rendered.  Not while rendering.
+    void setOutputTap(
+        std::function<void(const float * pSamples, int numSamples)> tap,
+        const int channel = 0) override {
+        outputStage.setTap(std::move(tap), channel);
+    }
+
+    // Check each finished block, after the output processor and the output 
+    // stage, for bad samples.  Null (the default) doesn't check.
+    void setOutputValidator(std::shared_ptr<BufferValidator> pValidator) {
+        pOutputValidator = pValidator;
+    }
+
+    // The output levels of the last block, after the gain and before 
+    // clipping.
+    const OutputStage::Levels & getOutputLevels() const {
+        return outputStage.getLevels();
+    }
+
+    // Make the effects' and output processor's buffers resident.  After 
+    // prepareToPlay().
+    void prefault(RealtimeMemory & memory) {
+        pFxProcessor->prefault(memory);
+        if (pOutputProcessor)
+            pOutputProcessor->prefault(memory);
+    }
+
+    // Run every voice for numBlocks blocks with a silent note, so its code 
+    // and data are in the caches before the first real note.  After 
+    // prepareToPlay(), not while rendering.
+    void warmUpVoices(const int numBlocks);
+
 private:
 
+    /**
+     * Notes whether any voice rendered anything since it was last asked: a
+     * voice renders in a piece of the block if it's active at the start of
+     * it.  Looking at the voices before and after the block isn't enough, as
+     * a note can start and finish inside it.
+     */
+    class Synthesiser: public juce::Synthesiser
+    {
+    public:
+        bool getAndClearVoiceRendered() noexcept
+        {
+            const bool rendered = voiceRendered;
+            voiceRendered = false;
+            return rendered;
+        }
+
+    protected:
+        using juce::Synthesiser::renderVoices;
+
+        void renderVoices(juce::AudioBuffer<float> & buffer, int startSample, int numSamples) override
+        {
+            for (int ix = 0; !voiceRendered && ix < voices.size(); ++ix) {
+                voiceRendered = voices.getUnchecked(ix)->isVoiceActive();
+            }
+            juce::Synthesiser::renderVoices(buffer, startSample, numSamples);
+        }
+
+    private:
+        bool voiceRendered = false;
+    };
+
+    // Move the block's controller events onto the sub-block grid.
+    const juce::MidiBuffer & scheduleMidi(
+        const juce::MidiBuffer & inputMidi,
+        int startSample);
+
+    // Work out whether the block just rendered leaves us idle.
+    void updateIdle(
+        const juce::AudioBuffer<float>& outputAudio,
+        const bool inputSilent,
+        const bool fxSkipped);
+
+    // How long silence takes to get through the effects and output 
+    // processors.
+    int getTailSamples() const noexcept;
+
     // logger
     std::shared_ptr<juce_igutil::MTLogger> pMTL;
 
     // The synth object
-    juce::Synthesiser synth;
+    Synthesiser synth;
 
     // Synth Parameters
     std::shared_ptr<juce::AudioProcessorValueTreeState> pSynthParams;
 
     // Generic synth params
     float previousGain = 0.6f;
+
+    // The effects' gain as of the last block, if they were folded into ours
+    // (1 if not)
+    float previousFxGain = 1.0f;
+    bool fxFolded = false;
     std::atomic<float> * pGainParam = nullptr;
 
-    // MidiKeyboardState:  helps merge on-screen keyboard midi
-    // with midi from controllers.
-    juce::MidiKeyboardState & keyboardState;
+    // Gain, clipping, metering and the output tap, in one pass
+    OutputStage outputStage;
+    std::shared_ptr<BufferValidator> pOutputValidator;
+
+    // Controller quantising, and the block's midi after it
+    int controllerSubBlockSize = 1;
+    static const int scheduledMidiBytes = 4096;
+    juce::MidiBuffer scheduledMidi;
 
     // ProcessSpec, set in prepareToPlay()
     juce::dsp::ProcessSpec processSpec;
 
     // Optional effects processor.
     std::shared_ptr<juce_igutil::Processor> pFxProcessor;
+
+    // Optional processor after the gain.
+    std::shared_ptr<juce_igutil::Processor> pOutputProcessor;
+
+    // Idle state.  The effects have been fed silentSamples of silence; once
+    // that's longer than their tail and the output is silent, we're idle.
+    int silentSamples = 0;
+    bool idle = false;
 };
 
 }
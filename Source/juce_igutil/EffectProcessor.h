@@ -19,15 +19,22 @@ template <typename ProcessorType>
 class EffectProcessor: public juce_igutil::Processor
 {
 public:
+
+    // Tells whether the effect's current settings make it a plain gain (see 
+    // Processor::getPureGain()).  Audio thread.
+    using PureGainFunc = std::function<bool(float & gain)>;
     
-    // Constructor 
+    // Constructor.  Give the effect's tail in seconds if it is known; 
+    // otherwise it's treated as infinite.
     EffectProcessor(
         //std::shared_ptr<juce_igutil::MTLogger> _pMTL,
-        std::shared_ptr<ProcessorType> pConcreteProcessor
+        std::shared_ptr<ProcessorType> pConcreteProcessor,
+        const double effectTailSeconds = -1.0
     ):
         Processor(),
         //pMTL(_pMTL),
-        pProcessor(pConcreteProcessor)
+        pProcessor(pConcreteProcessor),
+        tailSeconds(effectTailSeconds)
     {
         jassert(pProcessor);
 
@@ -42,6 +49,9 @@ public:
     {
         processSpec = spec;
         pProcessor->prepare(spec);
+        tailSamples = tailSeconds < 0.0 ? 
+            infiniteTail : 
+            static_cast<int>(std::ceil(tailSeconds * spec.sampleRate));
     }
 
     /** 
@@ -62,6 +72,24 @@ public:
         pProcessor->reset();
     }
 
+    /** Tail as given to the constructor. */
+    int getTailSamples() const noexcept override
+    {
+        return tailSamples;
+    }
+
+    /** Whatever the PureGainFunc says, if there is one. */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        return pureGainFunc && pureGainFunc(gain);
+    }
+
+    // Set the test for when the effect is a plain gain.
+    void setPureGainFunc(PureGainFunc func)
+    {
+        pureGainFunc = std::move(func);
+    }
+
     // Return the exact processor type, casted appropriately
     template <typename T> 
     std::shared_ptr<T> getExactProcessor() 
@@ -79,6 +107,13 @@ private:
 
     // Processor
     std::shared_ptr<ProcessorType> pProcessor;
+
+    // Tail (negative if unknown), and in samples as of prepare()
+    const double tailSeconds;
+    int tailSamples = infiniteTail;
+
+    // Optional plain gain test
+    PureGainFunc pureGainFunc;
 };
 
 }
@@ -3,30 +3,74 @@
 using namespace juce;
 using namespace juce_igutil;
 
-// Poison Pill definition.
-const juce::String MTLogger::poisonPill("__MTLogger_PoisonPill__");
-
 /**
  * Construct
  */
-MTLogger::MTLogger(std::shared_ptr<juce::FileLogger> _pLogger) :
-    pLogger(_pLogger)
+MTLogger::MTLogger(
+    std::shared_ptr<juce::FileLogger> _pLogger,
+    std::shared_ptr<BinaryLogSink> _pBinarySink
+) :
+    pCore(std::make_shared<Core>(_pLogger, _pBinarySink))
+{
+    // empty
+}
+
+/**
+ * Construct a tagged logger
+ */
+MTLogger::MTLogger(std::shared_ptr<Core> _pCore, const char * _tag) :
+    pCore(_pCore),
+    tag(_tag)
+{
+    // empty
+}
+
+/**
+ * Destruct.  The ring and the thread go with the last logger using them.
+ */
+MTLogger::~MTLogger()
+{
+    // empty
+}
+
+/**
+ * Create a tagged logger sharing this one's ring and thread
+ */
+std::shared_ptr<MTLogger> MTLogger::createTagged(const juce::String& newTag) const
+{
+    return std::shared_ptr<MTLogger>(new MTLogger(pCore, pCore->addTag(newTag)));
+}
+
+/**
+ * Construct the ring and start the logger thread
+ */
+MTLogger::Core::Core(
+    std::shared_ptr<juce::FileLogger> _pLogger,
+    std::shared_ptr<BinaryLogSink> _pBinarySink
+) :
+    pLogger(_pLogger),
+    pBinarySink(_pBinarySink),
+    ring(new Record[capacity]),
+    startTicks(_pBinarySink != nullptr ? _pBinarySink->getStartTicks() : Time::getHighResolutionTicks())
 {
+    static_assert((capacity & (capacity - 1)) == 0, "the capacity must be a power of 2");
+    for (int ix = 0; ix < capacity; ++ix) {
+        ring[ix].sequence.store(static_cast<juce::uint32>(ix), std::memory_order_relaxed);
+    }
+
     // Start the logger thread.
-    // Note that calling a member function from the thread requires this 1-arg syntax:
     pLogger->logMessage("MTLogger - Constructor - starting log loop thread.");
-    pLoggerThread.reset(new std::thread(&MTLogger::logLoop, this, LogLoopArgs{ queue, queueMutex, pLogger }));
+    pLoggerThread.reset(new std::thread(&Core::logLoop, this));
 }
 
 /**
- * Destruct
+ * Destruct.  Everything logged before this is written out first.
  */
-MTLogger::~MTLogger() 
+MTLogger::Core::~Core()
 {
-    queueMutex.lock();
-    queue.push(juce::String("MTLogger - Destructor - sending poisonPill."));
-    queue.push(MTLogger::poisonPill);
-    queueMutex.unlock();
+    logText(nullptr, "MTLogger - Destructor - stopping log loop thread.");
+    stopping.store(true);
+    wakeUp.post();
     if (pLoggerThread->joinable())
         pLoggerThread->join();
     pLogger->logMessage("MTLogger - Destructor - done.");
@@ -36,16 +80,12 @@ MTLogger::~MTLogger()
  * Log a debug message (TODO separate into debug/warn/error(?))
  */
 void MTLogger::debug(const juce::String& message) {
-    while ( !queueMutex.try_lock()) {
-        std::this_thread::yield();
-    }
-    queue.push(message);
-    queueMutex.unlock();
+    pCore->logText(tag, message);
 }
 
 /**
  * Log an info message (currently just calls debug())
- * 
+ *
  */
 void MTLogger::info(const juce::String& message) {
     debug(message);
@@ -66,47 +106,180 @@ void MTLogger::error(const juce::String& message) {
 }
 
 /**
- * Loops forever, safely pulling from the queue and writing to 
- * the log.  Runs on its own thread, started from the 
- * constructor.
+ * Copy a message into a record.  toRawUTF8() doesn't allocate, since that's
+ * how Strings are stored.
+ */
+void MTLogger::Core::logText(const char * tag, const juce::String& message) noexcept
+{
+    Record * pRecord = claimRecord();
+    if (pRecord == nullptr)
+        return;
+    pRecord->tag = tag;
+    pRecord->format = nullptr;
+    pRecord->numArgs = 0;
+    const char * pText = message.toRawUTF8();
+    size_t numBytes = jmin(message.getNumBytesAsUTF8(), static_cast<size_t>(maxTextBytes - 1));
+    // don't cut a multi-byte character in half
+    while (numBytes > 0 && (static_cast<unsigned char>(pText[numBytes]) & 0xc0) == 0x80)
+        --numBytes;
+    std::memcpy(pRecord->text, pText, numBytes);
+    pRecord->text[numBytes] = 0;
+    publishRecord(*pRecord);
+}
+
+/**
+ * Keep a copy of a tag.  The copies are never moved (it's a deque) or
+ * removed, so records can point to them.
+ */
+const char * MTLogger::Core::addTag(const juce::String& tag)
+{
+    const std::lock_guard<std::mutex> lock(tagLock);
+    tags.push_back(tag.toStdString());
+    return tags.back().c_str();
+}
+
+/**
+ * Claim the next free record, or count a dropped message and return null if
+ * the ring is full.  Producers only ever retry when another producer claimed
+ * the same record first; they never wait for the logger thread.
  */
-void MTLogger::logLoop(LogLoopArgs args)
+MTLogger::Record * MTLogger::Core::claimRecord() noexcept
 {
-    bool done = false;
-    while ( !done ) {
-        
-        // Don't be a processor hog
-        std::this_thread::yield();
-
-        if (args.queueMutex.try_lock()) {
-            bool locked = true;
-            while ( !done && !args.queue.empty() ) {
-            
-                // relock if needed
-                if ( !locked ) {
-                    args.queueMutex.lock();
-                    locked = true;
-                }
-
-                // read and unlock
-                const juce::String message(args.queue.front());
-                args.queue.pop();
-                args.queueMutex.unlock();
-                locked = false;
-
-                // Do the log or prepare to exit.  This is done outside of the locking 
-                // to ensure that we don't hold the lock while doing this I/O.
-                if (message == MTLogger::poisonPill) {
-                    args.pLogger->logMessage(String("LOGGER: detected poison pill. Exiting..."));
-                    done = true;
-                }
-                else {
-                    args.pLogger->logMessage(message);
-                }
+    juce::uint32 position = enqueuePosition.load(std::memory_order_relaxed);
+    for (;;) {
+        Record & record = ring[position & (capacity - 1)];
+        const juce::uint32 sequence = record.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<juce::int32>(sequence - position);
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                record.ticks = Time::getHighResolutionTicks();
+                return &record;
             }
-            
-            // May still be unlocked if never got in the loop:
-            if (locked) args.queueMutex.unlock();
         }
+        else if (difference < 0) {
+            // still holding a message from the last time round
+            droppedTotal.fetch_add(1, std::memory_order_relaxed);
+            droppedUnreported.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Hand a filled in record to the logger thread, and wake it if the ring was
+ * empty.  The count can go below zero for a moment, when the logger thread
+ * has taken a record before it was counted; the count still goes from zero to
+ * one after that if there's anything left, so no record is missed.
+ */
+void MTLogger::Core::publishRecord(Record & record) noexcept
+{
+    const juce::uint32 position = record.sequence.load(std::memory_order_relaxed);
+    record.sequence.store(position + 1, std::memory_order_release);
+    if (pendingRecords.fetch_add(1, std::memory_order_acq_rel) == 0)
+        wakeUp.post();
+}
+
+/**
+ * Write out the next record, if there is one, and give it back to the
+ * producers.  Binary records are only added to the sink's batch.
+ */
+bool MTLogger::Core::logNextRecord()
+{
+    Record & record = ring[dequeuePosition & (capacity - 1)];
+    if (record.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+        return false;
+
+    // Take what's needed from the record before giving it back.
+    juce::String message;
+    if (pBinarySink == nullptr) {
+        message = formatRecord(record);
+    }
+    else if (record.format == nullptr) {
+        pBinarySink->writeText(record.ticks, record.tag, record.text, std::strlen(record.text));
+    }
+    else {
+        pBinarySink->writeFormatted(record.ticks, record.tag, record.format, record.args, record.numArgs);
+    }
+    record.sequence.store(dequeuePosition + capacity, std::memory_order_release);
+    ++dequeuePosition;
+
+    if (pBinarySink == nullptr) {
+        pLogger->logMessage(message);
+    }
+    return true;
+}
+
+/**
+ * Log how many messages didn't fit in the ring.
+ */
+void MTLogger::Core::logDropped(const juce::uint32 dropped)
+{
+    if (pBinarySink != nullptr) {
+        pBinarySink->writeDropped(Time::getHighResolutionTicks(), dropped);
+    }
+    else {
+        pLogger->logMessage("MTLogger - the queue was full; dropped " + String(dropped) + " messages.");
+    }
+}
+
+/**
+ * The record's time since the logger started, its tag, then its message.
+ */
+juce::String MTLogger::Core::formatRecord(const Record & record) const
+{
+    const double seconds = Time::highResolutionTicksToSeconds(record.ticks - startTicks);
+    String message = "[" + String(seconds, 3) + "] ";
+    if (record.tag != nullptr) {
+        message += "[" + String::fromUTF8(record.tag) + "] ";
+    }
+    if (record.format == nullptr) {
+        return message + String::fromUTF8(record.text);
+    }
+
+    const std::string text = binarylog::formatMessage(record.format, record.args, record.numArgs);
+    message += String::fromUTF8(text.c_str());
+    return message;
+}
+
+/**
+ * Writes out records as they arrive, until the destructor stops it.  Runs on
+ * its own thread, started from the constructor.  In between it sleeps until
+ * a record makes the ring non-empty.
+ */
+void MTLogger::Core::logLoop()
+{
+    for (;;) {
+        const bool exiting = stopping.load();
+        int numLogged = 0;
+        while (logNextRecord()) {
+            ++numLogged;
+        }
+        const bool logged = numLogged > 0;
+        const int stillPending = pendingRecords.fetch_sub(numLogged, std::memory_order_acq_rel) - numLogged;
+
+        const juce::uint32 dropped = droppedUnreported.exchange(0);
+        if (dropped > 0) {
+            logDropped(dropped);
+        }
+
+        // Binary logs are written in batches: when one fills up, and when
+        // the messages stop coming for a while.
+        if (pBinarySink != nullptr && (! logged || exiting)) {
+            pBinarySink->flush();
+        }
+
+        // Everything before the destructor was called has been logged.
+        if (exiting)
+            return;
+
+        // Records published while the ring was being emptied are taken
+        // straight away; otherwise sleep until the next one, or until it's
+        // time to flush the binary batch.
+        if (stillPending > 0)
+            continue;
+        wakeUp.wait(logged && pBinarySink != nullptr ? flushAfterMs : -1);
     }
 }
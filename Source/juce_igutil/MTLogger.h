@@ -1,50 +1,172 @@
 // Multi-threaded Logger Class
-// 
+//
 // This class helps provide logging in threads that require very fast response time.
-// Keeps a thread safe in-memory store of messages to log as well as a separate thread 
-// that reads from the store and does the logging.
+// Messages are put in a fixed-size ring of records, without locking or allocating,
+// and a separate thread takes them out, formats them and does the logging.  With a
+// BinaryLogSink, they're written out unformatted, in batches, to binary log files
+// instead of the text log.
+//
+// One logger (its ring and thread) can be shared by many users, e.g. every instance
+// of a plugin, with createTagged() giving each its own tag on its messages.
 
 #pragma once
 
 #include <JuceHeader.h>
-#include <shared_mutex>
+
+#include "BinaryLogFormat.h"
+#include "BinaryLogSink.h"
+#include "Semaphore.h"
 
 namespace juce_igutil {
 
 class MTLogger {
 
 public:
-    static const juce::String poisonPill;
-
-public:
-    MTLogger(std::shared_ptr<juce::FileLogger> _pLogger);
+    // Messages go to _pBinarySink if there is one, otherwise to _pLogger.
+    MTLogger(
+        std::shared_ptr<juce::FileLogger> _pLogger,
+        std::shared_ptr<BinaryLogSink> _pBinarySink = nullptr);
 
     virtual ~MTLogger();
 
-    // logging functions
+    // A logger that shares this one's ring and thread, and puts "[tag]"
+    // before its messages.  Not realtime safe.
+    std::shared_ptr<MTLogger> createTagged(const juce::String& tag) const;
+
+    // logging functions.  The message is copied (and truncated to
+    // maxTextBytes) rather than kept, so these don't allocate, although
+    // building the message usually does.
     void debug(const juce::String& message);
     void info(const juce::String& message);
     void warning(const juce::String& message);
     void error(const juce::String& message);
 
+    // Log from a thread that mustn't allocate, e.g. the audio thread.  The
+    // format must be a string literal (only the pointer is kept); each "{}" in
+    // it is replaced by the next of up to maxArgs numbers, on the logger thread.
+    template <typename... Args>
+    void log(const char * format, const Args... args) noexcept
+    {
+        static_assert(sizeof...(Args) <= maxArgs, "too many arguments to log");
+        Record * pRecord = pCore->claimRecord();
+        if (pRecord == nullptr)
+            return;
+        pRecord->tag = tag;
+        pRecord->format = format;
+        pRecord->numArgs = 0;
+        setArgs(*pRecord, args...);
+        pCore->publishRecord(*pRecord);
+    }
+
+    // Messages dropped because the ring was full, by any user of the ring.
+    // Any thread.
+    juce::uint32 getDroppedCount() const noexcept {
+        return pCore->droppedTotal.load(std::memory_order_relaxed);
+    }
+
+    // Ring and record sizes
+    static const int capacity = 1024;
+    static const int maxArgs = 4;
+    static const int maxTextBytes = 192;
+
 private:
 
-    // Logger.  Only use while the worker thread is not created nor joined.
-    std::shared_ptr<juce::FileLogger> pLogger;
+    // A number to go in a format
+    using Arg = binarylog::Arg;
+
+    // A message.  sequence says whose turn it is: the producer claiming
+    // position pos can write it when it's pos, and the logger thread can read
+    // it when it's pos + 1.
+    struct Record {
+        std::atomic<juce::uint32> sequence { 0 };
+        juce::int64 ticks = 0;
+        // the logger's tag, or null
+        const char * tag = nullptr;
+        // null for a text message
+        const char * format = nullptr;
+        int numArgs = 0;
+        Arg args[maxArgs];
+        char text[maxTextBytes];
+    };
+
+    // The ring and the logger thread, shared by a logger and the tagged
+    // loggers created from it.
+    class Core {
+    public:
+        Core(std::shared_ptr<juce::FileLogger> _pLogger, std::shared_ptr<BinaryLogSink> _pBinarySink);
+        ~Core();
+
+        // Producer side
+        Record * claimRecord() noexcept;
+        void publishRecord(Record & record) noexcept;
+        void logText(const char * tag, const juce::String& message) noexcept;
+
+        // Keep a tag for as long as the ring lives, since records point to it.
+        const char * addTag(const juce::String& tag);
+
+        // Dropped messages, in total and not yet reported
+        std::atomic<juce::uint32> droppedTotal { 0 };
+        std::atomic<juce::uint32> droppedUnreported { 0 };
 
-    // Logging worker thread and function
-    std::unique_ptr<std::thread> pLoggerThread;
-    struct LogLoopArgs {
-        std::queue<juce::String, std::deque<juce::String>>& queue;
-        std::shared_mutex & queueMutex;
+    private:
+        // Logger thread
+        void logLoop();
+        bool logNextRecord();
+        void logDropped(const juce::uint32 dropped);
+        juce::String formatRecord(const Record & record) const;
+
+        // Logger.  Only use while the worker thread is not created nor joined.
         std::shared_ptr<juce::FileLogger> pLogger;
+
+        // Binary logs.  Only used by the worker thread.
+        std::shared_ptr<BinaryLogSink> pBinarySink;
+
+        // The ring: producers claim records at enqueuePosition; the logger
+        // thread reads them at dequeuePosition.
+        std::unique_ptr<Record[]> ring;
+        std::atomic<juce::uint32> enqueuePosition { 0 };
+        juce::uint32 dequeuePosition = 0;
+
+        // For the timestamps
+        const juce::int64 startTicks;
+
+        // The tags of the tagged loggers
+        std::mutex tagLock;
+        std::deque<std::string> tags;
+
+        // Logging worker thread.  It sleeps on a semaphore while the ring is
+        // empty; the producer whose record makes it non-empty posts it, which
+        // never blocks.  Records published and not yet logged are counted in
+        // pendingRecords to tell when that is.  With a binary sink, it also
+        // wakes flushAfterMs after the last record, to flush the batch.  It's
+        // posted to exit, too.
+        static const int flushAfterMs = 50;
+        std::unique_ptr<std::thread> pLoggerThread;
+        Semaphore wakeUp;
+        std::atomic<int> pendingRecords { 0 };
+        std::atomic<bool> stopping { false };
     };
-    void logLoop(LogLoopArgs args);
-    
-    // Message queue and protection
-    std::queue<juce::String, std::deque<juce::String>> queue;
-    std::shared_mutex queueMutex;
+
+    // A tagged logger
+    MTLogger(std::shared_ptr<Core> _pCore, const char * _tag);
+
+    void setArgs(Record &) noexcept {}
+
+    template <typename T, typename... Rest>
+    void setArgs(Record & record, const T arg, const Rest... rest) noexcept
+    {
+        static_assert(std::is_arithmetic<T>::value, "only numbers can be logged with a format");
+        Arg & out = record.args[record.numArgs++];
+        out.isInteger = std::is_integral<T>::value;
+        out.integer = out.isInteger ? static_cast<juce::int64>(arg) : 0;
+        out.real = static_cast<double>(arg);
+        setArgs(record, rest...);
+    }
+
+    std::shared_ptr<Core> pCore;
+
+    // This logger's tag, kept by the core; null if it has none.
+    const char * tag = nullptr;
 };
 
 }
-
@@ -0,0 +1,106 @@
+#include "MidiCoalescer.h"
+
+using namespace juce;
+using namespace juce_igutil;
+
+void MidiCoalescer::prepare(const int _windowSamples, const size_t maxMidiBytes)
+{
+    jassert(_windowSamples >= 1);
+    windowSamples = jmax(1, _windowSamples);
+    outputMidi.ensureSize(maxMidiBytes);
+    numPending = 0;
+}
+
+/**
+ * Poly aftertouch, channel pressure, pitch wheel, and the continuous CCs.
+ */
+bool MidiCoalescer::isCoalescable(const juce::uint8 * pData, const int numBytes) noexcept
+{
+    if (numBytes < 2)
+        return false;
+    switch (pData[0] & 0xf0) {
+        case 0xa0:
+        case 0xe0:
+            return numBytes == 3;
+        case 0xd0:
+            return true;
+        case 0xb0: {
+            if (numBytes != 3)
+                return false;
+            const int controller = pData[1];
+            // bank select; data entry; NRPN and RPN numbers and increments;
+            // channel mode messages
+            return controller != 0 && controller != 32 && controller != 6 && controller != 38
+                && (controller < 96 || controller > 101) && controller < 120;
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * One pass over the block.  A controller starts its window's pending list or
+ * replaces the pending one with the same key (status, and controller or note
+ * number); anything else flushes the list and goes out as it is.
+ */
+const juce::MidiBuffer & MidiCoalescer::process(const juce::MidiBuffer & inputMidi) noexcept
+{
+    if (windowSamples <= 1 || inputMidi.isEmpty())
+        return inputMidi;
+
+    outputMidi.clear();
+    numPending = 0;
+    windowStart = 0;
+    lastPassedPosition = 0;
+    for (const auto metadata : inputMidi) {
+        const int position = metadata.samplePosition;
+        if (!isCoalescable(metadata.data, metadata.numBytes)) {
+            flush();
+            outputMidi.addEvent(metadata.data, metadata.numBytes, position);
+            lastPassedPosition = position;
+            continue;
+        }
+
+        const int start = (position / windowSamples) * windowSamples;
+        if (start != windowStart) {
+            flush();
+            windowStart = start;
+        }
+        const auto type = metadata.data[0] & 0xf0;
+        const juce::uint16 key = static_cast<juce::uint16>(metadata.data[0]
+            | ((type == 0xa0 || type == 0xb0) ? metadata.data[1] << 8 : 0));
+        int ix = 0;
+        while (ix < numPending && pending[ix].key != key) {
+            ++ix;
+        }
+        if (ix < numPending) {
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            if (numPending == maxPending) {
+                flush();
+                ix = 0;
+            }
+            ++numPending;
+        }
+        Pending & entry = pending[ix];
+        entry.key = key;
+        std::memcpy(entry.data, metadata.data, static_cast<size_t>(metadata.numBytes));
+        entry.numBytes = metadata.numBytes;
+    }
+    flush();
+    return outputMidi;
+}
+
+/**
+ * At the start of the window, unless something that went out as it was came
+ * later than that.
+ */
+void MidiCoalescer::flush() noexcept
+{
+    const int position = jmax(windowStart, lastPassedPosition);
+    for (int ix = 0; ix < numPending; ++ix) {
+        outputMidi.addEvent(pending[ix].data, pending[ix].numBytes, position);
+    }
+    numPending = 0;
+}
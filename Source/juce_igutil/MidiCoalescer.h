@@ -0,0 +1,80 @@
+/**
+ * MidiCoalescer
+ *
+ * Thins out dense controller streams (CCs, pitch wheel, channel and poly
+ * aftertouch, e.g. from MPE controllers or automation) before they reach the
+ * synth, where each one is passed to every voice and splits the block.  The
+ * block is divided into windows of a fixed number of samples; within each,
+ * only the last value of each controller on each channel is kept, at the
+ * start of the window.  Voices ramp to each new value over a window (see
+ * WavetableOscillator::pitchWheelMoved()), so a sweep is a series of joined
+ * up ramps rather than a staircase.
+ *
+ * Notes, and the other events, are never moved or dropped, and controllers
+ * aren't moved or coalesced across them, so e.g. a sustain pedal change
+ * still comes after a note off before it.  Controllers whose messages only
+ * make sense together (bank select, RPN/NRPN and data entry) and channel mode
+ * messages are left alone too.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace juce_igutil {
+
+class MidiCoalescer
+{
+public:
+
+    // Most controllers kept per window before the window is flushed early
+    static const int maxPending = 64;
+
+    MidiCoalescer() = default;
+
+    // Set the window, and reserve the output.  Not while processing.
+    void prepare(const int windowSamples, const size_t maxMidiBytes);
+
+    // Coalesce a block's controllers.  Returns inputMidi itself if the
+    // window is a sample or less, otherwise the coalesced copy, valid until
+    // the next call.  Audio thread.
+    const juce::MidiBuffer & process(const juce::MidiBuffer & inputMidi) noexcept;
+
+    // Controller messages dropped, since they were replaced in their window.
+    // Any thread.
+    juce::int64 getCoalescedCount() const noexcept {
+        return coalesced.load(std::memory_order_relaxed);
+    }
+
+    // Is this a message whose value can replace an earlier one's?
+    static bool isCoalescable(const juce::uint8 * pData, const int numBytes) noexcept;
+
+private:
+
+    // A controller waiting for the end of its window
+    struct Pending
+    {
+        juce::uint16 key;
+        juce::uint8 data[3];
+        int numBytes;
+    };
+
+    // Add the pending controllers to the output
+    void flush() noexcept;
+
+    int windowSamples = 1;
+    juce::MidiBuffer outputMidi;
+
+    // the window being coalesced, and its controllers in the order they
+    // first appeared
+    int windowStart = 0;
+    int lastPassedPosition = 0;
+    Pending pending[maxPending];
+    int numPending = 0;
+
+    std::atomic<juce::int64> coalesced { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MidiCoalescer)
+};
+
+}
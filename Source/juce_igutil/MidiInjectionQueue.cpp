@@ -0,0 +1,122 @@
+#include "MidiInjectionQueue.h"
+
+using namespace juce;
+using namespace juce_igutil;
+
+namespace {
+
+// Room reserved in the merged midi for the host's events, on top of the
+// injected ones; more than this and the merged buffer has to grow.
+const int reservedHostEvents = 2048;
+
+// Bytes a short message takes up in a MidiBuffer (position, size, data)
+const int bytesPerEvent = sizeof(int32) + sizeof(uint16) + 3;
+
+}
+
+MidiInjectionQueue::MidiInjectionQueue():
+    ring(new Cell[capacity]),
+    blockEvents(new Event[capacity]),
+    placed(new Placed[capacity])
+{
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of 2");
+    for (int ix = 0; ix < capacity; ++ix) {
+        ring[ix].sequence.store(static_cast<juce::uint32>(ix), std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Claim the next free cell, fill it in and hand it over; see
+ * MTLogger::Core::claimRecord().
+ */
+bool MidiInjectionQueue::push(const juce::MidiMessage & message) noexcept
+{
+    const int numBytes = message.getRawDataSize();
+    if (numBytes < 1 || numBytes > 3)
+        return false;
+
+    juce::uint32 position = enqueuePosition.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell & cell = ring[position & (capacity - 1)];
+        const juce::uint32 sequence = cell.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<juce::int32>(sequence - position);
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.event.ticks = Time::getHighResolutionTicks();
+                std::memcpy(cell.event.data, message.getRawData(), static_cast<size_t>(numBytes));
+                cell.event.numBytes = numBytes;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            // the audio thread hasn't caught up
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool MidiInjectionQueue::pop(Event & event) noexcept
+{
+    Cell & cell = ring[dequeuePosition & (capacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+        return false;
+
+    event = cell.event;
+    cell.sequence.store(dequeuePosition + capacity, std::memory_order_release);
+    ++dequeuePosition;
+    return true;
+}
+
+void MidiInjectionQueue::prepare(const double sampleRate, const int maxBlockSize)
+{
+    jassert(sampleRate > 0.0 && maxBlockSize > 0);
+    ignoreUnused(maxBlockSize);
+    samplesPerTick = sampleRate / static_cast<double>(Time::getHighResolutionTicksPerSecond());
+    mergedMidi.ensureSize(static_cast<size_t>((capacity + reservedHostEvents) * bytesPerEvent));
+}
+
+/**
+ * Drain the ring, place each message a block after it was pushed, and merge
+ * them with the host's in sample order (the host's first, at the same
+ * sample).  Placing messages in order of arrival keeps each producer's in the
+ * order they were pushed.
+ */
+juce::MidiBuffer & MidiInjectionQueue::merge(juce::MidiBuffer & hostMidi, const int numSamples) noexcept
+{
+    jassert(samplesPerTick > 0.0);
+    int numPlaced = 0;
+    const juce::int64 now = Time::getHighResolutionTicks();
+    while (numPlaced < capacity && pop(blockEvents[numPlaced])) {
+        const Event & event = blockEvents[numPlaced];
+        const double age = static_cast<double>(now - event.ticks) * samplesPerTick;
+        const int sample = jlimit(0, jmax(0, numSamples - 1), numSamples - roundToInt(age));
+        // insertion sort; events mostly arrive in order already
+        int ix = numPlaced;
+        while (ix > 0 && placed[ix - 1].sample > sample) {
+            placed[ix] = placed[ix - 1];
+            --ix;
+        }
+        placed[ix] = { sample, &event };
+        ++numPlaced;
+    }
+    if (numPlaced == 0)
+        return hostMidi;
+
+    mergedMidi.clear();
+    int next = 0;
+    for (const auto metadata : hostMidi) {
+        for (; next < numPlaced && placed[next].sample < metadata.samplePosition; ++next) {
+            mergedMidi.addEvent(placed[next].pEvent->data, placed[next].pEvent->numBytes, placed[next].sample);
+        }
+        mergedMidi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition);
+    }
+    for (; next < numPlaced; ++next) {
+        mergedMidi.addEvent(placed[next].pEvent->data, placed[next].pEvent->numBytes, placed[next].sample);
+    }
+    return mergedMidi;
+}
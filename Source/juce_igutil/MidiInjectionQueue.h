@@ -0,0 +1,93 @@
+/**
+ * MidiInjectionQueue
+ *
+ * Midi from anywhere other than the host (the onscreen keyboard, a test
+ * harness, a sequencer or script) on its way to the audio thread.  Any number
+ * of threads can push short messages, timestamped as they're pushed, into a
+ * fixed-size ring without locking or allocating; the audio thread merges them
+ * into each block's midi, in sample order, the same way.  Nothing a producer
+ * does can make the audio thread wait, and when the ring is full, messages
+ * are dropped and counted rather than waited for.
+ *
+ * Messages are placed in a block a block after they were pushed (as
+ * juce::MidiMessageCollector does), so the spacing between them is kept.
+ * Anything older than that goes at the start of the block.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace juce_igutil {
+
+class MidiInjectionQueue
+{
+public:
+
+    // A message in the ring
+    struct Event
+    {
+        juce::int64 ticks = 0;
+        juce::uint8 data[3] = { 0, 0, 0 };
+        int numBytes = 0;
+    };
+
+    // Ring size, and most messages merged into one block
+    static const int capacity = 1024;
+
+    MidiInjectionQueue();
+
+    // Producers, any thread.  Only short (1 - 3 byte) messages can be pushed;
+    // returns false for anything else, or if the ring is full.
+    bool push(const juce::MidiMessage & message) noexcept;
+
+    // Consumer: the next message, if there is one.  Only one thread may pop
+    // (or merge) at a time.
+    bool pop(Event & event) noexcept;
+
+    // Audio thread: set the sample rate and reserve the merged block's midi.
+    // Not while merging.
+    void prepare(const double sampleRate, const int maxBlockSize);
+
+    // Audio thread: merge the messages pushed since the last block into this
+    // one's.  Returns hostMidi itself if there were none, otherwise a merged
+    // copy, which is valid until the next call.
+    juce::MidiBuffer & merge(juce::MidiBuffer & hostMidi, const int numSamples) noexcept;
+
+    // Messages dropped because the ring was full.  Any thread.
+    juce::uint32 getDroppedCount() const noexcept {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    // An event with its sequence number; see MTLogger's ring, which this
+    // works the same way as.
+    struct Cell
+    {
+        std::atomic<juce::uint32> sequence { 0 };
+        Event event;
+    };
+
+    std::unique_ptr<Cell[]> ring;
+    std::atomic<juce::uint32> enqueuePosition { 0 };
+    juce::uint32 dequeuePosition = 0;
+    std::atomic<juce::uint32> dropped { 0 };
+
+    // Set in prepare()
+    double samplesPerTick = 0.0;
+
+    // The block's injected events, as sample positions, and the merged midi
+    struct Placed
+    {
+        int sample;
+        const Event * pEvent;
+    };
+    std::unique_ptr<Event[]> blockEvents;
+    std::unique_ptr<Placed[]> placed;
+    juce::MidiBuffer mergedMidi;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiInjectionQueue)
+};
+
+}
@@ -45,6 +45,25 @@ public:
     {
         // empty
     }
+
+    /** No tail. */
+    int getTailSamples() const noexcept override
+    {
+        return 0;
+    }
+
+    /** Never does anything. */
+    bool isSkipping() const noexcept override
+    {
+        return true;
+    }
+
+    /** Always transparent. */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        gain = 1.0f;
+        return true;
+    }
 };
 
 }
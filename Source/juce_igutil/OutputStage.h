@@ -0,0 +1,222 @@
+/**
+ * The end of a synth's signal path: overall gain, clipping, metering and a
+ * tap for analysis, fused into one pass.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace juce_igutil {
+
+/**
+ * Applies the overall gain (ramped from one block's value to the next),
+ * clips the result, measures its peak and RMS level and hands it to a tap
+ * (e.g. a scope), in one sweep over each channel instead of a pass for each.
+ *
+ * Each channel is done in juce::dsp::SIMDRegister lanes, with scalar loops
+ * for the samples before the first aligned one and after the last whole
+ * register.  The tap is called for its channel straight after the channel
+ * is done, while it's still in cache.
+ *
+ * The levels are measured after the gain and before clipping, so a peak over
+ * the clip level shows that the output was clipped.
+ *
+ * A signal that's already had its gain and is already bounded (e.g. by a 
+ * limiter) just needs measure(), which only reads it.
+ */
+class OutputStage
+{
+public:
+
+    // A block's levels
+    struct Levels
+    {
+        float peak = 0.0f;
+        float rms = 0.0f;
+    };
+
+    // Given the finished samples of the tapped channel.
+    using Tap = std::function<void(const float * pSamples, int numSamples)>;
+
+    /**
+     * Clip samples to +/- this level.  0 (the default) doesn't clip.
+     */
+    void setClipLevel(const float newClipLevel) noexcept
+    {
+        jassert(newClipLevel >= 0.0f);
+        clipLevel = newClipLevel;
+    }
+
+    float getClipLevel() const noexcept
+    {
+        return clipLevel;
+    }
+
+    /**
+     * Would a signal already kept within +/- ceiling still need clipping?  A
+     * ceiling of 0 means it's not bounded.
+     */
+    bool needsClipping(const float ceiling) const noexcept
+    {
+        return clipLevel > 0.0f && (ceiling <= 0.0f || ceiling > clipLevel);
+    }
+
+    /**
+     * Set the tap and the channel it's given.  Not while processing.
+     */
+    void setTap(Tap newTap, const int channel = 0)
+    {
+        tap = std::move(newTap);
+        tapChannel = channel;
+    }
+
+    /**
+     * Process a block, ramping the gain from startGain at its first sample
+     * towards endGain, as AudioBuffer::applyGainRamp() does.
+     */
+    void process(
+        juce::AudioBuffer<float> & buffer,
+        const float startGain,
+        const float endGain
+    ) noexcept
+    {
+        processBlock<true>(buffer, startGain, endGain);
+    }
+
+    /**
+     * Just measure the levels and call the tap, for a block that needs no
+     * gain or clipping.  The samples are left as they are.
+     */
+    void measure(juce::AudioBuffer<float> & buffer) noexcept
+    {
+        processBlock<false>(buffer, 1.0f, 1.0f);
+    }
+
+    // The levels of the last block processed
+    const Levels & getLevels() const noexcept
+    {
+        return levels;
+    }
+
+private:
+
+    using SIMDType = juce::dsp::SIMDRegister<float>;
+    static constexpr int simdWidth = static_cast<int>(SIMDType::SIMDNumElements);
+
+    template <bool applyGainAndClip>
+    void processBlock(
+        juce::AudioBuffer<float> & buffer,
+        const float startGain,
+        const float endGain
+    ) noexcept
+    {
+        const int numChannels = buffer.getNumChannels();
+        const int numSamples = buffer.getNumSamples();
+        if (numSamples <= 0) {
+            levels = Levels();
+            return;
+        }
+
+        const float gainStep = (endGain - startGain) / static_cast<float>(numSamples);
+        float peak = 0.0f;
+        double sumSquares = 0.0;
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pSamples = buffer.getWritePointer(chan);
+            processChannel<applyGainAndClip>(pSamples, numSamples, startGain, gainStep, peak, sumSquares);
+            if (tap && chan == tapChannel) {
+                tap(pSamples, numSamples);
+            }
+        }
+
+        levels.peak = peak;
+        levels.rms = numChannels > 0 ?
+            static_cast<float>(std::sqrt(sumSquares / (static_cast<double>(numChannels) * numSamples))) :
+            0.0f;
+    }
+
+    // One channel: gain, meter, clip; or just meter.
+    template <bool applyGainAndClip>
+    void processChannel(
+        float * pSamples,
+        const int numSamples,
+        const float startGain,
+        const float gainStep,
+        float & peak,
+        double & sumSquares
+    ) const noexcept
+    {
+        const float limit = clipLevel > 0.0f ? clipLevel : std::numeric_limits<float>::max();
+
+        // the samples before the first aligned one
+        const int head = juce::jmin(
+            numSamples, static_cast<int>(SIMDType::getNextSIMDAlignedPtr(pSamples) - pSamples));
+        const int numVectors = (numSamples - head) / simdWidth;
+        const int tail = head + numVectors * simdWidth;
+
+        float scalarSquares = 0.0f;
+        for (int ix = 0; ix < head; ++ix) {
+            processSample<applyGainAndClip>(pSamples[ix], startGain + gainStep * ix, limit, peak, scalarSquares);
+        }
+
+        if (numVectors > 0) {
+            alignas(SIMDType::SIMDRegisterSize) float lanes[simdWidth];
+            for (int lane = 0; lane < simdWidth; ++lane) {
+                lanes[lane] = startGain + gainStep * (head + lane);
+            }
+            SIMDType gains = SIMDType::fromRawArray(lanes);
+            const SIMDType gainSteps = SIMDType::expand(gainStep * simdWidth);
+            const SIMDType high = SIMDType::expand(limit);
+            const SIMDType low = SIMDType::expand(-limit);
+            SIMDType peaks = SIMDType::expand(0.0f);
+            SIMDType squares = SIMDType::expand(0.0f);
+
+            for (float * p = pSamples + head; p < pSamples + tail; p += simdWidth) {
+                const SIMDType x = applyGainAndClip ? SIMDType::fromRawArray(p) * gains : SIMDType::fromRawArray(p);
+                peaks = SIMDType::max(peaks, SIMDType::abs(x));
+                squares += x * x;
+                if (applyGainAndClip) {
+                    SIMDType::max(low, SIMDType::min(high, x)).copyToRawArray(p);
+                    gains += gainSteps;
+                }
+            }
+
+            peaks.copyToRawArray(lanes);
+            for (int lane = 0; lane < simdWidth; ++lane) {
+                peak = juce::jmax(peak, lanes[lane]);
+            }
+            sumSquares += squares.sum();
+        }
+
+        for (int ix = tail; ix < numSamples; ++ix) {
+            processSample<applyGainAndClip>(pSamples[ix], startGain + gainStep * ix, limit, peak, scalarSquares);
+        }
+        sumSquares += scalarSquares;
+    }
+
+    template <bool applyGainAndClip>
+    static inline void processSample(
+        float & sample,
+        const float gain,
+        const float limit,
+        float & peak,
+        float & squares
+    ) noexcept
+    {
+        const float x = applyGainAndClip ? sample * gain : sample;
+        peak = juce::jmax(peak, std::abs(x));
+        squares += x * x;
+        if (applyGainAndClip) {
+            sample = juce::jlimit(-limit, limit, x);
+        }
+    }
+
+    float clipLevel = 0.0f;
+
+    Tap tap;
+    int tapChannel = 0;
+
+    Levels levels;
+};
+
+}
@@ -0,0 +1,408 @@
+/**
+ * Runs another processor a couple of chunks behind, on its own thread.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+#include "juce_igutil/RealtimeSanitizer.h"
+#include "juce_igutil/Semaphore.h"
+
+namespace juce_igutil {
+
+/**
+ * Runs another processor (e.g. the whole effects sequence) on a thread of its
+ * own, behind the caller, so the two overlap: while the caller renders the
+ * voices for the next chunk, this thread runs the effects on the last one.
+ *
+ * The blocks given to process() can be much smaller than is worth a handoff
+ * between threads (e.g. micro-blocks), so they're collected into chunks of a
+ * fixed size, and only whole chunks are handed over.  The thread runs the
+ * inner processor over a chunk in blocks of up to maximumBlockSize, as it was
+ * prepared for.  A chunk is handed over as soon as it's full, and has to be
+ * done by the time the next one is, so what comes out is two chunks behind:
+ * that's the latency, reported with the inner processor's.
+ *
+ * process() fills the chunk, and returns the oldest processed samples from a
+ * FIFO, which starts with two chunks of silence.  When the chunk is full it
+ * waits for the thread to finish the previous one and hands it over.  The
+ * handoff is one atomic state flag; each side only touches the buffers while
+ * the flag says they're its own.  If the thread still hasn't started on a
+ * chunk when the next one is full (e.g. it was slow to wake), process() takes
+ * it back and runs it itself rather than wait an unbounded time.
+ *
+ * The inner processor can only be changed safely while the thread is idle,
+ * so anything that sets it up per chunk should be done in the callback given
+ * to the constructor, which process() calls at that point.  For the same
+ * reason its latency and tail are read into atomics whenever it's idle, and
+ * reported from there.
+ */
+class PipelinedProcessor: public juce_igutil::Processor
+{
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param pProcessorToRun the processor to run on the thread.
+     * @param chunkSamples the samples handed over at a time (at least
+     *                     maximumBlockSize).
+     * @param whileIdle called from process() on the audio thread, while the
+     *                  thread is idle, before a chunk is handed over.
+     */
+    PipelinedProcessor(
+        std::shared_ptr<Processor> pProcessorToRun,
+        const int chunkSamples,
+        std::function<void()> whileIdle = nullptr
+    ):
+        Processor(),
+        pInner(pProcessorToRun),
+        requestedChunkSamples(chunkSamples),
+        onIdle(std::move(whileIdle)),
+        thread(*this)
+    {
+        jassert(pInner);
+        jassert(chunkSamples > 0);
+    }
+
+    /** Destructor; stops the thread. */
+    virtual ~PipelinedProcessor() override
+    {
+        thread.signalThreadShouldExit();
+        thread.wakeEvent.signal();
+        thread.stopThread(1000);
+    }
+
+    /** Prepare to process audio.  Starts the thread the first time. */
+    void prepare(const juce::dsp::ProcessSpec& spec) override
+    {
+        waitUntilIdle();
+        pInner->prepare(spec);
+        updateInnerState();
+        innerBlockSize = static_cast<int>(spec.maximumBlockSize);
+        chunkSize = juce::jmax(requestedChunkSamples, innerBlockSize);
+        for (auto & chunk : chunks) {
+            chunk.setSize(spec.numChannels, chunkSize);
+        }
+        fifo.setSize(spec.numChannels, 3 * chunkSize);
+        clearFifo();
+
+        if (!thread.isThreadRunning()) {
+            thread.startThread(juce::Thread::realtimeAudioPriority);
+        }
+    }
+
+    /**
+     * Add this block to the chunk, handing the chunk over if that fills it,
+     * and output the block from two chunks ago.
+     */
+    void process(
+        juce::dsp::ProcessContextReplacing<float> & context
+    ) noexcept override
+    {
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        const int numChannels = juce::jmin(static_cast<int>(block.getNumChannels()), fifo.getNumChannels());
+        jassert(numSamples <= innerBlockSize);
+
+        // All of the input first, since the output replaces it.  Once a
+        // chunk is handed over, the one before it is in the FIFO.
+        for (int done = 0; done < numSamples; ) {
+            const int count = juce::jmin(numSamples - done, chunkSize - fillSamples);
+            for (int chan = 0; chan < numChannels; ++chan) {
+                juce::FloatVectorOperations::copy(
+                    chunks[fillIndex].getWritePointer(chan, fillSamples),
+                    block.getChannelPointer(chan) + done,
+                    count);
+            }
+            fillSilent = fillSilent && inputSilentHint;
+            fillSamples += count;
+            done += count;
+            if (fillSamples == chunkSize) {
+                handOver(numChannels);
+            }
+        }
+        inputSilentHint = false;
+
+        // The thread writes two chunks ahead of the samples read here.
+        const int capacity = fifo.getNumSamples();
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pOut = block.getChannelPointer(chan);
+            const float * pFifo = fifo.getReadPointer(chan);
+            const int first = juce::jmin(numSamples, capacity - readPosition);
+            juce::FloatVectorOperations::copy(pOut, pFifo + readPosition, first);
+            juce::FloatVectorOperations::copy(pOut + first, pFifo, numSamples - first);
+        }
+        readPosition = (readPosition + numSamples) % capacity;
+    }
+
+    /** Reset the inner processor and the pipeline. */
+    void reset() override
+    {
+        waitUntilIdle();
+        pInner->reset();
+        updateInnerState();
+        clearFifo();
+    }
+
+    /** Two chunks on top of the inner processor's latency. */
+    int getLatencySamples() const noexcept override
+    {
+        return 2 * chunkSize + innerLatency.load(std::memory_order_relaxed);
+    }
+
+    /** The inner processor's tail comes out two chunks later. */
+    int getTailSamples() const noexcept override
+    {
+        const int innerTail = innerTailSamples.load(std::memory_order_relaxed);
+        return innerTail >= infiniteTail - 2 * chunkSize ? infiniteTail : innerTail + 2 * chunkSize;
+    }
+
+    /**
+     * Never a plain gain, even when the inner processor is.  Folding it
+     * would skip the chunks in the FIFO, and the pipeline's latency would
+     * disappear from the output (but not from what's reported) until it
+     * was run again.
+     */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        return false;
+    }
+
+    /**
+     * Whether the inner processor skipped every block of the last chunk it
+     * finished: the one coming out now, or the one after it if it's done
+     * already.
+     */
+    bool isSkipping() const noexcept override
+    {
+        return innerSkipping.load(std::memory_order_relaxed);
+    }
+
+    /** Passed on with the chunk, if every block in it was silent. */
+    void setInputSilent(const bool isSilent) noexcept override
+    {
+        inputSilentHint = isSilent;
+    }
+
+    /** Activate/deactivate the inner processor. */
+    void setActive(const bool isActive) noexcept override
+    {
+        waitUntilIdle();
+        pInner->setActive(isActive);
+        updateInnerState();
+    }
+
+    /** Pass realtime/offline rendering on to the inner processor. */
+    void setNonRealtime(const bool isNonRealtime) noexcept override
+    {
+        waitUntilIdle();
+        pInner->setNonRealtime(isNonRealtime);
+        updateInnerState();
+    }
+
+    /** The handoff buffers and the inner processor's. */
+    void prefault(RealtimeMemory & memory) override
+    {
+        waitUntilIdle();
+        for (auto & chunk : chunks) {
+            memory.add(chunk);
+        }
+        memory.add(fifo);
+        pInner->prefault(memory);
+    }
+
+    void handlePendingUpdates() override
+    {
+        pInner->handlePendingUpdates();
+    }
+
+private:
+
+    // handoff states: waiting for a block, handed over, being processed
+    static const int idle = 0;
+    static const int busy = 1;
+    static const int working = 2;
+
+    // How many times the audio thread looks for the thread to have started
+    // on the last chunk before it processes the chunk itself.
+    static const int maxWaitSpins = 2000;
+
+    class FxThread: public juce::Thread
+    {
+    public:
+        FxThread(PipelinedProcessor & owner):
+            juce::Thread("PipelinedProcessor"),
+            pipeline(owner)
+        {
+            // empty
+        }
+
+        // Spin for a while after each chunk, since the next one is usually
+        // close; then sleep until signalled.
+        void run() override
+        {
+            while (!threadShouldExit()) {
+                bool found = false;
+                for (int spin = 0; spin < spinCount && !found; ++spin) {
+                    found = pipeline.processPendingBlock();
+                }
+                if (found) {
+                    continue;
+                }
+                sleeping.store(true);
+                if (!pipeline.processPendingBlock()) {
+                    wakeEvent.wait(sleepTimeoutMs);
+                }
+                sleeping.store(false);
+            }
+        }
+
+        // set while the thread is (about to be) waiting for a signal
+        std::atomic<bool> sleeping { false };
+
+        // Signalled from the audio thread, so not Thread::notify(), which
+        // takes a lock
+        WakeEvent wakeEvent;
+
+    private:
+        static const int spinCount = 4000;
+        static const int sleepTimeoutMs = 100;
+        PipelinedProcessor & pipeline;
+    };
+
+    // Audio thread: wait for the thread to finish the last chunk, or do it
+    // here if the thread hasn't started on it after maxWaitSpins looks.
+    void waitUntilIdle() noexcept
+    {
+        for (int spin = 0; state.load(std::memory_order_acquire) != idle; ++spin) {
+            if (spin >= maxWaitSpins) {
+                processPendingBlock();
+            }
+        }
+    }
+
+    // Read the inner processor's latency and tail.  Only while idle, or on
+    // the thread.
+    void updateInnerState() noexcept
+    {
+        innerLatency.store(pInner->getLatencySamples(), std::memory_order_relaxed);
+        innerTailSamples.store(pInner->getTailSamples(), std::memory_order_relaxed);
+    }
+
+    // Empty the FIFO and fill it with two chunks of silence, and start a new
+    // chunk.  Only while idle.
+    void clearFifo()
+    {
+        fifo.clear();
+        readPosition = 0;
+        writePosition = 2 * chunkSize;
+        fillSamples = 0;
+        fillSilent = true;
+    }
+
+    // Audio thread: wait for the thread to finish the last chunk, and give
+    // it the one just filled.
+    void handOver(const int numChannels) noexcept
+    {
+        waitUntilIdle();
+        if (onIdle) {
+            onIdle();
+            updateInnerState();
+        }
+
+        blockIndex = fillIndex;
+        blockChannels = numChannels;
+        blockSilent = fillSilent;
+        fillIndex = 1 - fillIndex;
+        fillSamples = 0;
+        fillSilent = true;
+        // Sequentially consistent, like the thread's store to sleeping and
+        // its load of state: either it sees the chunk before sleeping, or
+        // it's seen to be sleeping here.
+        state.store(busy);
+        if (thread.sleeping.load()) {
+            thread.wakeEvent.signal();
+        }
+    }
+
+    // Thread (or the audio thread, if the thread is late): process the chunk
+    // if there is one nobody has started on, and put it in the FIFO.
+    bool processPendingBlock() noexcept
+    {
+        int expected = busy;
+        if (state.load() != busy || !state.compare_exchange_strong(expected, working)) {
+            return false;
+        }
+        RT_SANITIZER_REALTIME_SCOPE;
+
+        juce::AudioBuffer<float> & chunk = chunks[blockIndex];
+        juce::dsp::AudioBlock<float> chunkBlock(
+            chunk.getArrayOfWritePointers(), static_cast<size_t>(blockChannels), static_cast<size_t>(chunkSize));
+        bool skipping = true;
+        for (int start = 0; start < chunkSize; start += innerBlockSize) {
+            auto innerBlock = chunkBlock.getSubBlock(
+                static_cast<size_t>(start), static_cast<size_t>(juce::jmin(innerBlockSize, chunkSize - start)));
+            juce::dsp::ProcessContextReplacing<float> innerContext(innerBlock);
+            pInner->setInputSilent(blockSilent);
+            pInner->process(innerContext);
+            skipping = skipping && pInner->isSkipping();
+        }
+        innerSkipping.store(skipping, std::memory_order_relaxed);
+        updateInnerState();
+
+        const int capacity = fifo.getNumSamples();
+        const int first = juce::jmin(chunkSize, capacity - writePosition);
+        for (int chan = 0; chan < blockChannels; ++chan) {
+            float * pFifo = fifo.getWritePointer(chan);
+            const float * pIn = chunk.getReadPointer(chan);
+            juce::FloatVectorOperations::copy(pFifo + writePosition, pIn, first);
+            juce::FloatVectorOperations::copy(pFifo, pIn + first, chunkSize - first);
+        }
+        writePosition = (writePosition + chunkSize) % capacity;
+
+        state.store(idle, std::memory_order_release);
+        return true;
+    }
+
+    std::shared_ptr<Processor> pInner;
+    const int requestedChunkSamples;
+    std::function<void()> onIdle;
+
+    // Set in prepare()
+    int innerBlockSize = 0;
+    int chunkSize = 0;
+
+    // Handoff between the audio thread and ours
+    std::atomic<int> state { idle };
+
+    // Two chunks: the audio thread fills one while the other is handed over.
+    juce::AudioBuffer<float> chunks[2];
+    int fillIndex = 0;
+    int fillSamples = 0;
+    bool fillSilent = true;
+
+    // The chunk handed over; the thread's while busy.
+    int blockIndex = 0;
+    int blockChannels = 0;
+    bool blockSilent = false;
+
+    // Processed samples.  The audio thread reads from readPosition; the
+    // thread writes at writePosition.
+    juce::AudioBuffer<float> fifo;
+    int readPosition = 0;
+    int writePosition = 0;
+
+    bool inputSilentHint = false;
+    std::atomic<bool> innerSkipping { false };
+
+    // The inner processor's latency and tail, as of when it was last idle
+    std::atomic<int> innerLatency { 0 };
+    std::atomic<int> innerTailSamples { 0 };
+
+    FxThread thread;
+};
+
+}
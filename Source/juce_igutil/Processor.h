@@ -8,6 +8,8 @@
 
 #include <JuceHeader.h>
 
+#include "RealtimeMemory.h"
+
 namespace juce_igutil {
 
 class Processor
@@ -20,6 +22,9 @@ public:
     /** Destructor. */
     virtual ~Processor() = default;
 
+    /** Tail length for processors that can ring forever, or don't know. */
+    static const int infiniteTail = std::numeric_limits<int>::max();
+
     /** Prepare to process audio.  */
     virtual void prepare(const juce::dsp::ProcessSpec& spec) = 0;
 
@@ -36,6 +41,121 @@ public:
      * TODO this is too similar to [smart pointer].reset(). Consider renaming. 
      */
     virtual void reset() = 0;
+
+    /**
+     * The latency this processor adds, in samples.  This is reported to the 
+     * host.  Called from the audio thread.
+     */
+    virtual int getLatencySamples() const noexcept
+    {
+        return 0;
+    }
+
+    /**
+     * How long the output can carry on after the input goes silent, in 
+     * samples.  Valid after prepare().  ProcessorSequence skips processors 
+     * whose input has been silent for longer than this, so the default is to 
+     * never be skipped.
+     */
+    virtual int getTailSamples() const noexcept
+    {
+        return infiniteTail;
+    }
+
+    /**
+     * Hint that the input to the next process() call is known to be silent, 
+     * so there's no need to look.  Only ever a hint: it may not be given even
+     * when the input is silent.
+     */
+    virtual void setInputSilent(const bool isSilent) noexcept
+    {
+        // empty
+    }
+
+    /**
+     * If the processor's current settings make it a plain gain, set gain and
+     * return true; 1.0 means it's transparent.  ProcessorSequence then skips
+     * the processor and folds the gain into its neighbours, crossfading 
+     * whenever that changes.  Called from the audio thread once per block.
+     */
+    virtual bool getPureGain(float & gain) const noexcept
+    {
+        return false;
+    }
+
+    /**
+     * Offer a gain to apply to the input of the next process() call, ramped
+     * from startGain at its first sample towards endGain, as 
+     * AudioBuffer::applyGainRamp() does.  Return true if process() will apply
+     * it as part of its own pass over the block; otherwise the caller applies
+     * it first.  Called from the audio thread.
+     */
+    virtual bool setInputGain(const float startGain, const float endGain) noexcept
+    {
+        return false;
+    }
+
+    /**
+     * The level the last process() call kept its output within, if the 
+     * processor bounds it (e.g. a limiter's ceiling), or 0 if it doesn't.  
+     * Lets the caller skip clipping a signal that can't need it.
+     */
+    virtual float getOutputCeiling() const noexcept
+    {
+        return 0.0f;
+    }
+
+    /**
+     * Called from the audio thread when the processor is put into (true) or 
+     * taken out of (false) the signal path.  Processors with expensive 
+     * resources can use this to only hold them while they're in use, but 
+     * must not allocate from here.
+     */
+    virtual void setActive(const bool isActive) noexcept
+    {
+        // empty
+    }
+
+    /**
+     * Called from the audio thread when the host switches between realtime 
+     * and offline rendering.
+     */
+    virtual void setNonRealtime(const bool isNonRealtime) noexcept
+    {
+        // empty
+    }
+
+    /**
+     * Give the buffers process() uses to memory, which makes them resident 
+     * (see RealtimeMemory).  Called after prepare(), not from the audio 
+     * thread.  Processors that wrap others pass it on.
+     */
+    virtual void prefault(RealtimeMemory & memory)
+    {
+        // empty
+    }
+
+    /**
+     * Did the last process() call leave the block as it was, since its input
+     * was silent and it had nothing left to output?  Processors that skip
+     * work that way (e.g. ProcessorSequence) say so; the rest always run.
+     */
+    virtual bool isSkipping() const noexcept
+    {
+        return false;
+    }
+
+    /**
+     * Called regularly on the message thread (from the plugin's timer) to do
+     * whatever the audio thread has asked for that it can't do itself, like
+     * allocating.  The audio thread just sets a flag for this to check, as
+     * waking the message thread takes a lock.  Processors that wrap others
+     * pass it on.
+     */
+    virtual void handlePendingUpdates()
+    {
+        // empty
+    }
 };
 
 }
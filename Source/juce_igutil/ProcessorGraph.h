@@ -0,0 +1,388 @@
+/**
+ * Runs processors wired together as a graph of parallel branches, with the
+ * branches shared out between the audio thread and a worker pool.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "juce_igutil/Processor.h"
+#include "juce_igutil/RealtimeWorkerPool.h"
+
+namespace juce_igutil {
+
+/**
+ * A Processor made of other processors connected in a graph rather than in a
+ * line, for parallel branches: sends and returns, dry/wet splits, a delay and
+ * a reverb side by side.
+ *
+ * Each node sums the outputs of its inputs (or takes the graph's input) into
+ * its own buffer and processes it there.  The graph's output is the sum of
+ * the output nodes.  Nodes have to be added after their inputs, so the order
+ * they're added in is always a valid order to run them in.
+ *
+ * Independent branches are run at the same time on a RealtimeWorkerPool.
+ * Every node has a count of inputs still to finish; the thread that finishes
+ * the last of them publishes the node to a ready list, and the threads take
+ * nodes from that list in turn.  Small graphs, where nothing can run side by
+ * side, are just run in order on the calling thread.
+ *
+ * Parallel branches aren't latency compensated; the graph reports the
+ * latency of its slowest path.
+ */
+class ProcessorGraph:
+    public juce_igutil::Processor,
+    private RealtimeWorkerPool::Job
+{
+public:
+
+    // Input index meaning the graph's own input.
+    static const int graphInput = -1;
+
+    // Most nodes a graph can have
+    static const int maxNodes = 64;
+
+    /**
+     * Constructor.
+     *
+     * @param pWorkerPool pool to run branches on; null to always run them on
+     *                    the calling thread.
+     */
+    explicit ProcessorGraph(std::shared_ptr<RealtimeWorkerPool> pWorkerPool = nullptr):
+        Processor(),
+        pPool(pWorkerPool)
+    {
+        // empty
+    }
+
+    // destructor
+    virtual ~ProcessorGraph() override = default;
+
+    /**
+     * Add a node.  Only before prepare().
+     *
+     * @param pProcessor the node's processor.
+     * @param inputs indexes of earlier nodes to sum into this one, or
+     *               graphInput.
+     * @param isOutput whether the node's output goes to the graph's output.
+     * @return the new node's index.
+     */
+    int addNode(
+        std::shared_ptr<Processor> pProcessor,
+        const std::vector<int> & inputs,
+        const bool isOutput)
+    {
+        jassert(pProcessor);
+        jassert(!inputs.empty());
+        jassert(static_cast<int>(nodes.size()) < maxNodes);
+        const int index = static_cast<int>(nodes.size());
+        nodes.emplace_back(new Node());
+        Node & node = *nodes.back();
+        node.pProcessor = std::move(pProcessor);
+        node.inputs = inputs;
+        node.isOutput = isOutput;
+        for (const int input : inputs) {
+            jassert(input == graphInput || (input >= 0 && input < index));
+            if (input != graphInput) {
+                nodes[input]->dependents.push_back(index);
+            }
+        }
+        updateSchedule();
+        return index;
+    }
+
+    /** Prepare to process audio.  */
+    void prepare(const juce::dsp::ProcessSpec& spec) override
+    {
+        processSpec = spec;
+        for (auto & pNode : nodes) {
+            pNode->pProcessor->prepare(spec);
+            pNode->buffer.setSize(spec.numChannels, spec.maximumBlockSize);
+        }
+        inputBuffer.setSize(spec.numChannels, spec.maximumBlockSize);
+        readyList.reset(new std::atomic<int>[nodes.size()]);
+    }
+
+    /**
+     * Process audio.
+     */
+    void process(
+        juce::dsp::ProcessContextReplacing<float> & context
+    ) noexcept override
+    {
+        auto & block = context.getOutputBlock();
+        numChannels = juce::jmin(static_cast<int>(block.getNumChannels()), inputBuffer.getNumChannels());
+        numSamples = static_cast<int>(block.getNumSamples());
+        jassert(numSamples <= inputBuffer.getNumSamples());
+
+        for (int chan = 0; chan < numChannels; ++chan) {
+            juce::FloatVectorOperations::copy(
+                inputBuffer.getWritePointer(chan), block.getChannelPointer(chan), numSamples);
+        }
+
+        if (runInParallel()) {
+            startJob();
+            pPool->run(*this);
+        }
+        else {
+            for (size_t ix = 0; ix < nodes.size(); ++ix) {
+                runNode(static_cast<int>(ix));
+            }
+        }
+
+        // sum the outputs
+        block.clear();
+        for (auto & pNode : nodes) {
+            if (pNode->isOutput) {
+                for (int chan = 0; chan < numChannels; ++chan) {
+                    juce::FloatVectorOperations::add(
+                        block.getChannelPointer(chan), pNode->buffer.getReadPointer(chan), numSamples);
+                }
+            }
+        }
+    }
+
+    /**
+     * Reset the internal state of the processor.
+     */
+    void reset() override
+    {
+        for (auto & pNode : nodes) pNode->pProcessor->reset();
+    }
+
+    /**
+     * The longest tail along any path through the graph.
+     */
+    int getTailSamples() const noexcept override
+    {
+        return longestPath([](const Processor & p) { return p.getTailSamples(); });
+    }
+
+    /**
+     * The latency of the slowest path.
+     */
+    int getLatencySamples() const noexcept override
+    {
+        return longestPath([](const Processor & p) { return p.getLatencySamples(); });
+    }
+
+    /**
+     * Activate/deactivate all the processors in the graph.
+     */
+    void setActive(const bool isActive) noexcept override
+    {
+        for (auto & pNode : nodes) pNode->pProcessor->setActive(isActive);
+    }
+
+    /**
+     * Pass realtime/offline rendering on to all the processors.
+     */
+    void setNonRealtime(const bool isNonRealtime) noexcept override
+    {
+        for (auto & pNode : nodes) pNode->pProcessor->setNonRealtime(isNonRealtime);
+    }
+
+    /**
+     * The nodes' buffers and all the processors' buffers.
+     */
+    void prefault(RealtimeMemory & memory) override
+    {
+        memory.add(inputBuffer);
+        for (auto & pNode : nodes) {
+            memory.add(pNode->buffer);
+            pNode->pProcessor->prefault(memory);
+        }
+    }
+
+    void handlePendingUpdates() override
+    {
+        for (auto & pNode : nodes) {
+            pNode->pProcessor->handlePendingUpdates();
+        }
+    }
+
+    // Query the number of nodes
+    int getNodeCount() const
+    {
+        return static_cast<int>(nodes.size());
+    }
+
+private:
+
+    // Graphs with fewer nodes than this aren't worth waking the workers for.
+    static const int minParallelNodes = 3;
+
+    struct Node {
+        std::shared_ptr<Processor> pProcessor;
+        std::vector<int> inputs;
+        std::vector<int> dependents;
+        bool isOutput = false;
+        // inputs still to finish this block
+        std::atomic<int> pendingInputs { 0 };
+        juce::AudioBuffer<float> buffer;
+    };
+
+    // Work out whether any nodes can run at the same time: nodes at the same
+    // depth (longest distance from the input) don't depend on each other.
+    void updateSchedule()
+    {
+        std::vector<int> depth(nodes.size(), 0);
+        std::vector<int> nodesAtDepth(nodes.size(), 0);
+        maxWidth = 0;
+        for (size_t ix = 0; ix < nodes.size(); ++ix) {
+            for (const int input : nodes[ix]->inputs) {
+                if (input != graphInput) {
+                    depth[ix] = juce::jmax(depth[ix], depth[input] + 1);
+                }
+            }
+            maxWidth = juce::jmax(maxWidth, ++nodesAtDepth[depth[ix]]);
+        }
+    }
+
+    bool runInParallel() const noexcept
+    {
+        return pPool && pPool->getNumWorkers() > 0
+            && maxWidth > 1 && static_cast<int>(nodes.size()) >= minParallelNodes;
+    }
+
+    // Longest path through the graph by some per-processor measure,
+    // saturating at infiniteTail.  The path lengths are kept on the stack, as
+    // this can be called from more than one thread at once (e.g. the audio
+    // thread for the tail while the host asks for the latency).
+    template <typename Measure>
+    int longestPath(Measure measure) const noexcept
+    {
+        // Nodes are in dependency order, so one pass does it.
+        int longest = 0;
+        int pathTo[maxNodes];
+        for (size_t ix = 0; ix < nodes.size(); ++ix) {
+            int fromInputs = 0;
+            for (const int input : nodes[ix]->inputs) {
+                if (input != graphInput) {
+                    fromInputs = juce::jmax(fromInputs, pathTo[input]);
+                }
+            }
+            const int own = measure(*nodes[ix]->pProcessor);
+            pathTo[ix] = (fromInputs >= infiniteTail - own) ? infiniteTail : fromInputs + own;
+            if (nodes[ix]->isOutput) {
+                longest = juce::jmax(longest, pathTo[ix]);
+            }
+        }
+        return longest;
+    }
+
+    // Sum a node's inputs into its buffer and process it.
+    void runNode(const int index) noexcept
+    {
+        Node & node = *nodes[index];
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pDest = node.buffer.getWritePointer(chan);
+            bool first = true;
+            for (const int input : node.inputs) {
+                const float * pSrc = input == graphInput ?
+                    inputBuffer.getReadPointer(chan) :
+                    nodes[input]->buffer.getReadPointer(chan);
+                if (first) {
+                    juce::FloatVectorOperations::copy(pDest, pSrc, numSamples);
+                }
+                else {
+                    juce::FloatVectorOperations::add(pDest, pSrc, numSamples);
+                }
+                first = false;
+            }
+        }
+
+        auto * const * ppChannels = node.buffer.getArrayOfWritePointers();
+        juce::dsp::AudioBlock<float> nodeBlock(
+            ppChannels, static_cast<size_t>(numChannels), static_cast<size_t>(numSamples));
+        juce::dsp::ProcessContextReplacing<float> nodeContext(nodeBlock);
+        node.pProcessor->process(nodeContext);
+    }
+
+    // Set the counters up for a block and publish the nodes that only take
+    // the graph's input.  Calling thread, before the workers see the job.
+    void startJob() noexcept
+    {
+        const int numNodes = static_cast<int>(nodes.size());
+        for (int ix = 0; ix < numNodes; ++ix) {
+            readyList[ix].store(-1, std::memory_order_relaxed);
+        }
+        readyCount.store(0, std::memory_order_relaxed);
+        nextToTake.store(0, std::memory_order_relaxed);
+        finishedCount.store(0, std::memory_order_relaxed);
+        for (int ix = 0; ix < numNodes; ++ix) {
+            Node & node = *nodes[ix];
+            int pending = 0;
+            for (const int input : node.inputs) {
+                if (input != graphInput) ++pending;
+            }
+            node.pendingInputs.store(pending, std::memory_order_relaxed);
+            if (pending == 0) {
+                publish(ix);
+            }
+        }
+    }
+
+    // Put a node whose inputs are all done on the ready list.
+    void publish(const int index) noexcept
+    {
+        const int slot = readyCount.fetch_add(1, std::memory_order_relaxed);
+        readyList[slot].store(index, std::memory_order_release);
+    }
+
+    // Job: take the next ready node, run it, and publish whatever that
+    // unblocks, until every node has been taken.
+    void work() noexcept override
+    {
+        const int numNodes = static_cast<int>(nodes.size());
+        for (;;) {
+            const int slot = nextToTake.fetch_add(1, std::memory_order_relaxed);
+            if (slot >= numNodes) {
+                return;
+            }
+            // The node for this slot may still be waiting on a branch that
+            // another thread is running.
+            int index;
+            while ((index = readyList[slot].load(std::memory_order_acquire)) < 0) {
+                // spin
+            }
+
+            runNode(index);
+
+            for (const int dependent : nodes[index]->dependents) {
+                if (nodes[dependent]->pendingInputs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    publish(dependent);
+                }
+            }
+            finishedCount.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    bool isDone() const noexcept override
+    {
+        return finishedCount.load(std::memory_order_acquire) == static_cast<int>(nodes.size());
+    }
+
+    // ProcessSpec, set in prepare()
+    juce::dsp::ProcessSpec processSpec{0,0,0};
+
+    std::shared_ptr<RealtimeWorkerPool> pPool;
+
+    // Nodes in dependency order
+    std::vector<std::unique_ptr<Node>> nodes;
+    int maxWidth = 0;
+
+    // Copy of the graph's input for this block
+    juce::AudioBuffer<float> inputBuffer;
+    int numChannels = 0;
+    int numSamples = 0;
+
+    // Scheduling state for a block
+    std::unique_ptr<std::atomic<int>[]> readyList;
+    std::atomic<int> readyCount { 0 };
+    std::atomic<int> nextToTake { 0 };
+    std::atomic<int> finishedCount { 0 };
+};
+
+}
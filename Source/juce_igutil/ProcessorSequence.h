@@ -15,6 +15,20 @@ namespace juce_igutil {
  * A Processor which can process any number of processors in a sequence. Can be 
  * used as a wrapper for any number of Processors, which themselves wrap 
  * juce::dsp effects or ProcessorChains. 
+ *
+ * Processors are skipped while their input is silent and has been for longer 
+ * than their tail (see Processor::getTailSamples()), since their output would
+ * be silent too.  How long each processor's input has been silent is counted
+ * to the sample, and a processor is run again from the first block with any
+ * signal in it.
+ *
+ * Processors whose settings make them a plain gain (see 
+ * Processor::getPureGain()) aren't run either.  Their gains are multiplied 
+ * together and applied in one go before the next processor that does run, and
+ * a whole sequence of plain gains is a plain gain itself.  When a processor 
+ * goes from one to the other, its output is crossfaded with the plain gain 
+ * over a few ms; a processor coming back is reset first, since its state is 
+ * stale.
  */
 class ProcessorSequence: public juce_igutil::Processor
 {
@@ -36,7 +50,8 @@ public:
     ): 
         Processor(),
         //pMTL(_pMTL),
-        procs{pProcessor}
+        procs{pProcessor},
+        slots(1)
     {
         jassert(pProcessor);
     }
@@ -47,7 +62,8 @@ public:
         std::deque<std::shared_ptr<Processor>> processorSequence
     ):
         Processor(),
-        procs(processorSequence)
+        procs(processorSequence),
+        slots(processorSequence.size())
     {
         jassert( procs.size() > 0 );
         for (auto p : procs) jassert(p);
@@ -61,6 +77,8 @@ public:
     {
         processSpec = spec;
         for (auto p : procs) p->prepare(spec);
+        bypassBuffer.setSize(spec.numChannels, spec.maximumBlockSize);
+        crossfadeSamples = juce::jmax(1, static_cast<int>(crossfadeSeconds * spec.sampleRate));
     }
 
     /** 
@@ -70,7 +88,79 @@ public:
         juce::dsp::ProcessContextReplacing<float> & context
     ) noexcept override
     {
-        for (auto p : procs) p->process(context);
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+
+        // number of silent samples at the end of the buffer as it stands
+        int trailingSilence = inputSilentHint ? numSamples : countTrailingSilence(block);
+        inputSilentHint = false;
+
+        // plain gains not applied yet
+        float pendingGain = 1.0f;
+
+        // Has every processor been skipped?  Then the block is still silent,
+        // and there's no gain to apply to it either.
+        bool skippedAll = trailingSilence == numSamples;
+
+        // the input gain ramp, if there's one and it's not been applied yet
+        bool inputGainPending = inputStartGain != 1.0f || inputEndGain != 1.0f;
+
+        for (size_t ix = 0; ix < procs.size(); ++ix) {
+            auto & p = procs[ix];
+            SlotState & slot = slots[ix];
+            const bool inputSilent = trailingSilence == numSamples;
+
+            if (inputSilent && slot.silentInputSamples > p->getTailSamples()) {
+                // nothing going in and nothing left to come out
+                continue;
+            }
+
+            updateBypass(*p, slot);
+            if (slot.bypassed && slot.fadeRemaining == 0) {
+                pendingGain *= slot.gain;
+                continue;
+            }
+
+            // The first processor to run gets the input gain ramp (with the
+            // plain gains before it), unless it's crossfading with its own
+            // plain gain, which needs the ramp applied to its input too.
+            if (inputGainPending) {
+                inputGainPending = false;
+                if (slot.fadeRemaining == 0 && 
+                    p->setInputGain(inputStartGain * pendingGain, inputEndGain * pendingGain)) {
+                    pendingGain = 1.0f;
+                }
+                else {
+                    applyGainRamp(block, inputStartGain, inputEndGain);
+                }
+            }
+            applyGain(block, pendingGain);
+            pendingGain = 1.0f;
+            skippedAll = false;
+
+            p->setInputSilent(inputSilent);
+            if (slot.fadeRemaining > 0) {
+                processCrossfaded(*p, slot, context);
+            }
+            else {
+                p->process(context);
+            }
+
+            slot.silentInputSamples = inputSilent ? 
+                addSamples(slot.silentInputSamples, numSamples) : 
+                trailingSilence;
+            trailingSilence = countTrailingSilence(block);
+        }
+
+        skipping = skippedAll;
+        if (!skippedAll) {
+            if (inputGainPending) {
+                applyGainRamp(block, inputStartGain, inputEndGain);
+            }
+            applyGain(block, pendingGain);
+        }
+        inputStartGain = 1.0f;
+        inputEndGain = 1.0f;
     }
 
     /**
@@ -78,13 +168,137 @@ public:
      */
     void reset() override
     {
-        for (auto p : procs) p->reset();
+        for (size_t ix = 0; ix < procs.size(); ++ix) {
+            procs[ix]->reset();
+            // a processor that's been reset has nothing left to output, and
+            // there's nothing to crossfade from.
+            SlotState & slot = slots[ix];
+            slot.silentInputSamples = infiniteTail;
+            slot.bypassed = procs[ix]->getPureGain(slot.gain);
+            slot.fadeRemaining = 0;
+        }
+    }
+
+    /**
+     * Total tail of the sequence.
+     */
+    int getTailSamples() const noexcept override
+    {
+        int tail = 0;
+        for (auto p : procs) tail = addSamples(tail, p->getTailSamples());
+        return tail;
+    }
+
+    /**
+     * A plain gain if every processor is one (and none is crossfading), or if
+     * one of them mutes everything before it.
+     */
+    bool getPureGain(float & gain) const noexcept override
+    {
+        float total = 1.0f;
+        for (size_t ix = procs.size(); ix > 0; --ix) {
+            const SlotState & slot = slots[ix - 1];
+            float stageGain = 1.0f;
+            if (!slot.bypassed || slot.fadeRemaining > 0 || !procs[ix - 1]->getPureGain(stageGain)) {
+                return false;
+            }
+            total *= stageGain;
+            if (total == 0.0f) {
+                break;
+            }
+        }
+        gain = total;
+        return true;
+    }
+
+    /**
+     * Always taken: handed on to the first processor that runs if it folds it
+     * into its own pass, and applied to the block otherwise.
+     */
+    bool setInputGain(const float startGain, const float endGain) noexcept override
+    {
+        inputStartGain = startGain;
+        inputEndGain = endGain;
+        return true;
+    }
+
+    /**
+     * The last processor's bound, if it ran as itself.  A skipped processor's
+     * output was silent, which is within any bound.
+     */
+    float getOutputCeiling() const noexcept override
+    {
+        if (procs.empty()) {
+            return 0.0f;
+        }
+        const SlotState & slot = slots.back();
+        if (slot.bypassed || slot.fadeRemaining > 0) {
+            return 0.0f;
+        }
+        return procs.back()->getOutputCeiling();
+    }
+
+    /** Every processor was skipped, or was a plain gain of silence. */
+    bool isSkipping() const noexcept override
+    {
+        return skipping;
+    }
+
+    /**
+     * The input to the next process() call is silent; don't scan it.
+     */
+    void setInputSilent(const bool isSilent) noexcept override
+    {
+        inputSilentHint = isSilent;
+    }
+
+    /**
+     * Total latency of the sequence.
+     */
+    int getLatencySamples() const noexcept override
+    {
+        int latency = 0;
+        for (auto p : procs) latency += p->getLatencySamples();
+        return latency;
+    }
+
+    /**
+     * Activate/deactivate all the processors in the sequence.
+     */
+    void setActive(const bool isActive) noexcept override
+    {
+        for (auto p : procs) p->setActive(isActive);
+    }
+
+    /**
+     * Pass realtime/offline rendering on to all the processors.
+     */
+    void setNonRealtime(const bool isNonRealtime) noexcept override
+    {
+        for (auto p : procs) p->setNonRealtime(isNonRealtime);
+    }
+
+    /**
+     * The bypass crossfade buffer and all the processors' buffers.
+     */
+    void prefault(RealtimeMemory & memory) override
+    {
+        memory.add(bypassBuffer);
+        for (auto p : procs) p->prefault(memory);
+    }
+
+    // Not for a sequence whose processors are replaced while it's running;
+    // poll those processors directly.
+    void handlePendingUpdates() override
+    {
+        for (auto p : procs) p->handlePendingUpdates();
     }
 
     // Helper to add a processor to the end of the processing chain.
     void addProcessor(std::shared_ptr<Processor> p) 
     {
         procs.push_back(move(p));
+        slots.push_back(SlotState());
     }
 
     // Helper to replace a processor at an index.
@@ -99,9 +313,11 @@ public:
         if (index < procs.size()) {
             replaced = move(procs[index]);
             procs[index] = p;
+            slots[index] = SlotState{0};
         }
         else {
             procs.push_back(p);
+            slots.push_back(SlotState{0});
         }
         return replaced;
     }
@@ -115,6 +331,7 @@ public:
             auto iter = procs.begin() + index;
             removed = *iter;
             procs.erase(iter);
+            slots.erase(slots.begin() + index);
         }
         return removed;
     }
@@ -129,6 +346,7 @@ public:
     void clear() 
     {
         procs.clear(); 
+        slots.clear();
     }
 
     // Return the exact processor type, casted appropriately
@@ -144,6 +362,136 @@ public:
 
 private:
 
+    // Below this level a sample counts as silent (-120dB).
+    static constexpr float silenceThreshold = 1.0e-6f;
+
+    // Crossfade between a processor and its plain gain.
+    static constexpr double crossfadeSeconds = 0.01;
+
+    // Per-processor state
+    struct SlotState {
+        // how many samples its input has been silent for
+        int silentInputSamples = infiniteTail;
+        // skipped and replaced by a plain gain (or fading to that)
+        bool bypassed = false;
+        float gain = 1.0f;
+        // samples left of the crossfade to the current state
+        int fadeRemaining = 0;
+    };
+
+    // Check whether a processor has become, or stopped being, a plain gain.
+    void updateBypass(Processor & p, SlotState & slot) noexcept
+    {
+        float gain = 1.0f;
+        const bool isPureGain = p.getPureGain(gain);
+        if (isPureGain) {
+            // kept for fading back in
+            slot.gain = gain;
+        }
+        if (isPureGain != slot.bypassed) {
+            slot.bypassed = isPureGain;
+            // turn round a crossfade that's under way from where it is.
+            slot.fadeRemaining = crossfadeSamples - slot.fadeRemaining;
+            if (!isPureGain && slot.fadeRemaining == crossfadeSamples) {
+                p.reset();
+            }
+        }
+    }
+
+    // Run a processor and crossfade its output with its plain gain.
+    void processCrossfaded(
+        Processor & p,
+        SlotState & slot,
+        juce::dsp::ProcessContextReplacing<float> & context) noexcept
+    {
+        auto & block = context.getOutputBlock();
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        const int numChannels = static_cast<int>(block.getNumChannels());
+        jassert(numChannels <= bypassBuffer.getNumChannels());
+        jassert(numSamples <= bypassBuffer.getNumSamples());
+
+        for (int chan = 0; chan < numChannels; ++chan) {
+            juce::FloatVectorOperations::copyWithMultiply(
+                bypassBuffer.getWritePointer(chan), block.getChannelPointer(chan), 
+                slot.gain, numSamples);
+        }
+
+        p.process(context);
+
+        // weight of the processed signal: rising to 1 when fading in, 
+        // falling to 0 when fading out.
+        const int fadeSamples = juce::jmin(slot.fadeRemaining, numSamples);
+        const float step = 1.0f / crossfadeSamples;
+        const float start = (crossfadeSamples - slot.fadeRemaining) * step;
+        const float weightStart = slot.bypassed ? 1.0f - start : start;
+        const float weightStep = slot.bypassed ? -step : step;
+        for (int chan = 0; chan < numChannels; ++chan) {
+            float * pOut = block.getChannelPointer(chan);
+            const float * pBypass = bypassBuffer.getReadPointer(chan);
+            float weight = weightStart;
+            for (int ix = 0; ix < fadeSamples; ++ix) {
+                weight += weightStep;
+                pOut[ix] = pBypass[ix] + weight * (pOut[ix] - pBypass[ix]);
+            }
+            if (slot.bypassed) {
+                juce::FloatVectorOperations::copy(
+                    pOut + fadeSamples, pBypass + fadeSamples, numSamples - fadeSamples);
+            }
+        }
+        slot.fadeRemaining -= fadeSamples;
+    }
+
+    // Apply a gain, unless it's 1.
+    static void applyGain(juce::dsp::AudioBlock<float> & block, const float gain) noexcept
+    {
+        if (gain != 1.0f) {
+            block.multiplyBy(gain);
+        }
+    }
+
+    // Apply a gain ramp, as AudioBuffer::applyGainRamp() does.
+    static void applyGainRamp(
+        juce::dsp::AudioBlock<float> & block, 
+        const float startGain, 
+        const float endGain) noexcept
+    {
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        if (numSamples <= 0) {
+            return;
+        }
+        const float step = (endGain - startGain) / static_cast<float>(numSamples);
+        for (size_t chan = 0; chan < block.getNumChannels(); ++chan) {
+            float * p = block.getChannelPointer(chan);
+            float gain = startGain;
+            for (int ix = 0; ix < numSamples; ++ix) {
+                p[ix] *= gain;
+                gain += step;
+            }
+        }
+    }
+
+    // Add sample counts, saturating at infiniteTail.
+    static int addSamples(const int a, const int b) noexcept
+    {
+        return (a >= infiniteTail - b) ? infiniteTail : a + b;
+    }
+
+    // How many samples at the end of the block are silent in every channel.
+    static int countTrailingSilence(const juce::dsp::AudioBlock<float> & block) noexcept
+    {
+        const int numSamples = static_cast<int>(block.getNumSamples());
+        int trailing = numSamples;
+        for (size_t chan = 0; chan < block.getNumChannels() && trailing > 0; ++chan) {
+            const float * p = block.getChannelPointer(chan);
+            int ix = numSamples;
+            while (ix > 0 && std::abs(p[ix - 1]) <= silenceThreshold) {
+                --ix;
+            }
+            trailing = juce::jmin(trailing, numSamples - ix);
+        }
+        return trailing;
+    }
+
     //// logger
     //std::shared_ptr<juce_igutil::MTLogger> pMTL;
 
@@ -152,6 +500,23 @@ private:
 
     // Processor sequence
     std::deque<std::shared_ptr<Processor>> procs;
+
+    // State for each processor
+    std::deque<SlotState> slots;
+
+    // The plain gain's output while crossfading
+    juce::AudioBuffer<float> bypassBuffer;
+    int crossfadeSamples = 1;
+
+    // set by setInputSilent() for the next process() call
+    bool inputSilentHint = false;
+
+    // set by setInputGain() for the next process() call
+    float inputStartGain = 1.0f;
+    float inputEndGain = 1.0f;
+
+    // the last process() call didn't run any processor
+    bool skipping = false;
 };
 
 }
@@ -24,6 +24,7 @@ Profiler::Profiler(
 ): 
     name(nameOfProfiler), 
     pMTL(_pMTL),
+    pTotals(std::make_shared<Totals>()),
     maxWarmups(numWarmupCycles),
     countOfWarmups(0LL),
     outputModulo(numLogMessagesToBuffer)
@@ -31,6 +32,20 @@ Profiler::Profiler(
     // empty
 }
 
+/**
+ * Construct a tagged profiler, with the parent's settings and totals.
+ */
+Profiler::Profiler(const Profiler& parent, const juce::String& tag):
+    name(parent.name),
+    pMTL(parent.pMTL->createTagged(tag)),
+    pTotals(parent.pTotals),
+    maxWarmups(parent.maxWarmups),
+    countOfWarmups(0LL),
+    outputModulo(parent.outputModulo)
+{
+    // empty
+}
+
 /**
  * Destruct.
  */
@@ -38,6 +53,38 @@ Profiler::~Profiler() {
     // empty
 }
 
+/**
+ * A profiler that adds to this one's totals.
+ */
+std::shared_ptr<Profiler> Profiler::createTagged(const juce::String& tag) const {
+    return std::shared_ptr<Profiler>(new Profiler(*this, tag));
+}
+
+/**
+ * Add one sample to the totals.  Lock free, since the tagged profilers may
+ * be on different audio threads.
+ */
+void Profiler::Totals::add(const long long nanos) noexcept {
+    long long min = minNanos.load(std::memory_order_relaxed);
+    while ((min < 0 || nanos < min) && !minNanos.compare_exchange_weak(min, nanos, std::memory_order_relaxed)) {}
+    long long max = maxNanos.load(std::memory_order_relaxed);
+    while (nanos > max && !maxNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {}
+    sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    samples.fetch_add(1ULL, std::memory_order_relaxed);
+}
+
+/**
+ * Create the totals' stats string.
+ */
+const juce::String Profiler::Totals::toString() const {
+    using namespace juce;
+    const unsigned long long n = samples.load(std::memory_order_relaxed);
+    const long long avg = n > 0 ? sumNanos.load(std::memory_order_relaxed) / static_cast<long long>(n) : 0LL;
+    return String("All Stats:  minNanos=") + String(minNanos.load(std::memory_order_relaxed)) +
+        String(", maxNanos=") + String(maxNanos.load(std::memory_order_relaxed)) +
+        String(", nanosAvg=") + String(avg) + String(", totalSamples=") + String(n);
+}
+
 /**
  * Create stats string.
  */
@@ -70,9 +117,11 @@ void Profiler::stop() {
         if ( nanosAvg < 0.0 ) nanosAvg = (double)nanos;
         else nanosAvg = ((nanosAvg * totalSamples) + nanos) / (totalSamples + 1);
         totalSamples += 1;
+        pTotals->add(nanos);
 
         if (totalSamples % outputModulo == 0) {
             pMTL->debug(this->toString());
+            pMTL->debug(pTotals->toString());
         }
     }
     else {
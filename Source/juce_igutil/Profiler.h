@@ -8,6 +8,12 @@
 namespace juce_igutil {
 
 // Class to aid in profiling code.
+//
+// One profiler can be shared by many users, e.g. every instance of a plugin
+// (see SharedService), with createTagged() giving each its own stopwatch and
+// stats, tagged in the log, while they all add to the process-wide totals.
+// The shared one itself isn't for timing; only its tagged ones are, each on
+// one thread at a time.
 
 class Profiler {
 
@@ -35,6 +41,10 @@ public:
     // Destruct
     virtual ~Profiler();
 
+    // A profiler that adds to this one's totals, logging its own stats with
+    // "[tag]" before them.  Not realtime safe.
+    std::shared_ptr<Profiler> createTagged(const juce::String& tag) const;
+
     // Stringify the stats for output.
     const juce::String toString() const;
     
@@ -51,6 +61,21 @@ public:
 
 private: 
 
+    // The stats of everything timed by this profiler and its tagged ones,
+    // updated from whichever threads they run on.
+    struct Totals {
+        std::atomic<long long> minNanos { -1LL };
+        std::atomic<long long> maxNanos { 0LL };
+        std::atomic<long long> sumNanos { 0LL };
+        std::atomic<unsigned long long> samples { 0ULL };
+
+        void add(const long long nanos) noexcept;
+        const juce::String toString() const;
+    };
+
+    // for createTagged()
+    Profiler(const Profiler& parent, const juce::String& tag);
+
     Stopwatch sw;
 
     std::string name;
@@ -62,6 +87,8 @@ private:
 
     std::shared_ptr<MTLogger> pMTL;
 
+    std::shared_ptr<Totals> pTotals;
+
     unsigned long long maxWarmups;
     unsigned long long countOfWarmups;
     const unsigned long long outputModulo;
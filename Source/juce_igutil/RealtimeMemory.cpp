@@ -0,0 +1,173 @@
+#include "RealtimeMemory.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#else
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+using namespace juce;
+using namespace juce_igutil;
+
+// How many locked regions are on each locked page, by page address, for every
+// RealtimeMemory in the process.
+static std::mutex lockedPagesLock;
+static std::map<uintptr_t, int> lockedPages;
+
+RealtimeMemory::RealtimeMemory(const Options & _options):
+    options(_options)
+{
+    // empty
+}
+
+RealtimeMemory::~RealtimeMemory()
+{
+    release();
+}
+
+/**
+ * Offer huge pages for the whole ones inside the region.
+ */
+size_t RealtimeMemory::adviseHugePages(void * pData, const size_t numBytes) noexcept
+{
+#if JUCE_LINUX
+    if (pData != nullptr && numBytes >= hugePageBytes) {
+        const uintptr_t start = (reinterpret_cast<uintptr_t>(pData) + hugePageBytes - 1) & ~(hugePageBytes - 1);
+        const uintptr_t end = (reinterpret_cast<uintptr_t>(pData) + numBytes) & ~(hugePageBytes - 1);
+        if (end > start && madvise(reinterpret_cast<void *>(start), end - start, MADV_HUGEPAGE) == 0)
+            return end - start;
+    }
+#else
+    ignoreUnused(pData, numBytes);
+#endif
+    return 0;
+}
+
+/**
+ * Touch, then lock.
+ */
+void RealtimeMemory::add(void * pData, const size_t numBytes)
+{
+    if (pData == nullptr || numBytes == 0)
+        return;
+
+    char * pBytes = static_cast<char *>(pData);
+
+    // Write each page's first byte back to it.  Reading alone could leave a
+    // page mapped to the shared zero page, to be copied on the first write.
+    const size_t pageSize = getPageSize();
+    const uintptr_t firstPage = reinterpret_cast<uintptr_t>(pBytes) & ~(pageSize - 1);
+    for (uintptr_t page = firstPage; page < reinterpret_cast<uintptr_t>(pBytes) + numBytes; page += pageSize) {
+        volatile char * pTouch = reinterpret_cast<char *>(jmax(page, reinterpret_cast<uintptr_t>(pBytes)));
+        *pTouch = *pTouch;
+    }
+    ++stats.regions;
+    stats.residentBytes += numBytes;
+
+    if (options.lock) {
+#if JUCE_WINDOWS
+        const bool locked = VirtualLock(pData, numBytes) != 0;
+#else
+        const bool locked = mlock(pData, numBytes) == 0;
+#endif
+        if (locked) {
+            lockedRegions.emplace_back(pData, numBytes);
+            countLockedPages(lockedRegions.back());
+            stats.lockedBytes += numBytes;
+        }
+        else {
+            stats.lockFailedBytes += numBytes;
+        }
+    }
+}
+
+void RealtimeMemory::add(juce::AudioBuffer<float> & buffer)
+{
+    const size_t channelBytes = static_cast<size_t>(buffer.getNumSamples()) * sizeof(float);
+    for (int chan = 0; chan < buffer.getNumChannels(); ++chan) {
+        add(buffer.getWritePointer(chan), channelBytes);
+    }
+}
+
+void RealtimeMemory::release()
+{
+    for (const auto & region : lockedRegions) {
+        releaseLockedPages(region);
+    }
+    lockedRegions.clear();
+    stats = Stats();
+}
+
+juce::String RealtimeMemory::describe(const Stats & stats)
+{
+    auto toMB = [](const size_t bytes) { return String(bytes / (1024.0 * 1024.0), 1) + "MB"; };
+    String description = toMB(stats.residentBytes) + " resident in " + String(stats.regions) + " buffers";
+    if (stats.lockedBytes > 0 || stats.lockFailedBytes > 0) {
+        description += ", " + toMB(stats.lockedBytes) + " locked";
+        if (stats.lockFailedBytes > 0)
+            description += " (" + toMB(stats.lockFailedBytes) + " couldn't be)";
+    }
+    return description;
+}
+
+void RealtimeMemory::countLockedPages(const std::pair<void *, size_t> & region)
+{
+    const size_t pageSize = getPageSize();
+    const uintptr_t start = reinterpret_cast<uintptr_t>(region.first) & ~(pageSize - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(region.first) + region.second + pageSize - 1) & ~(pageSize - 1);
+    const std::lock_guard<std::mutex> lock(lockedPagesLock);
+    for (uintptr_t page = start; page < end; page += pageSize) {
+        ++lockedPages[page];
+    }
+}
+
+/**
+ * Unlock the pages that only this region was on, a run of them at a time.
+ */
+void RealtimeMemory::releaseLockedPages(const std::pair<void *, size_t> & region)
+{
+    const size_t pageSize = getPageSize();
+    const uintptr_t start = reinterpret_cast<uintptr_t>(region.first) & ~(pageSize - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(region.first) + region.second + pageSize - 1) & ~(pageSize - 1);
+
+    auto unlock = [](const uintptr_t from, const uintptr_t to) {
+        if (to > from) {
+#if JUCE_WINDOWS
+            VirtualUnlock(reinterpret_cast<void *>(from), to - from);
+#else
+            munlock(reinterpret_cast<void *>(from), to - from);
+#endif
+        }
+    };
+
+    const std::lock_guard<std::mutex> lock(lockedPagesLock);
+    uintptr_t runStart = start;
+    for (uintptr_t page = start; page < end; page += pageSize) {
+        auto counted = lockedPages.find(page);
+        jassert(counted != lockedPages.end());
+        if (counted != lockedPages.end() && --counted->second == 0) {
+            lockedPages.erase(counted);
+            continue;
+        }
+        // still locked for another region: unlock the run before it
+        unlock(runStart, page);
+        runStart = page + pageSize;
+    }
+    unlock(runStart, end);
+}
+
+size_t RealtimeMemory::getPageSize() noexcept
+{
+    static const size_t pageSize = []() {
+#if JUCE_WINDOWS
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<size_t>(info.dwPageSize);
+#else
+        const long size = sysconf(_SC_PAGESIZE);
+        return size > 0 ? static_cast<size_t>(size) : static_cast<size_t>(4096);
+#endif
+    }();
+    return pageSize;
+}
@@ -0,0 +1,100 @@
+/**
+ * RealtimeMemory
+ *
+ * Makes the memory the audio thread renders with resident before it's needed,
+ * so the first notes (and the first use of an effect) don't take page faults.
+ * Buffers are handed to add() once they're allocated, e.g. by
+ * Processor::prefault() after prepare(); every page of them is written to,
+ * and they can also be locked into RAM.  Large buffers can be offered
+ * transparent huge pages on Linux too, but that has to be done as they're
+ * allocated (adviseHugePages()), before anything writes to them.  None of
+ * this is realtime safe.
+ *
+ * Locked memory counts against a limit (RLIMIT_MEMLOCK on Linux and mac, the
+ * working set size on Windows) that a plugin shares with its host, so memory
+ * that couldn't be locked is only counted, not treated as an error.  Locks
+ * are per page and don't nest, and buffers locked by different instances can
+ * share a page, so the pages locked are counted across the process and only
+ * unlocked when the last region on them is released.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace juce_igutil {
+
+class RealtimeMemory
+{
+public:
+
+    struct Options
+    {
+        // lock the memory into RAM
+        bool lock = false;
+    };
+
+    // What add() has done since the last release()
+    struct Stats
+    {
+        int regions = 0;
+        size_t residentBytes = 0;
+        size_t lockedBytes = 0;
+        size_t lockFailedBytes = 0;
+    };
+
+    // Transparent huge page size, and the smallest region offered them
+    static const size_t hugePageBytes = 2 * 1024 * 1024;
+
+    // Offer the whole huge pages inside a region huge pages (Linux; elsewhere
+    // this does nothing).  Only worth it straight after allocating the region
+    // and before it's first written to: a page that's been touched is a small
+    // page, which the kernel may or may not collapse later in the background.
+    // Returns the number of bytes offered.
+    static size_t adviseHugePages(void * pData, const size_t numBytes) noexcept;
+
+    explicit RealtimeMemory(const Options & _options);
+
+    // Unlocks anything still locked.
+    ~RealtimeMemory();
+
+    // Make a region resident: write to every page of it, and lock it if the
+    // options say so.  The region mustn't be in use by another thread.
+    void add(void * pData, const size_t numBytes);
+
+    template <typename T>
+    void add(std::vector<T> & values)
+    {
+        add(values.data(), values.size() * sizeof(T));
+    }
+
+    void add(juce::AudioBuffer<float> & buffer);
+
+    // Unlock everything that was locked and start counting again.  Call this
+    // before the memory is freed or reallocated, e.g. before prepare().
+    void release();
+
+    const Stats & getStats() const noexcept { return stats; }
+
+    // The stats, for the log
+    static juce::String describe(const Stats & stats);
+
+private:
+
+    static size_t getPageSize() noexcept;
+
+    // Count the pages of a locked region, and uncount them when it's
+    // released, unlocking the ones no region is on any more.
+    static void countLockedPages(const std::pair<void *, size_t> & region);
+    static void releaseLockedPages(const std::pair<void *, size_t> & region);
+
+    const Options options;
+    Stats stats;
+
+    // The locked regions, to unlock
+    std::vector<std::pair<void *, size_t>> lockedRegions;
+
+    JUCE_DECLARE_NON_COPYABLE(RealtimeMemory)
+};
+
+}
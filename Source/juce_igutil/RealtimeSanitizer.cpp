@@ -0,0 +1,322 @@
+#include "RealtimeSanitizer.h"
+
+#if RT_SANITIZER && JUCE_LINUX
+ #include <dlfcn.h>
+ #include <poll.h>
+ #include <pthread.h>
+ #include <semaphore.h>
+ #include <unistd.h>
+#endif
+
+using namespace juce;
+using namespace juce_igutil;
+
+// The thread's state is looked at inside malloc, so it mustn't be in TLS that
+// gets allocated on first use.
+#if defined(__GNUC__)
+ #define RT_SANITIZER_THREAD_LOCAL thread_local __attribute__((tls_model("initial-exec")))
+#else
+ #define RT_SANITIZER_THREAD_LOCAL thread_local
+#endif
+
+namespace {
+
+// How deep the calling thread is in realtime and allowed scopes
+RT_SANITIZER_THREAD_LOCAL int realtimeDepth = 0;
+RT_SANITIZER_THREAD_LOCAL int allowedDepth = 0;
+
+std::atomic<juce::int64> violations { 0 };
+std::atomic<bool> abortOnViolation { false };
+
+}
+
+RealtimeSanitizer::ScopedRealtime::ScopedRealtime() noexcept
+{
+    ++realtimeDepth;
+}
+
+RealtimeSanitizer::ScopedRealtime::~ScopedRealtime() noexcept
+{
+    --realtimeDepth;
+}
+
+RealtimeSanitizer::ScopedAllowed::ScopedAllowed() noexcept
+{
+    ++allowedDepth;
+}
+
+RealtimeSanitizer::ScopedAllowed::~ScopedAllowed() noexcept
+{
+    --allowedDepth;
+}
+
+bool RealtimeSanitizer::isRealtime() noexcept
+{
+    return realtimeDepth > 0 && allowedDepth == 0;
+}
+
+juce::int64 RealtimeSanitizer::getViolationCount() noexcept
+{
+    return violations.load();
+}
+
+void RealtimeSanitizer::setAbortOnViolation(const bool shouldAbort) noexcept
+{
+    abortOnViolation.store(shouldAbort);
+}
+
+/**
+ * Write what happened and where to stderr.  The report allocates and locks
+ * itself, so it's done in an allowed scope.
+ */
+void RealtimeSanitizer::reportViolation(const char * what) noexcept
+{
+    const ScopedAllowed allowed;
+    const juce::int64 count = ++violations;
+    const String report = "RT sanitizer: violation " + String(count) + ": " + String(what)
+        + " on a realtime thread\n" + SystemStats::getStackBacktrace() + "\n";
+    std::fputs(report.toRawUTF8(), stderr);
+    std::fflush(stderr);
+    if (abortOnViolation.load()) {
+        std::abort();
+    }
+}
+
+#if RT_SANITIZER
+
+//==============================================================================
+// operator new and delete, everywhere.  The memory itself comes from malloc,
+// which isn't reported again.
+
+namespace {
+
+void * allocate(const std::size_t size, const char * what)
+{
+    RealtimeSanitizer::check(what);
+    void * p;
+    {
+        const RealtimeSanitizer::ScopedAllowed allowed;
+        p = std::malloc(size == 0 ? 1 : size);
+    }
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * allocateAligned(const std::size_t size, const std::align_val_t alignment, const char * what)
+{
+    RealtimeSanitizer::check(what);
+    const RealtimeSanitizer::ScopedAllowed allowed;
+    const std::size_t align = jmax(static_cast<std::size_t>(alignment), sizeof(void *));
+#if JUCE_WINDOWS
+    void * p = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    void * p = nullptr;
+    if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0)
+        p = nullptr;
+#endif
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void deallocate(void * p, const char * what) noexcept
+{
+    if (p == nullptr)
+        return;
+    RealtimeSanitizer::check(what);
+    const RealtimeSanitizer::ScopedAllowed allowed;
+    std::free(p);
+}
+
+void deallocateAligned(void * p, const char * what) noexcept
+{
+    if (p == nullptr)
+        return;
+    RealtimeSanitizer::check(what);
+    const RealtimeSanitizer::ScopedAllowed allowed;
+#if JUCE_WINDOWS
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+}
+
+void * operator new(std::size_t size) { return allocate(size, "operator new"); }
+void * operator new[](std::size_t size) { return allocate(size, "operator new[]"); }
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try { return allocate(size, "operator new"); } catch (...) { return nullptr; }
+}
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    try { return allocate(size, "operator new[]"); } catch (...) { return nullptr; }
+}
+void * operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocateAligned(size, alignment, "operator new");
+}
+void * operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return allocateAligned(size, alignment, "operator new[]");
+}
+
+void operator delete(void * p) noexcept { deallocate(p, "operator delete"); }
+void operator delete[](void * p) noexcept { deallocate(p, "operator delete[]"); }
+void operator delete(void * p, std::size_t) noexcept { deallocate(p, "operator delete"); }
+void operator delete[](void * p, std::size_t) noexcept { deallocate(p, "operator delete[]"); }
+void operator delete(void * p, const std::nothrow_t &) noexcept { deallocate(p, "operator delete"); }
+void operator delete[](void * p, const std::nothrow_t &) noexcept { deallocate(p, "operator delete[]"); }
+void operator delete(void * p, std::align_val_t) noexcept { deallocateAligned(p, "operator delete"); }
+void operator delete[](void * p, std::align_val_t) noexcept { deallocateAligned(p, "operator delete[]"); }
+void operator delete(void * p, std::size_t, std::align_val_t) noexcept { deallocateAligned(p, "operator delete"); }
+void operator delete[](void * p, std::size_t, std::align_val_t) noexcept { deallocateAligned(p, "operator delete[]"); }
+
+#if JUCE_LINUX
+
+//==============================================================================
+// The C library's allocation, locking and blocking calls.  These are defined
+// in front of glibc's, so they only catch calls that are linked to them, i.e.
+// from an executable that has this in it.
+
+extern "C" {
+
+void * __libc_malloc(size_t size);
+void * __libc_calloc(size_t count, size_t size);
+void * __libc_realloc(void * p, size_t size);
+void * __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void * p);
+
+void * malloc(size_t size)
+{
+    RealtimeSanitizer::check("malloc");
+    return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+    RealtimeSanitizer::check("calloc");
+    return __libc_calloc(count, size);
+}
+
+void * realloc(void * p, size_t size)
+{
+    RealtimeSanitizer::check("realloc");
+    return __libc_realloc(p, size);
+}
+
+void free(void * p)
+{
+    if (p != nullptr)
+        RealtimeSanitizer::check("free");
+    __libc_free(p);
+}
+
+int posix_memalign(void ** pp, size_t alignment, size_t size)
+{
+    RealtimeSanitizer::check("posix_memalign");
+    void * p = __libc_memalign(alignment, size);
+    if (p == nullptr)
+        return ENOMEM;
+    *pp = p;
+    return 0;
+}
+
+void * aligned_alloc(size_t alignment, size_t size)
+{
+    RealtimeSanitizer::check("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+}
+
+namespace {
+
+/**
+ * The C library's version of a function we've defined.  Looked up when this
+ * is loaded (see below), so not normally on a realtime thread.
+ */
+template <typename Function>
+Function getReal(std::atomic<Function> & real, const char * name) noexcept
+{
+    Function pFunction = real.load(std::memory_order_relaxed);
+    if (pFunction == nullptr) {
+        const RealtimeSanitizer::ScopedAllowed allowed;
+        // The condition functions have an old version too; we want the one
+        // everything links to now.
+        void * pSymbol = std::strncmp(name, "pthread_cond_", 13) == 0 ?
+            dlvsym(RTLD_NEXT, name, "GLIBC_2.3.2") : nullptr;
+        if (pSymbol == nullptr)
+            pSymbol = dlsym(RTLD_NEXT, name);
+        pFunction = reinterpret_cast<Function>(pSymbol);
+        real.store(pFunction, std::memory_order_relaxed);
+    }
+    return pFunction;
+}
+
+}
+
+// Define a function that reports itself, then calls the C library's.
+#define RT_SANITIZER_INTERCEPT(returnType, name, parameters, arguments) \
+    namespace { std::atomic<returnType (*) parameters> real_##name { nullptr }; } \
+    extern "C" returnType name parameters \
+    { \
+        RealtimeSanitizer::check(#name); \
+        return getReal(real_##name, #name) arguments; \
+    }
+
+RT_SANITIZER_INTERCEPT(int, pthread_mutex_lock, (pthread_mutex_t * m), (m))
+RT_SANITIZER_INTERCEPT(int, pthread_rwlock_rdlock, (pthread_rwlock_t * l), (l))
+RT_SANITIZER_INTERCEPT(int, pthread_rwlock_wrlock, (pthread_rwlock_t * l), (l))
+RT_SANITIZER_INTERCEPT(int, pthread_cond_wait, (pthread_cond_t * c, pthread_mutex_t * m), (c, m))
+RT_SANITIZER_INTERCEPT(int, pthread_cond_timedwait,
+    (pthread_cond_t * c, pthread_mutex_t * m, const struct timespec * t), (c, m, t))
+RT_SANITIZER_INTERCEPT(int, pthread_join, (pthread_t t, void ** r), (t, r))
+RT_SANITIZER_INTERCEPT(int, sem_wait, (sem_t * s), (s))
+RT_SANITIZER_INTERCEPT(int, sem_timedwait, (sem_t * s, const struct timespec * t), (s, t))
+RT_SANITIZER_INTERCEPT(int, nanosleep, (const struct timespec * t, struct timespec * r), (t, r))
+RT_SANITIZER_INTERCEPT(int, clock_nanosleep,
+    (clockid_t c, int f, const struct timespec * t, struct timespec * r), (c, f, t, r))
+RT_SANITIZER_INTERCEPT(int, usleep, (useconds_t t), (t))
+RT_SANITIZER_INTERCEPT(ssize_t, read, (int fd, void * p, size_t n), (fd, p, n))
+RT_SANITIZER_INTERCEPT(ssize_t, write, (int fd, const void * p, size_t n), (fd, p, n))
+RT_SANITIZER_INTERCEPT(int, close, (int fd), (fd))
+RT_SANITIZER_INTERCEPT(int, fsync, (int fd), (fd))
+RT_SANITIZER_INTERCEPT(int, poll, (struct pollfd * f, nfds_t n, int t), (f, n, t))
+
+#undef RT_SANITIZER_INTERCEPT
+
+namespace {
+
+// Look the C library's functions up before any realtime thread needs them:
+// dlsym() can allocate and lock.
+struct RealFunctionLookup
+{
+    RealFunctionLookup()
+    {
+        getReal(real_pthread_mutex_lock, "pthread_mutex_lock");
+        getReal(real_pthread_rwlock_rdlock, "pthread_rwlock_rdlock");
+        getReal(real_pthread_rwlock_wrlock, "pthread_rwlock_wrlock");
+        getReal(real_pthread_cond_wait, "pthread_cond_wait");
+        getReal(real_pthread_cond_timedwait, "pthread_cond_timedwait");
+        getReal(real_pthread_join, "pthread_join");
+        getReal(real_sem_wait, "sem_wait");
+        getReal(real_sem_timedwait, "sem_timedwait");
+        getReal(real_nanosleep, "nanosleep");
+        getReal(real_clock_nanosleep, "clock_nanosleep");
+        getReal(real_usleep, "usleep");
+        getReal(real_read, "read");
+        getReal(real_write, "write");
+        getReal(real_close, "close");
+        getReal(real_fsync, "fsync");
+        getReal(real_poll, "poll");
+    }
+} realFunctionLookup;
+
+}
+
+#endif // JUCE_LINUX
+
+#endif // RT_SANITIZER
@@ -0,0 +1,77 @@
+/**
+ * A build mode that catches realtime threads doing things they mustn't:
+ * allocating, locking and making blocking system calls.
+ *
+ * Build with RT_SANITIZER=1 (e.g. in the exporter's preprocessor definitions)
+ * to turn it on.  Threads are marked as realtime for a scope with
+ * RT_SANITIZER_REALTIME_SCOPE; while one is, every operator new and delete it
+ * makes is reported, with a stack trace, to stderr.  On Linux, malloc and
+ * free, pthread mutex, rwlock, condition and semaphore waits, and blocking
+ * file and sleep calls are caught as well, by defining them in front of the
+ * C library's; that only works in an executable (e.g.
+ * tools/rtsanitizer), not in a plugin loaded by a host.
+ *
+ * Without RT_SANITIZER, the macros are empty and nothing is intercepted.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef RT_SANITIZER
+ #define RT_SANITIZER 0
+#endif
+
+namespace juce_igutil {
+
+class RealtimeSanitizer
+{
+public:
+
+    // Marks the calling thread as realtime while it's in scope.  Can be nested.
+    class ScopedRealtime
+    {
+    public:
+        ScopedRealtime() noexcept;
+        ~ScopedRealtime() noexcept;
+    };
+
+    // Lets a realtime thread do anything while it's in scope, e.g. for
+    // something known to only happen when settings change.
+    class ScopedAllowed
+    {
+    public:
+        ScopedAllowed() noexcept;
+        ~ScopedAllowed() noexcept;
+    };
+
+    // True if the calling thread is realtime, and not allowed anything.
+    static bool isRealtime() noexcept;
+
+    // Report what the calling thread just did, if it's realtime.
+    static void check(const char * what) noexcept
+    {
+        if (isRealtime())
+            reportViolation(what);
+    }
+
+    // Violations reported so far.  Any thread.
+    static juce::int64 getViolationCount() noexcept;
+
+    // Abort on the first violation, e.g. to stop in a debugger.
+    static void setAbortOnViolation(const bool shouldAbort) noexcept;
+
+private:
+
+    static void reportViolation(const char * what) noexcept;
+};
+
+}
+
+#if RT_SANITIZER
+ #define RT_SANITIZER_REALTIME_SCOPE juce_igutil::RealtimeSanitizer::ScopedRealtime rtSanitizerScope
+ #define RT_SANITIZER_ALLOWED_SCOPE juce_igutil::RealtimeSanitizer::ScopedAllowed rtSanitizerAllowedScope
+#else
+ #define RT_SANITIZER_REALTIME_SCOPE
+ #define RT_SANITIZER_ALLOWED_SCOPE
+#endif
@@ -0,0 +1,127 @@
+#include "RealtimeWorkerPool.h"
+
+using namespace juce;
+using namespace juce_igutil;
+using namespace std;
+
+/**
+ * Constructor
+ */
+RealtimeWorkerPool::RealtimeWorkerPool(const int numWorkerThreads)
+{
+    for (int ix = 0; ix < numWorkerThreads; ++ix) {
+        workers.push_back(make_unique<Worker>(*this, ix));
+    }
+    // These threads meet the audio thread's deadlines, so they run at the
+    // same priority.
+    for (auto & pWorker : workers) {
+        pWorker->startThread(Thread::realtimeAudioPriority);
+    }
+}
+
+/**
+ * Destructor
+ */
+RealtimeWorkerPool::~RealtimeWorkerPool()
+{
+    for (auto & pWorker : workers) {
+        pWorker->signalThreadShouldExit();
+        pWorker->wakeEvent.signal();
+    }
+    for (auto & pWorker : workers) {
+        pWorker->stopThread(1000);
+    }
+}
+
+/**
+ * Run a job.  Audio thread.
+ */
+void RealtimeWorkerPool::run(Job & job) noexcept
+{
+    Job * pExpected = nullptr;
+    if (workers.empty() || !pCurrentJob.compare_exchange_strong(pExpected, &job)) {
+        job.work();
+        jassert(job.isDone());
+        return;
+    }
+
+    generation.fetch_add(1);
+    for (auto & pWorker : workers) {
+        if (pWorker->sleeping.load()) {
+            pWorker->wakeEvent.signal();
+        }
+    }
+
+    job.work();
+    while (!job.isDone()) {
+        // the last tasks are still running on the workers.
+    }
+
+    // A worker says which job it's taking before checking it's still the
+    // current one, so either it sees nullptr after this, or it's seen here
+    // and waited for.  Workers on another caller's job aren't.
+    pCurrentJob.store(nullptr);
+    for (auto & pWorker : workers) {
+        while (pWorker->pHelping.load() == &job) {
+            // wait for the worker to let go of the job.
+        }
+    }
+}
+
+/**
+ * Worker side.  Returns true if there was a new job.
+ */
+bool RealtimeWorkerPool::helpWithJob(Worker & worker, juce::uint32 & lastGeneration) noexcept
+{
+    const juce::uint32 current = generation.load();
+    if (current == lastGeneration) {
+        return false;
+    }
+    lastGeneration = current;
+
+    // The job may have finished (and gone) since it was loaded, so it's only
+    // touched once it's been found still current after saying we're on it.
+    Job * pJob = pCurrentJob.load();
+    if (pJob != nullptr) {
+        worker.pHelping.store(pJob);
+        if (pCurrentJob.load() == pJob) {
+            RT_SANITIZER_REALTIME_SCOPE;
+            pJob->work();
+        }
+        worker.pHelping.store(nullptr);
+    }
+    return true;
+}
+
+RealtimeWorkerPool::Worker::Worker(RealtimeWorkerPool & owner, const int index):
+    Thread("RealtimeWorker " + String(index)),
+    pool(owner)
+{
+    // empty
+}
+
+/**
+ * Worker loop.  Spin for a while after each job, since the next one is
+ * usually only a block away; then sleep until signalled.
+ */
+void RealtimeWorkerPool::Worker::run()
+{
+    juce::uint32 lastGeneration = pool.generation.load();
+    while (!threadShouldExit()) {
+        bool found = false;
+        for (int spin = 0; spin < spinCount && !found; ++spin) {
+            found = pool.helpWithJob(*this, lastGeneration);
+        }
+        if (found) {
+            continue;
+        }
+
+        // Say we're going to sleep before checking one last time, so a job
+        // posted in between either gets seen here or signals us.
+        sleeping.store(true);
+        if (!pool.helpWithJob(*this, lastGeneration)) {
+            wakeEvent.wait(sleepTimeoutMs);
+        }
+        sleeping.store(false);
+    }
+}
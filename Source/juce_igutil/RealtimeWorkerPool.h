@@ -0,0 +1,98 @@
+/**
+ * A small pool of realtime priority threads that help the audio thread with a
+ * job made of independent tasks, e.g. the branches of a ProcessorGraph.
+ *
+ * The audio thread posts the job and works on it itself; the workers join in
+ * and take tasks from it as they wake up.  The job hands out its own tasks
+ * (lock free), so all the pool does is get the workers to call Job::work().
+ * Posting never blocks: workers spin for a short while after each job so
+ * they're ready for the next one, and only a worker that has gone to sleep
+ * has to be signalled, which is a semaphore post rather than a lock.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "RealtimeSanitizer.h"
+#include "Semaphore.h"
+
+namespace juce_igutil {
+
+class RealtimeWorkerPool
+{
+public:
+
+    /**
+     * A job.  work() may be called on any number of threads at once, and must
+     * keep taking tasks until there are none left to take.  isDone() is true
+     * once every task has finished.
+     */
+    class Job
+    {
+    public:
+        virtual ~Job() = default;
+        virtual void work() noexcept = 0;
+        virtual bool isDone() const noexcept = 0;
+    };
+
+    /** Constructor; starts the worker threads. */
+    explicit RealtimeWorkerPool(const int numWorkerThreads);
+
+    /** Destructor; stops the worker threads. */
+    ~RealtimeWorkerPool();
+
+    /** Number of worker threads (not counting the audio thread). */
+    int getNumWorkers() const noexcept { return static_cast<int>(workers.size()); }
+
+    /**
+     * Run a job on the calling thread and the workers, and return once it's
+     * done and no worker is touching it any more.  If the pool is already busy
+     * with another job, the calling thread does this one on its own.  Only
+     * waits for the workers helping with this job, not for any that have
+     * gone on to another caller's.
+     */
+    void run(Job & job) noexcept;
+
+private:
+
+    class Worker: public juce::Thread
+    {
+    public:
+        Worker(RealtimeWorkerPool & owner, const int index);
+        void run() override;
+
+        // set while the thread is (about to be) waiting for a signal
+        std::atomic<bool> sleeping { false };
+
+        // The job this worker is about to work on, or is working on; its
+        // caller waits for this to change before letting go of it.
+        std::atomic<Job*> pHelping { nullptr };
+
+        // Signalled from the audio thread, so not Thread::notify(), which
+        // takes a lock
+        WakeEvent wakeEvent;
+
+    private:
+        RealtimeWorkerPool & pool;
+    };
+
+    // How many times an idle worker checks for a new job before sleeping.
+    static const int spinCount = 4000;
+
+    // Longest time a sleeping worker waits without being signalled.
+    static const int sleepTimeoutMs = 100;
+
+    // Worker side: help with the current job, if there's a new one.
+    bool helpWithJob(Worker & worker, juce::uint32 & lastGeneration) noexcept;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // The job being run, and a count of jobs posted.
+    std::atomic<Job*> pCurrentJob { nullptr };
+    std::atomic<juce::uint32> generation { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(RealtimeWorkerPool)
+};
+
+}
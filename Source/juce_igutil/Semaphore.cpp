@@ -0,0 +1,107 @@
+#include "Semaphore.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+ #include <cerrno>
+ #include <ctime>
+#endif
+
+using namespace juce;
+using namespace juce_igutil;
+
+#if JUCE_WINDOWS
+
+struct Semaphore::Impl
+{
+    HANDLE handle = CreateSemaphore(nullptr, 0, LONG_MAX, nullptr);
+    ~Impl() { CloseHandle(handle); }
+};
+
+void Semaphore::post() noexcept
+{
+    ReleaseSemaphore(pImpl->handle, 1, nullptr);
+}
+
+bool Semaphore::wait(const int timeoutMs) noexcept
+{
+    return WaitForSingleObject(pImpl->handle, timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs)) == WAIT_OBJECT_0;
+}
+
+#elif JUCE_MAC || JUCE_IOS
+
+// Unnamed POSIX semaphores aren't implemented on mac.
+struct Semaphore::Impl
+{
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    ~Impl() { dispatch_release(semaphore); }
+};
+
+void Semaphore::post() noexcept
+{
+    dispatch_semaphore_signal(pImpl->semaphore);
+}
+
+bool Semaphore::wait(const int timeoutMs) noexcept
+{
+    const dispatch_time_t timeout = timeoutMs < 0
+        ? DISPATCH_TIME_FOREVER
+        : dispatch_time(DISPATCH_TIME_NOW, static_cast<int64_t>(timeoutMs) * 1000000);
+    return dispatch_semaphore_wait(pImpl->semaphore, timeout) == 0;
+}
+
+#else
+
+struct Semaphore::Impl
+{
+    sem_t semaphore;
+    Impl() { sem_init(&semaphore, 0, 0); }
+    ~Impl() { sem_destroy(&semaphore); }
+};
+
+void Semaphore::post() noexcept
+{
+    sem_post(&pImpl->semaphore);
+}
+
+/**
+ * sem_timedwait() takes a deadline on the realtime clock, so a clock change
+ * can make a wait shorter or longer; callers only use timeouts as a backstop.
+ */
+bool Semaphore::wait(const int timeoutMs) noexcept
+{
+    if (timeoutMs < 0) {
+        while (sem_wait(&pImpl->semaphore) != 0) {
+            if (errno != EINTR)
+                return false;
+        }
+        return true;
+    }
+
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += static_cast<long>(timeoutMs % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(&pImpl->semaphore, &deadline) != 0) {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+#endif
+
+Semaphore::Semaphore():
+    pImpl(new Impl())
+{
+    // empty
+}
+
+Semaphore::~Semaphore() = default;
@@ -0,0 +1,75 @@
+/**
+ * Semaphore
+ *
+ * A counting semaphore for waking a background thread from the audio thread.
+ * juce::WaitableEvent::signal() and Thread::notify() take a mutex (and can
+ * wait on it); posting a semaphore is a single system call that never blocks
+ * (sem_post on Linux, dispatch_semaphore_signal on mac, ReleaseSemaphore on
+ * Windows), so it's safe from the audio thread.
+ *
+ * WakeEvent is an auto-reset event built on one: however many times it's
+ * signalled while the waiter is busy, the waiter wakes once.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace juce_igutil {
+
+class Semaphore
+{
+public:
+
+    Semaphore();
+    ~Semaphore();
+
+    // Add one to the count, waking a waiter if there is one.  Realtime safe.
+    void post() noexcept;
+
+    // Take one from the count, waiting up to timeoutMs (forever if negative)
+    // for it to be non-zero.  Returns false if it timed out.
+    bool wait(const int timeoutMs) noexcept;
+
+private:
+
+    struct Impl;
+    std::unique_ptr<Impl> pImpl;
+
+    JUCE_DECLARE_NON_COPYABLE(Semaphore)
+};
+
+class WakeEvent
+{
+public:
+
+    WakeEvent() = default;
+
+    // Wake the waiter, unless it's already been woken.  Realtime safe.
+    void signal() noexcept
+    {
+        if (!signalled.exchange(true, std::memory_order_acq_rel))
+            semaphore.post();
+    }
+
+    // Wait up to timeoutMs for a signal, and reset it.  Returns false if it
+    // timed out.  One waiting thread only.
+    bool wait(const int timeoutMs) noexcept
+    {
+        // An exchange rather than a store, so a signal() that found it still
+        // set (and didn't post) happens before whatever the waiter does next.
+        const bool woken = semaphore.wait(timeoutMs);
+        if (woken)
+            signalled.exchange(false, std::memory_order_acq_rel);
+        return woken;
+    }
+
+private:
+
+    Semaphore semaphore;
+    std::atomic<bool> signalled { false };
+
+    JUCE_DECLARE_NON_COPYABLE(WakeEvent)
+};
+
+}
@@ -0,0 +1,54 @@
+/**
+ * One instance of a service (a logger, a pool of worker threads...) for the
+ * whole process, shared by everything that uses it, e.g. every instance of a
+ * plugin loaded in a host.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace juce_igutil {
+
+/**
+ * The process's T.  get() creates it the first time, and gives everyone after
+ * that the same one; it's destroyed when the last user lets go of it, and
+ * created again by the next get() after that.  Only a weak pointer is kept
+ * here, so the users' shared_ptrs are what count the references.
+ *
+ * Unlike juce::SharedResourcePointer, T is created by a function, so it can
+ * take arguments (the first user's are the ones used).  Not realtime safe.
+ */
+template <typename T>
+class SharedService
+{
+public:
+
+    template <typename Create>
+    static std::shared_ptr<T> get(Create create)
+    {
+        const std::lock_guard<std::mutex> lock(getLock());
+        std::shared_ptr<T> pService = getInstance().lock();
+        if (pService == nullptr) {
+            pService = create();
+            getInstance() = pService;
+        }
+        return pService;
+    }
+
+private:
+
+    static std::mutex & getLock()
+    {
+        static std::mutex lock;
+        return lock;
+    }
+
+    static std::weak_ptr<T> & getInstance()
+    {
+        static std::weak_ptr<T> instance;
+        return instance;
+    }
+};
+
+}
@@ -6,7 +6,8 @@
  *  
  * The expected usage is pretty standard: 
  *   1. prepareToPlay() first
- *   2. renderNextBlock() from inside processBlock()
+ *   2. renderNextBlock() from inside processBlock(), after trying 
+ *      renderIdleBlock()
  *   3. releaseResources() last
  */
 
@@ -14,6 +15,8 @@
 
 #include <JuceHeader.h>
 
+#include "RealtimeMemory.h"
+
 namespace juce_igutil {
 
 class SynthAudioSource
@@ -41,6 +44,20 @@ public:
         juce::MidiBuffer & inputMidi,
         int startSample) = 0;
 
+    /**
+     * The idle fast path.  Once a source has shown that it's producing 
+     * silence, it can render blocks without any midi just by clearing them.
+     * Returns true if it did that for this block; otherwise returns false, and
+     * renderNextBlock() must be called with the same arguments.
+     */
+    virtual bool renderIdleBlock(
+        juce::AudioBuffer<float> & outputAudio,
+        juce::MidiBuffer & inputMidi,
+        int startSample)
+    {
+        return false;
+    }
+
     /** Allows the source to release anything it no longer needs after playback
      *  has stopped.
      */
@@ -50,6 +67,54 @@ public:
      * Allow access to the params - necessary for all synths.
      */
     virtual std::shared_ptr<juce::AudioProcessorValueTreeState> getSynthParams() = 0;
+
+    /**
+     * Latency of the source in samples, to report to the host.  Called from 
+     * the audio thread after renderNextBlock().
+     */
+    virtual int getLatencySamples()
+    {
+        return 0;
+    }
+
+    /**
+     * Tells the source whether the host is rendering offline.  This may be 
+     * called from any thread.
+     */
+    virtual void setNonRealtime(const bool isNonRealtime)
+    {
+        // empty
+    }
+
+    /**
+     * Give the final samples of one output channel to a function as they're
+     * rendered, e.g. for a scope.  Not while rendering.
+     */
+    virtual void setOutputTap(
+        std::function<void(const float * pSamples, int numSamples)> tap,
+        const int channel = 0)
+    {
+        // empty
+    }
+
+    /**
+     * Called regularly on the message thread, to do whatever rendering has
+     * asked for that the audio thread can't do itself (see
+     * Processor::handlePendingUpdates()).
+     */
+    virtual void handlePendingUpdates()
+    {
+        // empty
+    }
+
+    /**
+     * How much of the memory the source renders with prepareToPlay() made 
+     * resident (and locked).  Not from the audio thread.
+     */
+    virtual RealtimeMemory::Stats getRealtimeMemoryStats() const
+    {
+        return {};
+    }
 };
 
 }
@@ -7,4 +7,5 @@ source $THISDIR/env.sh
 set -ex
 rm -fv $LOGF
 touch $LOGF
+rm -fv $LOGDIR/$NAME*.mtlog
 
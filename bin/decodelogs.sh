@@ -0,0 +1,17 @@
+#!/bin/bash
+
+# Decode the binary logs to text.  Extra args go to mtlogdecode (e.g. -w).
+
+THISDIR=$(dirname $(readlink -e ${BASH_SOURCE[0]}))
+
+source $THISDIR/env.sh
+
+DECODER=$THISDIR/../Builds/mtlogdecode
+
+set -e
+if [[ ! -x $DECODER || $THISDIR/../tools/mtlogdecode/mtlogdecode.cpp -nt $DECODER ]]; then
+    mkdir -p $(dirname $DECODER)
+    g++ -std=c++17 -O2 -o $DECODER $THISDIR/../tools/mtlogdecode/mtlogdecode.cpp
+fi
+
+$DECODER "$@" $BINLOGS
@@ -4,3 +4,6 @@ LOGDIR="$HOME/AppData/Roaming/$NAME"
 
 LOGF="$LOGDIR/$NAME.txt"
 SETTINGSF="$LOGDIR/$NAME.settings"
+
+# Binary logs (config::binaryLogging), oldest first
+BINLOGS="$(ls -r $LOGDIR/$NAME.*.mtlog 2>/dev/null) $LOGDIR/$NAME.mtlog"
@@ -0,0 +1,169 @@
+/**
+ * Loads N instances of the synth in one process, the way a host does for a
+ * big template, and reports the process's thread count, resident memory and
+ * CPU use while they sit idle (no notes playing), as real time passes.
+ *
+ * Build it with tools/instancebench/InstanceBench.jucer (a Projucer console
+ * application with all of Source/, and the plugin's JucePlugin_* definitions).
+ *
+ * Usage: InstanceBench [instances [seconds [sampleRate [blockSize]]]]
+ *        (defaults: 40 instances, 10 seconds, 48000Hz, 256 samples)
+ */
+
+#include <JuceHeader.h>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <psapi.h>
+ #include <tlhelp32.h>
+ #pragma comment(lib, "psapi.lib")
+#elif JUCE_MAC
+ #include <mach/mach.h>
+ #include <sys/resource.h>
+#else
+ #include <sys/resource.h>
+ #include <fstream>
+#endif
+
+using namespace juce;
+using namespace std;
+
+juce::AudioProcessor * JUCE_CALLTYPE createPluginFilter();
+
+namespace {
+
+// What the process is using
+struct Usage
+{
+    int threads = -1;
+    int64 residentBytes = -1;
+    // user + system, all threads
+    double cpuSeconds = 0.0;
+};
+
+Usage getUsage()
+{
+    Usage usage;
+#if JUCE_WINDOWS
+    const DWORD processId = GetCurrentProcessId();
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE) {
+        THREADENTRY32 entry;
+        entry.dwSize = sizeof(entry);
+        usage.threads = 0;
+        for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry)) {
+            if (entry.th32OwnerProcessID == processId)
+                ++usage.threads;
+        }
+        CloseHandle(snapshot);
+    }
+    PROCESS_MEMORY_COUNTERS memory;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory)))
+        usage.residentBytes = static_cast<int64>(memory.WorkingSetSize);
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+        auto toSeconds = [](const FILETIME & time) {
+            return static_cast<double>((static_cast<uint64>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1.0e-7;
+        };
+        usage.cpuSeconds = toSeconds(kernel) + toSeconds(user);
+    }
+#elif JUCE_MAC
+    thread_act_array_t threadList;
+    mach_msg_type_number_t threadCount = 0;
+    if (task_threads(mach_task_self(), &threadList, &threadCount) == KERN_SUCCESS) {
+        usage.threads = static_cast<int>(threadCount);
+        for (mach_msg_type_number_t ix = 0; ix < threadCount; ++ix)
+            mach_port_deallocate(mach_task_self(), threadList[ix]);
+        vm_deallocate(mach_task_self(), reinterpret_cast<vm_address_t>(threadList), threadCount * sizeof(thread_act_t));
+    }
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t infoCount = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &infoCount) == KERN_SUCCESS)
+        usage.residentBytes = static_cast<int64>(info.resident_size);
+#else
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0)
+            usage.threads = std::stoi(line.substr(8));
+        else if (line.rfind("VmRSS:", 0) == 0)
+            usage.residentBytes = std::stoll(line.substr(6)) * 1024;
+    }
+#endif
+#if ! JUCE_WINDOWS
+    rusage self;
+    if (getrusage(RUSAGE_SELF, &self) == 0) {
+        usage.cpuSeconds = self.ru_utime.tv_sec + self.ru_utime.tv_usec * 1.0e-6
+            + self.ru_stime.tv_sec + self.ru_stime.tv_usec * 1.0e-6;
+    }
+#endif
+    return usage;
+}
+
+String describe(const Usage & usage)
+{
+    return String(usage.threads) + " threads, " + String(usage.residentBytes / (1024.0 * 1024.0), 1) + "MB resident";
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    const int numInstances = argc > 1 ? String(argv[1]).getIntValue() : 40;
+    const double seconds = argc > 2 ? String(argv[2]).getDoubleValue() : 10.0;
+    const double sampleRate = argc > 3 ? String(argv[3]).getDoubleValue() : 48000.0;
+    const int blockSize = argc > 4 ? String(argv[4]).getIntValue() : 256;
+
+    ScopedJuceInitialiser_GUI juce;
+    const Usage before = getUsage();
+    std::cout << "Before loading: " << describe(before) << std::endl;
+
+    std::vector<std::unique_ptr<AudioProcessor>> instances;
+    for (int ix = 0; ix < numInstances; ++ix) {
+        instances.emplace_back(createPluginFilter());
+        instances.back()->setPlayConfigDetails(0, 2, sampleRate, blockSize);
+        instances.back()->prepareToPlay(sampleRate, blockSize);
+    }
+    const Usage loaded = getUsage();
+    std::cout << "With " << numInstances << " instances: " << describe(loaded)
+        << " (" << String((loaded.residentBytes - before.residentBytes) / (1024.0 * numInstances), 0)
+        << "KB and " << String((loaded.threads - before.threads) / static_cast<double>(numInstances), 2)
+        << " threads per instance)" << std::endl;
+
+    // Render every instance once a block, in real time, with nothing playing.
+    AudioBuffer<float> buffer(2, blockSize);
+    MidiBuffer midi;
+    const double blockMs = 1000.0 * blockSize / sampleRate;
+    const int numBlocks = static_cast<int>(seconds * sampleRate / blockSize);
+    double renderMs = 0.0;
+
+    const Usage start = getUsage();
+    const double startMs = Time::getMillisecondCounterHiRes();
+    for (int block = 0; block < numBlocks; ++block) {
+        const double blockStartMs = Time::getMillisecondCounterHiRes();
+        for (auto & pInstance : instances) {
+            midi.clear();
+            pInstance->processBlock(buffer, midi);
+        }
+        renderMs += Time::getMillisecondCounterHiRes() - blockStartMs;
+
+        const double nextBlockMs = startMs + (block + 1) * blockMs;
+        const double waitMs = nextBlockMs - Time::getMillisecondCounterHiRes();
+        if (waitMs > 0.0)
+            Thread::sleep(static_cast<int>(waitMs));
+    }
+    const double wallSeconds = (Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+    const Usage end = getUsage();
+
+    std::cout << "Idle for " << String(wallSeconds, 1) << "s: "
+        << String(100.0 * (end.cpuSeconds - start.cpuSeconds) / wallSeconds, 1) << "% of a core in total, "
+        << String(100.0 * renderMs / (wallSeconds * 1000.0), 2) << "% of the time rendering ("
+        << String(1000.0 * renderMs / (static_cast<double>(numBlocks) * numInstances), 2)
+        << "us per instance per block)" << std::endl;
+
+    for (auto & pInstance : instances) {
+        pInstance->releaseResources();
+    }
+    instances.clear();
+    return 0;
+}
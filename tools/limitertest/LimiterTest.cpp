@@ -0,0 +1,112 @@
+/**
+ * Checks that LimiterProcessor keeps its output under the ceiling.
+ *
+ * The worst case for the gain computer is a needed gain that keeps rising
+ * for longer than the lookahead, e.g. a loud note decaying after its crest:
+ * every needed gain stays in the hold queue, which then has to hold the
+ * whole window.  Each case here is a 100Hz tone decaying from well over the
+ * ceiling to under it, through the limiter with and without true peak
+ * detection, with a few release times, in a few block sizes and with and
+ * without an input gain ramp for the limiter to apply (see
+ * setInputGain()), and fails if any output sample is over the ceiling.  A slow release hides a wrong hold
+ * (the gain only creeps up towards it), so the fast ones matter most.
+ *
+ * Build it with tools/limitertest/LimiterTest.jucer (a Projucer console
+ * application).  Exits with 0 if every case passes, 1 if not.
+ *
+ * Usage: LimiterTest [sampleRate]   (default 48000Hz)
+ */
+
+#include <JuceHeader.h>
+
+#include "../../Source/LimiterProcessor.h"
+
+using namespace juce;
+using namespace std;
+
+namespace {
+
+const float ceiling = 0.94f;
+const double lookaheadSeconds = 0.0015;
+
+/**
+ * The tone, at frequency, decaying from startLevel to endLevel over the
+ * buffer.
+ */
+void makeDecayingTone(AudioBuffer<float> & buffer, const double sampleRate,
+    const double frequency, const float startLevel, const float endLevel)
+{
+    const int numSamples = buffer.getNumSamples();
+    for (int ix = 0; ix < numSamples; ++ix) {
+        const float level = startLevel * std::pow(endLevel / startLevel, static_cast<float>(ix) / numSamples);
+        const float sample = level * static_cast<float>(
+            std::sin(MathConstants<double>::twoPi * frequency * ix / sampleRate));
+        for (int chan = 0; chan < buffer.getNumChannels(); ++chan) {
+            buffer.setSample(chan, ix, sample);
+        }
+    }
+}
+
+/**
+ * Run the tone through a limiter in blocks of blockSize, optionally with an
+ * input gain rising from 0.5 to 3 over the tone, given to the limiter to
+ * apply.  Returns the loudest output sample.
+ */
+float runCase(const AudioBuffer<float> & input, const double sampleRate,
+    const int blockSize, const bool truePeak, const double releaseSeconds, const bool rampInput)
+{
+    LimiterProcessor limiter(ceiling, lookaheadSeconds, releaseSeconds, truePeak);
+    limiter.prepare({ sampleRate, static_cast<uint32>(blockSize), static_cast<uint32>(input.getNumChannels()) });
+
+    AudioBuffer<float> buffer(input);
+    const int numSamples = buffer.getNumSamples();
+    float loudest = 0.0f;
+    for (int start = 0; start < numSamples; start += blockSize) {
+        const int count = jmin(blockSize, numSamples - start);
+        dsp::AudioBlock<float> block(buffer.getArrayOfWritePointers(), 
+            static_cast<size_t>(buffer.getNumChannels()), static_cast<size_t>(start), static_cast<size_t>(count));
+        dsp::ProcessContextReplacing<float> context(block);
+        if (rampInput) {
+            const float startGain = 0.5f + 2.5f * start / numSamples;
+            const float endGain = 0.5f + 2.5f * (start + count) / numSamples;
+            limiter.setInputGain(startGain, endGain);
+        }
+        limiter.process(context);
+    }
+    for (int chan = 0; chan < buffer.getNumChannels(); ++chan) {
+        loudest = jmax(loudest, buffer.getMagnitude(chan, 0, numSamples));
+    }
+    return loudest;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    const double sampleRate = argc > 1 ? String(argv[1]).getDoubleValue() : 48000.0;
+
+    AudioBuffer<float> tone(2, static_cast<int>(sampleRate));
+    int failures = 0;
+    for (const float startLevel : { 2.0f, 4.0f, 16.0f }) {
+        makeDecayingTone(tone, sampleRate, 100.0, startLevel, 0.5f);
+        for (const bool truePeak : { false, true }) {
+            for (const double releaseSeconds : { 0.1, 0.01, 0.001 }) {
+                for (const int blockSize : { 1, 16, 64, 256, 1000 }) {
+                    for (const bool rampInput : { false, true }) {
+                        const float loudest = runCase(tone, sampleRate, blockSize, truePeak, releaseSeconds, rampInput);
+                        // only rounding over the ceiling
+                        const bool passed = loudest <= ceiling * 1.0001f;
+                        if (!passed)
+                            ++failures;
+                        cout << (passed ? "pass" : "FAIL") << ": from " << startLevel
+                            << ", true peak " << (truePeak ? "on" : "off") << ", release " << releaseSeconds
+                            << "s, blocks of " << blockSize << (rampInput ? ", input gain ramped" : "")
+                            << ": loudest " << loudest << " (ceiling " << ceiling << ")" << endl;
+                    }
+                }
+            }
+        }
+    }
+    cout << failures << " failures." << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+/**
+ * Turns MTLogger's binary logs (see Source/juce_igutil/BinaryLogFormat.h)
+ * back into text, the same as the text logs read.  Doesn't need Juce:
+ *
+ *     g++ -std=c++17 -O2 -o mtlogdecode tools/mtlogdecode/mtlogdecode.cpp
+ *
+ * Usage: mtlogdecode [-w] file...
+ *
+ * The files are decoded in the order given, so give rotated logs oldest
+ * first (e.g. midi-synthesiser.3.mtlog ... midi-synthesiser.mtlog).  -w also
+ * shows each message's wall clock time.
+ */
+
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../../Source/juce_igutil/BinaryLogFormat.h"
+
+using namespace juce_igutil;
+using namespace std;
+
+namespace {
+
+// Reads fields from a file's bytes, in order.
+class Reader
+{
+public:
+    explicit Reader(const vector<char> & _bytes): bytes(_bytes) {}
+
+    bool atEnd() const {
+        return position >= bytes.size();
+    }
+
+    template <typename T>
+    bool get(T & value)
+    {
+        if (position + sizeof(T) > bytes.size())
+            return false;
+        memcpy(&value, bytes.data() + position, sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+
+    bool getString(string & value, const size_t length)
+    {
+        if (position + length > bytes.size())
+            return false;
+        value.assign(bytes.data() + position, length);
+        position += length;
+        return true;
+    }
+
+    size_t getPosition() const {
+        return position;
+    }
+
+private:
+    const vector<char> & bytes;
+    size_t position = 0;
+};
+
+string formatWallClock(const int64_t ticks, const binarylog::FileHeader & header)
+{
+    const double ms = static_cast<double>(header.startTimeMs)
+        + 1000.0 * static_cast<double>(ticks - header.startTicks) / static_cast<double>(header.ticksPerSecond);
+    const time_t seconds = static_cast<time_t>(ms / 1000.0);
+    tm local;
+#if defined(_WIN32)
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    char text[64];
+    const size_t length = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    snprintf(text + length, sizeof(text) - length, ".%03d ",
+        static_cast<int>(static_cast<int64_t>(ms) % 1000));
+    return text;
+}
+
+/**
+ * Decode one file to out.  Returns false, having decoded what it could, if
+ * the file isn't a log or is cut short.
+ */
+bool decode(const string & fileName, const bool showWallClock, ostream & out)
+{
+    ifstream in(fileName, ios::binary);
+    if (! in) {
+        cerr << fileName << ": can't open" << endl;
+        return false;
+    }
+    const vector<char> bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    Reader reader(bytes);
+
+    binarylog::FileHeader header;
+    if (! reader.get(header) || memcmp(header.magic, binarylog::magic, sizeof(header.magic)) != 0) {
+        cerr << fileName << ": not a binary log" << endl;
+        return false;
+    }
+    if (header.version != binarylog::version) {
+        cerr << fileName << ": unknown version " << header.version << endl;
+        return false;
+    }
+
+    // the formats' and tags' texts, by id
+    unordered_map<uint16_t, string> strings;
+    while (! reader.atEnd()) {
+        const size_t recordStart = reader.getPosition();
+        uint8_t type = 0;
+        int64_t ticks = 0;
+        uint16_t tagId = binarylog::noTag;
+        bool ok = reader.get(type);
+        string message;
+
+        switch (type) {
+            case binarylog::stringDefinition: {
+                uint16_t id = 0;
+                uint16_t length = 0;
+                string text;
+                ok = ok && reader.get(id) && reader.get(length) && reader.getString(text, length);
+                if (ok) {
+                    strings[id] = text;
+                    continue;
+                }
+                break;
+            }
+            case binarylog::textMessage: {
+                uint16_t length = 0;
+                ok = ok && reader.get(ticks) && reader.get(tagId) && reader.get(length)
+                    && reader.getString(message, length);
+                break;
+            }
+            case binarylog::formattedMessage: {
+                uint16_t id = 0;
+                uint8_t numArgs = 0;
+                ok = ok && reader.get(ticks) && reader.get(tagId) && reader.get(id) && reader.get(numArgs);
+                vector<binarylog::Arg> args(numArgs);
+                for (auto & arg : args) {
+                    uint8_t argType = 0;
+                    ok = ok && reader.get(argType);
+                    arg.isInteger = argType == binarylog::integerArg;
+                    ok = ok && (arg.isInteger ? reader.get(arg.integer) : reader.get(arg.real));
+                }
+                const auto it = strings.find(id);
+                if (ok && it == strings.end()) {
+                    cerr << fileName << ": format " << id << " isn't defined, at byte " << recordStart << endl;
+                    return false;
+                }
+                if (ok) {
+                    message = binarylog::formatMessage(it->second.c_str(), args.data(), numArgs);
+                }
+                break;
+            }
+            case binarylog::droppedMessages: {
+                uint32_t count = 0;
+                ok = ok && reader.get(ticks) && reader.get(count);
+                message = "MTLogger - the queue was full; dropped " + to_string(count) + " messages.";
+                break;
+            }
+            default:
+                ok = false;
+                break;
+        }
+
+        const auto tag = strings.find(tagId);
+        if (ok && tagId != binarylog::noTag && tag == strings.end()) {
+            cerr << fileName << ": tag " << tagId << " isn't defined, at byte " << recordStart << endl;
+            return false;
+        }
+        if (! ok) {
+            cerr << fileName << ": bad or incomplete record at byte " << recordStart << endl;
+            return false;
+        }
+        if (showWallClock) {
+            out << formatWallClock(ticks, header);
+        }
+        out << binarylog::formatPrefix(ticks, header, tagId == binarylog::noTag ? nullptr : tag->second.c_str())
+            << message << '\n';
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    bool showWallClock = false;
+    vector<string> fileNames;
+    for (int ix = 1; ix < argc; ++ix) {
+        if (strcmp(argv[ix], "-w") == 0) {
+            showWallClock = true;
+        }
+        else {
+            fileNames.push_back(argv[ix]);
+        }
+    }
+    if (fileNames.empty()) {
+        cerr << "Usage: mtlogdecode [-w] file..." << endl;
+        return 2;
+    }
+
+    bool ok = true;
+    for (const auto & fileName : fileNames) {
+        ok = decode(fileName, showWallClock, cout) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+/**
+ * Renders a script of midi and parameter changes through the synth in a
+ * RT_SANITIZER build, and fails if the audio thread (or a thread helping it)
+ * allocated, locked or blocked while doing it.  See
+ * Source/juce_igutil/RealtimeSanitizer.h.
+ *
+ * Build it with tools/rtsanitizer/RealtimeSanitizerDriver.jucer (a Projucer
+ * console application with all of Source/, the plugin's JucePlugin_*
+ * definitions and RT_SANITIZER=1).  On Linux, malloc, locks and blocking
+ * calls are caught as well as operator new and delete.
+ *
+ * Usage: RealtimeSanitizerDriver script [sampleRate [blockSize]] [--abort]
+ *        (defaults: 48000Hz, 256 samples)
+ *
+ * Each line of a script is a time in seconds and a command:
+ *
+ *     0.0   note-on 1 60 100       channel, note, velocity
+ *     0.5   note-off 1 60          channel, note
+ *     0.5   cc 1 64 127            channel, controller, value
+ *     0.5   pitch 1 12000          channel, value (0 - 16383)
+ *     1.0   param cutoff 800       parameter id, value (not normalised)
+ *     4.0   end                    stop rendering here
+ *
+ * Blank lines and lines starting with # are ignored.  The midi goes into the
+ * block it falls in, at its sample; parameters are set between blocks, from
+ * the driver's thread, as a host's automation or UI would.  Rendering is as
+ * fast as it can go, not in real time.
+ */
+
+#include <JuceHeader.h>
+
+#include "../../Source/juce_igutil/RealtimeSanitizer.h"
+
+using namespace juce;
+using namespace juce_igutil;
+using namespace std;
+
+juce::AudioProcessor * JUCE_CALLTYPE createPluginFilter();
+
+namespace {
+
+struct Event
+{
+    double seconds = 0.0;
+    StringArray tokens;
+    int lineNumber = 0;
+};
+
+/**
+ * Read a script.  Returns false, having said why, if it can't.
+ */
+bool readScript(const File & file, vector<Event> & events, double & endSeconds)
+{
+    if (! file.existsAsFile()) {
+        cerr << file.getFullPathName() << ": not found" << endl;
+        return false;
+    }
+    StringArray lines;
+    file.readLines(lines);
+    endSeconds = 0.0;
+    for (int ix = 0; ix < lines.size(); ++ix) {
+        const String line = lines[ix].trim();
+        if (line.isEmpty() || line.startsWith("#"))
+            continue;
+        Event event;
+        event.tokens = StringArray::fromTokens(line, true);
+        event.lineNumber = ix + 1;
+        event.seconds = event.tokens[0].getDoubleValue();
+        event.tokens.remove(0);
+        endSeconds = jmax(endSeconds, event.seconds);
+        events.push_back(event);
+    }
+    stable_sort(events.begin(), events.end(), [](const Event & a, const Event & b) {
+        return a.seconds < b.seconds;
+    });
+    return true;
+}
+
+/**
+ * A parameter by id
+ */
+RangedAudioParameter * findParameter(AudioProcessor & processor, const String & id)
+{
+    for (auto * pParameter : processor.getParameters()) {
+        if (auto * pRanged = dynamic_cast<RangedAudioParameter *>(pParameter)) {
+            if (pRanged->paramID == id)
+                return pRanged;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Apply a parameter change, or add an event's midi to the block.  Returns
+ * false if the event doesn't make sense.
+ */
+bool applyEvent(const Event & event, AudioProcessor & processor, MidiBuffer & midi, const int sampleInBlock)
+{
+    const String & command = event.tokens[0];
+    auto number = [&event](const int index) { return event.tokens[index].getIntValue(); };
+
+    if (command == "note-on" && event.tokens.size() == 4) {
+        midi.addEvent(MidiMessage::noteOn(number(1), number(2), static_cast<uint8>(number(3))), sampleInBlock);
+    }
+    else if (command == "note-off" && event.tokens.size() == 3) {
+        midi.addEvent(MidiMessage::noteOff(number(1), number(2)), sampleInBlock);
+    }
+    else if (command == "cc" && event.tokens.size() == 4) {
+        midi.addEvent(MidiMessage::controllerEvent(number(1), number(2), number(3)), sampleInBlock);
+    }
+    else if (command == "pitch" && event.tokens.size() == 3) {
+        midi.addEvent(MidiMessage::pitchWheel(number(1), number(2)), sampleInBlock);
+    }
+    else if (command == "param" && event.tokens.size() == 3) {
+        auto * pParameter = findParameter(processor, event.tokens[1]);
+        if (pParameter == nullptr) {
+            cerr << "line " << event.lineNumber << ": no parameter " << event.tokens[1] << endl;
+            return false;
+        }
+        pParameter->setValueNotifyingHost(pParameter->convertTo0to1(event.tokens[2].getFloatValue()));
+    }
+    else if (command != "end") {
+        cerr << "line " << event.lineNumber << ": can't understand it" << endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    StringArray args;
+    bool abortOnViolation = false;
+    for (int ix = 1; ix < argc; ++ix) {
+        if (String(argv[ix]) == "--abort")
+            abortOnViolation = true;
+        else
+            args.add(argv[ix]);
+    }
+    if (args.isEmpty()) {
+        cerr << "Usage: RealtimeSanitizerDriver script [sampleRate [blockSize]] [--abort]" << endl;
+        return 2;
+    }
+#if ! RT_SANITIZER
+    cerr << "Warning: built without RT_SANITIZER, so nothing will be caught." << endl;
+#endif
+
+    const double sampleRate = args.size() > 1 ? args[1].getDoubleValue() : 48000.0;
+    const int blockSize = args.size() > 2 ? args[2].getIntValue() : 256;
+
+    ScopedJuceInitialiser_GUI juce;
+    vector<Event> events;
+    double endSeconds = 0.0;
+    if (! readScript(File::getCurrentWorkingDirectory().getChildFile(args[0]), events, endSeconds))
+        return 2;
+
+    unique_ptr<AudioProcessor> pProcessor(createPluginFilter());
+    pProcessor->setPlayConfigDetails(0, 2, sampleRate, blockSize);
+    pProcessor->prepareToPlay(sampleRate, blockSize);
+    RealtimeSanitizer::setAbortOnViolation(abortOnViolation);
+    const int64 violationsBefore = RealtimeSanitizer::getViolationCount();
+
+    AudioBuffer<float> buffer(2, blockSize);
+    MidiBuffer midi;
+    midi.ensureSize(4096);
+    size_t nextEvent = 0;
+    const int64 endSample = static_cast<int64>(endSeconds * sampleRate) + blockSize;
+    for (int64 blockStart = 0; blockStart < endSample; blockStart += blockSize) {
+        midi.clear();
+        while (nextEvent < events.size()) {
+            const Event & event = events[nextEvent];
+            const int64 sample = static_cast<int64>(event.seconds * sampleRate);
+            if (sample >= blockStart + blockSize)
+                break;
+            if (! applyEvent(event, *pProcessor, midi, static_cast<int>(sample - blockStart)))
+                return 2;
+            ++nextEvent;
+        }
+        buffer.clear();
+        pProcessor->processBlock(buffer, midi);
+    }
+    pProcessor->releaseResources();
+
+    const int64 violations = RealtimeSanitizer::getViolationCount() - violationsBefore;
+    cout << "Rendered " << String(endSample / sampleRate, 2) << "s in blocks of " << blockSize
+        << ": " << violations << " realtime violations." << endl;
+    return violations == 0 ? 0 : 1;
+}